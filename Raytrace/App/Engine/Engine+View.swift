@@ -30,12 +30,12 @@ extension Engine {
                 meshes = []
 
                 do {
-                    let raw = MDLMesh.init(
-                        try! .load(
-                            url: Bundle.main.url(forResource: "Spot", withExtension: "obj", subdirectory: "Farm/Spot")!,
-                            with: device
-                        ).first!,
-                        indexType: .uint16
+                    // Spot is imported once and loaded from its cooked blob from then on.
+                    // Its triangles are compact if the app is launched with --compact-triangles.
+                    let raw = try! Raytrace.Mesh.Cooked.load(
+                        cooking: Bundle.main.url(forResource: "Spot", withExtension: "obj", subdirectory: "Farm/Spot")!,
+                        with: device,
+                        layout: ProcessInfo.processInfo.arguments.contains("--compact-triangles") ? .compactTriangle : .triangle
                     )
 
                     do {
@@ -94,7 +94,7 @@ extension Engine {
                             geometryType: .triangles,
                             allocator: MTKMeshBufferAllocator.init(device: device)
                         ),
-                        indexType: .uint16
+                        indexType: .uint32
                     )
 
                     var mesh = try! raw.toMesh(
@@ -131,7 +131,7 @@ extension Engine {
                             geometryType: .triangles,
                             allocator: MTKMeshBufferAllocator.init(device: device)
                         ),
-                        indexType: .uint16
+                        indexType: .uint32
                     )
 
                     var mesh = try! raw.toMesh(
@@ -207,6 +207,10 @@ extension Engine.View: MTKViewDelegate {
                     )
                 )
 
+                shader.raytrace.encodeMeasure(to: command)
+
+                shader.denoise.encode(to: command, raytrace: shader.raytrace)
+
                 shader.echo.encode(
                     to: command,
                     as: currentRenderPassDescriptor!,
@@ -215,8 +219,17 @@ extension Engine.View: MTKViewDelegate {
 
                 command.present(currentDrawable!)
             }
-        }
 
-        renderFrame!.id += 1
+            // The schedule of the next pass depends on the noise of this one, which it has to wait for.
+            // We know the camera and the scene never change for now, so stop once no tile needs samples,
+            // and keep the frame, as the accumulation never starts over.
+            command.waitUntilCompleted()
+
+            let convergence = shader.raytrace.convergence()
+            if !self.shader!.raytrace.schedule.advance(with: convergence) {
+                print("Noise: \(convergence.error) (threshold \(shader.raytrace.schedule.options.threshold))")
+                isPaused = true
+            }
+        }
     }
 }
@@ -3,6 +3,7 @@
 import ModelIO
 import Metal
 import MetalKit
+import simd
 
 extension Raytrace {
     struct Accelerator {
@@ -91,10 +92,31 @@ extension Raytrace.Accelerator.Primitive {
 extension Raytrace.Accelerator {
     struct Instanced {
         var target: (any MTLAccelerationStructure)?
+
+        // What the last build has left for the next encodes, which move the same instances in place.
+        var built: Built?
+    }
+}
+
+extension Raytrace.Accelerator.Instanced {
+    struct Built {
+        var structures: [any MTLAccelerationStructure]
+        var instances: any MTLBuffer
+        var scratch: any MTLBuffer
+
+        // Where the instances were when they were built, see drift.
+        var translates: [SIMD3<Float>]
+        var extent: Float
     }
 }
 
 extension Raytrace.Accelerator.Instanced {
+    // Refitting keeps the tree that was built for where the instances were,
+    // so rebuild it once they have drifted by this much of the extent of the scene since then.
+    static let maxDrift: Float = 0.25
+
+    // Refits the structure if only the transforms of the instances have changed since the last build, and rebuilds it otherwise,
+    // reusing the structure, the instance buffer and the scratch buffer as long as they are large enough.
     mutating func encode(
         _ meshes: [Raytrace.Mesh],
         to buffer: some MTLCommandBuffer
@@ -104,62 +126,110 @@ extension Raytrace.Accelerator.Instanced {
 
         encoder.label = "Accelerator/Instanced"
 
-        let desc: MTLInstanceAccelerationStructureDescriptor = describe(
-            meshes,
-            with: encoder.device
+        let structures = meshes.map { $0.accelerationStructure! }
+        let instances = describe(meshes)
+        let translates = meshes.flatMap { mesh in mesh.instances.map { $0.transform.translate } }
+
+        if let built = built, let target = target, Self.canRefit(built, to: structures, translates: translates) {
+            write(instances, to: built.instances)
+
+            encoder.refit(
+                sourceAccelerationStructure: target,
+                descriptor: describe(structures, instances: built.instances, count: instances.count),
+                destinationAccelerationStructure: nil,
+                scratchBuffer: built.scratch,
+                scratchBufferOffset: 0
+            )
+
+            return
+        }
+
+        let instanceBuffer = reuse(
+            built?.instances,
+            length: MemoryLayout<MTLAccelerationStructureUserIDInstanceDescriptor>.stride * max(instances.count, 1),
+            with: encoder.device,
+            options: .storageModeShared
         )
+        write(instances, to: instanceBuffer)
+
+        let desc = describe(structures, instances: instanceBuffer, count: instances.count)
         let sizes = encoder.device.accelerationStructureSizes(descriptor: desc)
 
-        target = encoder.device.makeAccelerationStructure(size: sizes.accelerationStructureSize)
+        if target == nil || target!.size < sizes.accelerationStructureSize {
+            target = encoder.device.makeAccelerationStructure(size: sizes.accelerationStructureSize)
+        }
+
+        let scratch = reuse(
+            built?.scratch,
+            length: max(sizes.buildScratchBufferSize, sizes.refitScratchBufferSize),
+            with: encoder.device,
+            options: .storageModePrivate
+        )
 
         encoder.build(
             accelerationStructure: target!,
             descriptor: desc,
-            scratchBuffer: encoder.device.makeBuffer(
-                length: sizes.buildScratchBufferSize,
-                options: .storageModePrivate
-            )!,
+            scratchBuffer: scratch,
             scratchBufferOffset: 0
         )
+
+        built = .init(
+            structures: structures,
+            instances: instanceBuffer,
+            scratch: scratch,
+            translates: translates,
+            extent: Self.extent(of: meshes)
+        )
     }
 
     private func describe(
-        _ meshes: [Raytrace.Mesh],
-        with device: some MTLDevice
+        _ structures: [any MTLAccelerationStructure],
+        instances: any MTLBuffer,
+        count: Int
     ) -> MTLInstanceAccelerationStructureDescriptor {
         let desc = MTLInstanceAccelerationStructureDescriptor.init()
 
-        desc.instancedAccelerationStructures = meshes.map { $0.accelerationStructure! }
+        desc.instancedAccelerationStructures = structures
+
+        desc.instanceDescriptorType = .userID
+        desc.instanceDescriptorBuffer = instances
+        desc.instanceCount = count
+
+        desc.usage = .refit
+
+        return desc
+    }
 
-        let instances = meshes.enumerated().reduce(
-            into: []
-        ) { result, mesh in
-            result.append(
+    private func describe(_ meshes: [Raytrace.Mesh]) -> [MTLAccelerationStructureUserIDInstanceDescriptor] {
+        // The pieces of all the meshes are laid out one mesh after another, where each instance points at the first of its mesh.
+        var instances: [MTLAccelerationStructureUserIDInstanceDescriptor] = []
+        var pieceBase = 0
+
+        for (i, mesh) in meshes.enumerated() {
+            instances.append(
                 contentsOf: describe(
-                    mesh.element.instances,
-                    of: .init(mesh.offset)
+                    mesh.instances,
+                    of: .init(i),
+                    pieceBase: .init(pieceBase)
                 )
             )
-        }
-
-        desc.instanceDescriptorBuffer = Raytrace.Metal.Buffer.buildable(instances).build(
-            with: device,
-            options: .storageModeShared
-        )
 
-        desc.instanceCount = instances.count
+            pieceBase += mesh.pieces.count
+        }
 
-        return desc
+        return instances
     }
 
     private func describe(
         _ instances: [Raytrace.Mesh.Instance],
-        of accelerator: UInt32
-    ) -> [MTLAccelerationStructureInstanceDescriptor] {
+        of accelerator: UInt32,
+        pieceBase: UInt32
+    ) -> [MTLAccelerationStructureUserIDInstanceDescriptor] {
         return instances.map { instance in
-            var desc = MTLAccelerationStructureInstanceDescriptor.init()
+            var desc = MTLAccelerationStructureUserIDInstanceDescriptor.init()
 
             desc.accelerationStructureIndex = accelerator
+            desc.userID = pieceBase
 
             desc.transformationMatrix = .init(instance.transform.resolve())
 
@@ -169,4 +239,69 @@ extension Raytrace.Accelerator.Instanced {
             return desc
         }
     }
+
+    // The caller waits for the frame that reads the buffer before the next encode, so it is written in place.
+    private func write(
+        _ instances: [MTLAccelerationStructureUserIDInstanceDescriptor],
+        to buffer: any MTLBuffer
+    ) {
+        instances.withUnsafeBytes { bytes in
+            guard let base = bytes.baseAddress else { return }
+            buffer.contents().copyMemory(from: base, byteCount: bytes.count)
+        }
+    }
+
+    private func reuse(
+        _ buffer: (any MTLBuffer)?,
+        length: Int,
+        with device: some MTLDevice,
+        options: MTLResourceOptions
+    ) -> any MTLBuffer {
+        if let buffer = buffer, buffer.length >= length {
+            return buffer
+        }
+
+        return device.makeBuffer(length: length, options: options)!
+    }
+}
+
+extension Raytrace.Accelerator.Instanced {
+    // Refitting needs the same instances of the same structures in the same order.
+    static func canRefit(
+        _ built: Built,
+        to structures: [any MTLAccelerationStructure],
+        translates: [SIMD3<Float>]
+    ) -> Bool {
+        return built.structures.count == structures.count
+            && zip(built.structures, structures).allSatisfy { $0 === $1 }
+            && built.translates.count == translates.count
+            && drift(of: translates, from: built) <= maxDrift
+    }
+
+    // The app keeps no bounds of the meshes, so the GPU structure cannot tell how much refitting has cost it.
+    // Instead, this measures how far the instances have moved since the build against the extent of the scene then,
+    // where the scale of each instance stands in for the size of its mesh.
+    static func drift(of translates: [SIMD3<Float>], from built: Built) -> Float {
+        var drift: Float = 0
+
+        for (translate, builtTranslate) in zip(translates, built.translates) {
+            drift = max(drift, simd_distance(translate, builtTranslate))
+        }
+
+        return drift / built.extent
+    }
+
+    static func extent(of meshes: [Raytrace.Mesh]) -> Float {
+        var min = SIMD3<Float>.init(repeating: .infinity)
+        var max = SIMD3<Float>.init(repeating: -.infinity)
+
+        for mesh in meshes {
+            for instance in mesh.instances {
+                min = simd_min(min, instance.transform.translate - instance.transform.scale)
+                max = simd_max(max, instance.transform.translate + instance.transform.scale)
+            }
+        }
+
+        return Swift.max(simd_distance(min, max), 1e-3)
+    }
 }
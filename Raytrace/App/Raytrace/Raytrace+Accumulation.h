@@ -0,0 +1,77 @@
+// tomocy
+
+#pragma once
+
+#include <metal_stdlib>
+
+namespace Raytrace {
+// Accumulation is the running mean of the samples of a pixel,
+// with the sum of the squared differences of their luminance from it (Welford's method),
+// which a texel holds as (mean, m2) while the frame knows the count.
+struct Accumulation {
+public:
+    // The side of the square tiles that the noise is measured by.
+    static constexpr constant uint32_t tileSize = 16;
+
+    // Fewer samples than this may agree by chance, so their variance is not trusted.
+    static constexpr constant uint32_t minCount = 4;
+
+public:
+    static Accumulation from(const float4 texel, const uint32_t count)
+    {
+        if (count == 0) {
+            return {};
+        }
+
+        return {
+            .mean = texel.rgb,
+            .m2 = texel.a,
+            .count = count,
+        };
+    }
+
+public:
+    Accumulation adding(const float3 sample) const
+    {
+        const auto nextCount = count + 1;
+        const auto nextMean = mean + (sample - mean) / float(nextCount);
+
+        const auto luminance = luminanceOf(sample);
+
+        return {
+            .mean = nextMean,
+            .m2 = m2 + (luminance - luminanceOf(mean)) * (luminance - luminanceOf(nextMean)),
+            .count = nextCount,
+        };
+    }
+
+    float4 toTexel() const { return float4(mean, m2); }
+
+public:
+    // The standard error of the mean luminance relative to itself,
+    // which is infinite until there are samples enough to tell the variance.
+    float error() const
+    {
+        if (count < minCount) {
+            return INFINITY;
+        }
+
+        // Keep dark pixels from asking for samples forever, as their noise is hardly visible.
+        return metal::sqrt(varianceOfMean()) / metal::max(luminanceOf(mean), 1e-2f);
+    }
+
+    // The variance of the mean luminance, which only means something from minCount samples.
+    float varianceOfMean() const { return m2 / float(count - 1) / float(count); }
+
+public:
+    static float luminanceOf(const float3 color)
+    {
+        return metal::dot(color, float3(0.2126, 0.7152, 0.0722));
+    }
+
+public:
+    float3 mean = 0;
+    float m2 = 0;
+    uint32_t count = 0;
+};
+}
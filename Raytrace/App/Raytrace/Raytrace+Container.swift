@@ -0,0 +1,188 @@
+// tomocy
+
+import Foundation
+import Metal
+
+extension Raytrace {
+    // Container reads what Prelight writes as a container (.prelit), see Container there for the layout.
+    // The file is mapped and wrapped in a buffer without a copy, from which the GPU uploads the levels,
+    // so that nothing decodes the texels at launch.
+    enum Container {}
+}
+
+extension Raytrace.Container {
+    static let magic: [UInt8] = Array("PLIT".utf8)
+    static let version: UInt32 = 1
+}
+
+extension Raytrace.Container {
+    enum Format: UInt32 {
+        case rgba16Float = 0
+        case rgb9e5Float = 1
+        case rg16Float = 2
+    }
+}
+
+extension Raytrace.Container.Format {
+    var pixelFormat: MTLPixelFormat {
+        switch self {
+        case .rgba16Float:
+            return .rgba16Float
+        case .rgb9e5Float:
+            return .rgb9e5Float
+        case .rg16Float:
+            return .rg16Float
+        }
+    }
+
+    var bytesPerPixel: Int {
+        switch self {
+        case .rgba16Float:
+            return 8
+        case .rgb9e5Float, .rg16Float:
+            return 4
+        }
+    }
+}
+
+extension Raytrace.Container {
+    struct Header {
+        var format: Format
+        var faceCount: Int
+        var size: Int
+        var levelCount: Int
+        var alignment: Int
+    }
+}
+
+extension Raytrace.Container.Header {
+    static func read(from source: UnsafeRawPointer, length: Int) throws -> Self {
+        guard length >= 28,
+              Array(UnsafeRawBufferPointer.init(start: source, count: 4)) == Raytrace.Container.magic else {
+            throw Raytrace.Container.Error.broken("not a container")
+        }
+
+        let valueAt = { (i: Int) in
+            Int(UInt32(littleEndian: source.loadUnaligned(fromByteOffset: 4 + i * 4, as: UInt32.self)))
+        }
+
+        guard UInt32(valueAt(0)) == Raytrace.Container.version else {
+            throw Raytrace.Container.Error.broken("version \(valueAt(0))")
+        }
+        guard let format = Raytrace.Container.Format.init(rawValue: UInt32(valueAt(1))) else {
+            throw Raytrace.Container.Error.broken("format \(valueAt(1))")
+        }
+
+        let header = Self.init(
+            format: format,
+            faceCount: valueAt(2),
+            size: valueAt(3),
+            levelCount: valueAt(4),
+            alignment: valueAt(5)
+        )
+
+        guard header.faceCount == 1 || header.faceCount == 6,
+              header.size > 0, header.levelCount > 0, header.alignment > 0,
+              header.offset(at: header.levelCount, face: 0) <= length else {
+            throw Raytrace.Container.Error.broken("truncated")
+        }
+
+        return header
+    }
+}
+
+extension Raytrace.Container.Header {
+    func size(at level: Int) -> Int {
+        return max(size >> level, 1)
+    }
+
+    func length(at level: Int) -> Int {
+        let size = size(at: level)
+        return size * size * format.bytesPerPixel
+    }
+
+    func offset(at level: Int, face: Int) -> Int {
+        var offset = alignment
+
+        for other in 0..<level {
+            offset += length(at: other).align(by: alignment) * faceCount
+        }
+
+        return offset + length(at: level).align(by: alignment) * face
+    }
+}
+
+extension Raytrace.Container {
+    enum Error: Swift.Error {
+        case broken(String)
+    }
+}
+
+extension Raytrace.Container {
+    // Loads the container into a private texture, which is a cube if it has 6 faces and 2D otherwise.
+    static func load(at url: URL, with device: some MTLDevice, label: String) throws -> any MTLTexture {
+        let buffer = try map(url, with: device)
+        let header = try Header.read(from: buffer.contents(), length: buffer.length)
+
+        let desc = header.faceCount == 6
+            ? MTLTextureDescriptor.textureCubeDescriptor(
+                pixelFormat: header.format.pixelFormat,
+                size: header.size,
+                mipmapped: header.levelCount > 1
+            )
+            : MTLTextureDescriptor.texture2DDescriptor(
+                pixelFormat: header.format.pixelFormat,
+                width: header.size,
+                height: header.size,
+                mipmapped: header.levelCount > 1
+            )
+        desc.mipmapLevelCount = header.levelCount
+        desc.usage = .shaderRead
+        desc.storageMode = .private
+
+        let texture = device.makeTexture(descriptor: desc)!
+        texture.label = label
+
+        let command = device.makeCommandQueue()!.makeCommandBuffer()!
+
+        do {
+            let encoder = command.makeBlitCommandEncoder()!
+            defer { encoder.endEncoding() }
+
+            for level in 0..<header.levelCount {
+                let size = header.size(at: level)
+
+                for face in 0..<header.faceCount {
+                    encoder.copy(
+                        from: buffer,
+                        sourceOffset: header.offset(at: level, face: face),
+                        sourceBytesPerRow: size * header.format.bytesPerPixel,
+                        sourceBytesPerImage: header.length(at: level),
+                        sourceSize: .init(width: size, height: size, depth: 1),
+                        to: texture,
+                        destinationSlice: face,
+                        destinationLevel: level,
+                        destinationOrigin: .init(x: 0, y: 0, z: 0)
+                    )
+                }
+            }
+        }
+
+        command.commit()
+        command.waitUntilCompleted()
+
+        return texture
+    }
+
+    // Maps the whole file into a buffer.
+    // Prelight pads the file to whole pages, as a buffer without a copy takes nothing less.
+    private static func map(_ url: URL, with device: some MTLDevice) throws -> any MTLBuffer {
+        let mapping = try Raytrace.Memory.Mapping.init(url)
+
+        guard let buffer = mapping.buffer(at: 0, length: mapping.length, with: device, label: url.lastPathComponent) else {
+            throw Error.broken("not padded to whole pages: \(url.lastPathComponent)")
+        }
+
+        return buffer
+    }
+}
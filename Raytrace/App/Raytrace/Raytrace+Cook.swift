@@ -0,0 +1,353 @@
+// tomocy
+
+import Foundation
+import Metal
+import ModelIO
+
+extension Raytrace.Mesh {
+    // Cooked is a mesh imported once and saved as a blob (.mesh) whose sections are already laid out as the GPU reads them,
+    // so that loading it takes a mapping and a buffer for each section, with no work for each vertex.
+    //
+    // The table takes the first pages:
+    //   magic "MESH", then UInt32s of version, vertex count, piece count and material count, and UInt64 of the offset of the positions,
+    //   then for each piece, UInt32s of index type (MTLIndexType) and index count, UInt64s of the offsets of the indices and the data,
+    //   Int32 of the material, or -1 for none, and UInt32 of the layout of the data (Raytrace::Primitive::Layout),
+    //   then for each material, UInt32 of the length of the path of the albedo relative to the source, and the path in UTF-8 padded to 4.
+    // The positions (packed float3), then the indices and the data (as the layout tells) of each piece follow,
+    // each starting on a page of alignment bytes and padded to whole pages.
+    struct Cooked {
+        var positions: Positions
+        var pieces: [Piece]
+
+        // The albedo of each material, if it has one.
+        var albedoURLs: [URL?]
+    }
+}
+
+extension Raytrace.Mesh.Cooked {
+    static let magic: [UInt8] = Array("MESH".utf8)
+    static let version: UInt32 = 3
+
+    // The pages of Apple silicon, which are also whole pages of Intel Macs.
+    static let alignment = 16384
+}
+
+extension Raytrace.Mesh.Cooked {
+    struct Piece {
+        var indices: Raytrace.Mesh.Indices
+        var data: Raytrace.Primitive.Data
+        var material: Int?
+    }
+}
+
+extension Raytrace.Mesh.Cooked {
+    func toMesh(with device: some MTLDevice, instances: [Raytrace.Mesh.Instance]) throws -> Raytrace.Mesh {
+        // The pieces of a material share it, which is loaded once.
+        let materials = try albedoURLs.map { try Raytrace.Material.init(albedo: $0, device: device) }
+
+        return .init(
+            pieces: pieces.map { piece in
+                .init(
+                    type: .triangle,
+                    indices: piece.indices,
+                    data: piece.data,
+                    material: piece.material.map { materials[$0] }
+                )
+            },
+            positions: positions,
+            instances: instances
+        )
+    }
+}
+
+extension Raytrace.Mesh.Cooked {
+    enum Error: Swift.Error {
+        case broken(String)
+    }
+}
+
+extension Raytrace.Mesh.Cooked {
+    // Loads the source from its cooked blob in the caches,
+    // cooking it first if there is none yet or the source has changed since.
+    // Each layout of the data of the triangles has a blob of its own.
+    static func load(
+        cooking source: URL,
+        with device: some MTLDevice,
+        layout: Raytrace.Primitive.Layout = .triangle
+    ) throws -> Self {
+        let url = try cacheURL(for: source, layout: layout)
+        let directory = source.deletingLastPathComponent()
+
+        if let cooked = try? load(at: url, relativeTo: directory, with: device) {
+            return cooked
+        }
+
+        let raw = MDLMesh.init(
+            try MDLMesh.load(url: source, with: device).first!,
+            indexType: .uint32
+        )
+
+        try FileManager.default.createDirectory(at: url.deletingLastPathComponent(), withIntermediateDirectories: true)
+        try cook(raw, relativeTo: directory, to: url, layout: layout)
+
+        return try load(at: url, relativeTo: directory, with: device)
+    }
+
+    // Names the blob after FNV-1a over the version, the layout and the path, the size and the modification date of the source.
+    private static func cacheURL(for source: URL, layout: Raytrace.Primitive.Layout) throws -> URL {
+        let attributes = try FileManager.default.attributesOfItem(atPath: source.path())
+        let size = (attributes[.size] as? NSNumber)?.uint64Value ?? 0
+        let date = (attributes[.modificationDate] as? Date)?.timeIntervalSince1970 ?? 0
+
+        var key = UInt64(14695981039346656037)
+        let hash = { (bytes: UnsafeRawBufferPointer) in
+            for byte in bytes {
+                key = (key ^ UInt64(byte)) &* 1099511628211
+            }
+        }
+
+        withUnsafeBytes(of: version.littleEndian, hash)
+        withUnsafeBytes(of: layout.rawValue.littleEndian, hash)
+        Array(source.path().utf8).withUnsafeBytes(hash)
+        withUnsafeBytes(of: size.littleEndian, hash)
+        withUnsafeBytes(of: date.bitPattern.littleEndian, hash)
+
+        return FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask)[0]
+            .appending(path: "Raytrace/Mesh")
+            .appending(path: String(format: "%016llx.mesh", key))
+    }
+}
+
+extension Raytrace.Mesh.Cooked {
+    // Cooks the mesh into a blob at the url with a piece for each cluster of each submesh,
+    // keeping the paths of the textures relative to the directory if they lie in it.
+    static func cook(_ raw: MDLMesh, relativeTo directory: URL, to url: URL, layout: Raytrace.Primitive.Layout) throws {
+        assert(
+            raw.vertexDescriptor.defaultLayouts![0].stride == MemoryLayout<MDLMesh.Layout.PNT>.stride
+        )
+
+        let vertices: [MDLMesh.Layout.PNT] = raw.vertexBuffers.first!.contents().toArray(count: raw.vertexCount)
+        let positions = vertices.map { $0.position }
+
+        let submeshes = raw.defaultSubmeshes!
+
+        // The clusters of each submesh, with the index of the submesh.
+        let clusters = submeshes.enumerated().flatMap { i, submesh in
+            submesh.toClusters(vertices: vertices, layout: layout).map { (submeshI: i, cluster: $0) }
+        }
+
+        // The path of the albedo of each submesh, which is empty if the material has none, and nil if the submesh has no material.
+        let paths = submeshes.map { submesh -> [UInt8]? in
+            guard let material = submesh.material else { return nil }
+            guard let url = material.property(with: .baseColor)?.urlValue else { return [] }
+
+            let prefix = directory.path().hasSuffix("/") ? directory.path() : directory.path() + "/"
+            let path = url.path()
+
+            return Array((path.hasPrefix(prefix) ? String(path.dropFirst(prefix.count)) : path).utf8)
+        }
+        let materialPaths = paths.compactMap { $0 }
+
+        // The index of the material of each submesh in the table.
+        var materialCount = Int32(0)
+        let materialIs = paths.map { path -> Int32 in
+            guard path != nil else { return -1 }
+            defer { materialCount += 1 }
+            return materialCount
+        }
+
+        let tableLength = 4 + 4 * 4 + 8
+            + clusters.count * 32
+            + materialPaths.reduce(0) { $0 + 4 + $1.count.align(by: 4) }
+
+        var length = tableLength.align(by: alignment)
+        let place = { (count: Int) -> Int in
+            defer { length += count.align(by: alignment) }
+            return length
+        }
+
+        let positionsOffset = place(positions.count * MemoryLayout<SIMD3<Float>.Packed>.stride)
+        let pieceOffsets = clusters.map { each in
+            (
+                indices: place(each.cluster.indices.withUnsafeBytes { $0.count }),
+                data: place(each.cluster.data.withUnsafeBytes { $0.count })
+            )
+        }
+
+        var data = Data.init(count: length)
+
+        data.withUnsafeMutableBytes { bytes in
+            let destination = bytes.baseAddress!
+
+            do {
+                var offset = 0
+                let write = { (value: UnsafeRawBufferPointer) in
+                    destination.copy(from: value.baseAddress!, count: value.count, offset: offset)
+                    offset += value.count
+                }
+
+                magic.withUnsafeBytes(write)
+                for value in [version, UInt32(raw.vertexCount), UInt32(clusters.count), UInt32(materialPaths.count)] {
+                    withUnsafeBytes(of: value.littleEndian, write)
+                }
+                withUnsafeBytes(of: UInt64(positionsOffset).littleEndian, write)
+
+                for (i, offsets) in pieceOffsets.enumerated() {
+                    let (submeshI, cluster) = clusters[i]
+
+                    withUnsafeBytes(of: UInt32(cluster.indices.type.rawValue).littleEndian, write)
+                    withUnsafeBytes(of: UInt32(cluster.indices.count).littleEndian, write)
+                    withUnsafeBytes(of: UInt64(offsets.indices).littleEndian, write)
+                    withUnsafeBytes(of: UInt64(offsets.data).littleEndian, write)
+                    withUnsafeBytes(of: materialIs[submeshI].littleEndian, write)
+                    withUnsafeBytes(of: cluster.data.layout.rawValue.littleEndian, write)
+                }
+
+                for path in materialPaths {
+                    withUnsafeBytes(of: UInt32(path.count).littleEndian, write)
+                    path.withUnsafeBytes(write)
+                    offset = offset.align(by: 4)
+                }
+            }
+
+            positions.withUnsafeBytes { positions in
+                destination.copy(from: positions.baseAddress!, count: positions.count, offset: positionsOffset)
+            }
+
+            for (i, offsets) in pieceOffsets.enumerated() {
+                clusters[i].cluster.indices.withUnsafeBytes { indices in
+                    destination.copy(from: indices.baseAddress!, count: indices.count, offset: offsets.indices)
+                }
+                clusters[i].cluster.data.withUnsafeBytes { data in
+                    destination.copy(from: data.baseAddress!, count: data.count, offset: offsets.data)
+                }
+            }
+        }
+
+        try data.write(to: url, options: .atomic)
+    }
+}
+
+extension Raytrace.Mesh.Cooked {
+    // Loads the blob at the url, resolving the paths of the textures relative to the directory.
+    static func load(at url: URL, relativeTo directory: URL, with device: some MTLDevice) throws -> Self {
+        let mapping = try Raytrace.Memory.Mapping.init(url)
+
+        var reader = Reader.init(mapping: mapping)
+
+        guard reader.read(count: magic.count) == magic else {
+            throw Error.broken("not a cooked mesh")
+        }
+        guard reader.read(UInt32.self) == version else {
+            throw Error.broken("version")
+        }
+
+        let vertexCount = Int(reader.read(UInt32.self))
+        let pieceCount = Int(reader.read(UInt32.self))
+        let materialCount = Int(reader.read(UInt32.self))
+        let positionsOffset = Int(reader.read(UInt64.self))
+
+        let section = { (offset: Int, count: Int, label: String) throws -> any MTLBuffer in
+            guard offset % alignment == 0, count > 0,
+                  let buffer = mapping.buffer(
+                      at: offset,
+                      length: count.align(by: alignment),
+                      with: device,
+                      label: "\(url.lastPathComponent)/\(label)"
+                  ) else {
+                throw Error.broken("section: \(label)")
+            }
+
+            return buffer
+        }
+
+        let positions = Raytrace.Mesh.Positions.init(
+            buffer: try section(positionsOffset, vertexCount * MemoryLayout<SIMD3<Float>.Packed>.stride, "Positions"),
+            format: .float3,
+            stride: MemoryLayout<SIMD3<Float>.Packed>.stride
+        )
+
+        let records = (0..<pieceCount).map { _ in
+            (
+                indexType: reader.read(UInt32.self),
+                indexCount: Int(reader.read(UInt32.self)),
+                indicesOffset: Int(reader.read(UInt64.self)),
+                dataOffset: Int(reader.read(UInt64.self)),
+                material: Int(reader.read(Int32.self)),
+                layout: reader.read(UInt32.self)
+            )
+        }
+
+        let albedoURLs = (0..<materialCount).map { _ -> URL? in
+            let count = Int(reader.read(UInt32.self))
+            defer { reader.offset = reader.offset.align(by: 4) }
+
+            guard count > 0, let path = String.init(bytes: reader.read(count: count), encoding: .utf8) else {
+                return nil
+            }
+
+            return path.hasPrefix("/") ? URL.init(filePath: path) : directory.appending(path: path)
+        }
+
+        guard reader.isValid else {
+            throw Error.broken("truncated")
+        }
+
+        let pieces = try records.enumerated().map { i, record in
+            guard let indexType = MTLIndexType.init(rawValue: UInt(record.indexType)),
+                  let layout = Raytrace.Primitive.Layout.init(rawValue: record.layout),
+                  record.material < materialCount else {
+                throw Error.broken("piece \(i)")
+            }
+
+            let indexStride = indexType == .uint16 ? MemoryLayout<UInt16>.stride : MemoryLayout<UInt32>.stride
+
+            return Piece.init(
+                indices: .init(
+                    buffer: try section(record.indicesOffset, record.indexCount * indexStride, "\(i)/Indices"),
+                    type: indexType,
+                    count: record.indexCount
+                ),
+                data: .init(
+                    buffer: try section(record.dataOffset, record.indexCount / 3 * layout.stride, "\(i)/Data"),
+                    layout: layout,
+                    stride: layout.stride
+                ),
+                material: record.material >= 0 ? record.material : nil
+            )
+        }
+
+        return .init(positions: positions, pieces: pieces, albedoURLs: albedoURLs)
+    }
+}
+
+extension Raytrace.Mesh.Cooked {
+    // Reader reads the table from the start of the mapping, marking itself invalid instead of reading beyond it.
+    private struct Reader {
+        var mapping: Raytrace.Memory.Mapping
+        var offset = 0
+        var isValid = true
+    }
+}
+
+extension Raytrace.Mesh.Cooked.Reader {
+    mutating func read<T: FixedWidthInteger>(_ type: T.Type) -> T {
+        guard isValid, offset + MemoryLayout<T>.size <= mapping.length else {
+            isValid = false
+            return 0
+        }
+        defer { offset += MemoryLayout<T>.size }
+
+        return T(littleEndian: mapping.pointer.loadUnaligned(fromByteOffset: offset, as: T.self))
+    }
+
+    mutating func read(count: Int) -> [UInt8] {
+        guard isValid, offset + count <= mapping.length else {
+            isValid = false
+            return []
+        }
+        defer { offset += count }
+
+        return Array(UnsafeRawBufferPointer.init(start: mapping.pointer.advanced(by: offset), count: count))
+    }
+}
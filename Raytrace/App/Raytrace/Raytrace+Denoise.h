@@ -0,0 +1,100 @@
+// tomocy
+
+#pragma once
+
+#include "Raytrace+Accumulation.h"
+#include <metal_stdlib>
+
+namespace Raytrace {
+namespace Denoise {
+// Guide is what the first hit of a pixel tells about the edges of the image, which the denoiser keeps sharp.
+// Pixels that hit nothing have no normal, so that nothing blurs into them.
+struct Guide {
+public:
+    static Guide miss()
+    {
+        return {
+            .albedo = 1,
+            .normal = 0,
+            .depth = 0,
+        };
+    }
+
+    static Guide from(const float4 albedo, const float4 normalDepth)
+    {
+        return {
+            .albedo = albedo.rgb,
+            .normal = normalDepth.xyz,
+            .depth = normalDepth.w,
+        };
+    }
+
+public:
+    float4 albedoTexel() const { return float4(albedo, 1); }
+    float4 normalDepthTexel() const { return float4(normal, depth); }
+
+public:
+    float3 albedo;
+    float3 normal;
+    float depth;
+};
+}
+}
+
+namespace Raytrace {
+namespace Denoise {
+// Wavelet is an edge-avoiding à-trous wavelet filter (Dammertz et al. 2010) with the variance guidance of SVGF
+// (Schied et al. 2017), applied to the irradiance that is the accumulation divided by the albedo of the first hit.
+struct Wavelet {
+public:
+    // Each iteration doubles the step between the taps of the 5x5 kernel, covering 61x61 pixels after 5 of them.
+    static constexpr constant uint32_t iterationCount = 5;
+
+    static uint32_t stepAt(const uint32_t iteration) { return 1u << iteration; }
+
+public:
+    // The B3 spline from the center to the edge of the kernel.
+    static float kernelAt(const int offset)
+    {
+        const auto distance = offset < 0 ? -offset : offset;
+        return distance == 0 ? 3.0f / 8 : distance == 1 ? 1.0f / 4 : 1.0f / 16;
+    }
+
+    // The 3x3 gaussian that the variance of the center is blurred with, as a single pixel may agree by chance.
+    static float varianceKernelAt(const int dx, const int dy) { return (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f); }
+
+public:
+    // Normals that differ by more than a few degrees belong to other surfaces, as cos^128 falls to half at 6 degrees.
+    static float normalWeightOf(const float3 normal, const float3 other)
+    {
+        auto weight = metal::max(metal::dot(normal, other), 0.0f);
+        for (int i = 0; i < 7; i++) {
+            weight *= weight;
+        }
+
+        return weight;
+    }
+
+    // The exponent of the weight for the depth and the luminance, which share a single exp.
+    // Depth may differ by sigmaDepth of itself per pixel of offset, and luminance by sigmaLuminance standard deviations.
+    static float exponentOf(
+        const float depth,
+        const float otherDepth,
+        const float offsetLength,
+        const float luminance,
+        const float otherLuminance,
+        const float variance
+    )
+    {
+        const auto depthTerm = metal::abs(depth - otherDepth) / (sigmaDepth * depth * offsetLength + 1e-4f);
+        const auto luminanceTerm = metal::abs(luminance - otherLuminance) / (sigmaLuminance * metal::sqrt(variance) + 1e-4f);
+
+        return -(depthTerm + luminanceTerm);
+    }
+
+public:
+    static constexpr constant float sigmaDepth = 0.02;
+    static constexpr constant float sigmaLuminance = 4;
+};
+}
+}
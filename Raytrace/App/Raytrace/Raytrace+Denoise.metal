@@ -0,0 +1,185 @@
+// tomocy
+
+#include "Raytrace+Accumulation.h"
+#include "Raytrace+Denoise.h"
+#include <metal_stdlib>
+
+namespace Raytrace {
+namespace Denoise {
+namespace Demodulate {
+struct Args {
+public:
+    metal::texture2d<float> accumulation;
+    metal::texture2d<uint32_t> schedule;
+    metal::texture2d<float> albedo;
+
+    // The irradiance (rgb) and the variance of its mean luminance (a).
+    metal::texture2d<float, metal::access::write> irradiance;
+};
+
+float3 irradianceAt(constant Args& args, const uint2 id, const uint32_t count)
+{
+    const auto accumulation = Accumulation::from(args.accumulation.read(id), count);
+    return accumulation.mean / metal::max(args.albedo.read(id).rgb, float3(1e-3));
+}
+
+// Divides the accumulation by the albedo, so that the filter never blurs textures but only the lighting.
+kernel void compute(
+    const uint2 id [[thread_position_in_grid]],
+    constant Args& args [[buffer(0)]]
+)
+{
+    const auto size = uint2(args.accumulation.get_width(), args.accumulation.get_height());
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+
+    const auto schedule = args.schedule.read(id / Accumulation::tileSize);
+    const auto count = schedule.r + schedule.g;
+
+    const auto irradiance = irradianceAt(args, id, count);
+
+    auto variance = 0.0f;
+    if (count >= Accumulation::minCount) {
+        const auto accumulation = Accumulation::from(args.accumulation.read(id), count);
+        const auto albedo = metal::max(Accumulation::luminanceOf(args.albedo.read(id).rgb), 1e-3f);
+
+        variance = accumulation.varianceOfMean() / (albedo * albedo);
+    } else {
+        // Too few samples to tell the variance of the pixel, so take the one of its neighbors,
+        // each of which is a mean of as many samples.
+        const auto from = uint2(metal::max(int2(id) - 1, int2(0)));
+        const auto to = metal::min(id + 2, size);
+
+        auto sum = 0.0f;
+        auto squaredSum = 0.0f;
+        for (auto y = from.y; y < to.y; y++) {
+            for (auto x = from.x; x < to.x; x++) {
+                const auto luminance = Accumulation::luminanceOf(irradianceAt(args, uint2(x, y), count));
+                sum += luminance;
+                squaredSum += luminance * luminance;
+            }
+        }
+
+        const auto n = float((to.x - from.x) * (to.y - from.y));
+        const auto mean = sum / n;
+
+        variance = metal::max(squaredSum / n - mean * mean, 0.0f);
+    }
+
+    args.irradiance.write(float4(irradiance, variance), id);
+}
+}
+}
+}
+
+namespace Raytrace {
+namespace Denoise {
+namespace Filter {
+struct Args {
+public:
+    metal::texture2d<float> source;
+    metal::texture2d<float> normalDepth;
+    metal::texture2d<float, metal::access::write> destination;
+
+    // The pixels between the taps of this iteration, see Wavelet::stepAt.
+    uint32_t step;
+};
+
+// Runs an iteration of the filter over the irradiance, which carries its variance along as SVGF does.
+kernel void compute(
+    const uint2 id [[thread_position_in_grid]],
+    constant Args& args [[buffer(0)]]
+)
+{
+    const auto size = int2(args.source.get_width(), args.source.get_height());
+    if (int(id.x) >= size.x || int(id.y) >= size.y) {
+        return;
+    }
+
+    const auto center = args.source.read(id);
+    const auto centerGuide = args.normalDepth.read(id);
+    const auto luminance = Accumulation::luminanceOf(center.rgb);
+
+    // Pixels out of the image count as no variance, as the border of Host::Denoise::Planes does.
+    auto centerVariance = 0.0f;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const auto at = int2(id) + int2(dx, dy);
+            if (at.x < 0 || at.y < 0 || at.x >= size.x || at.y >= size.y) {
+                continue;
+            }
+
+            centerVariance += args.source.read(uint2(at)).a * Wavelet::varianceKernelAt(dx, dy);
+        }
+    }
+
+    // The center always weighs in, even when it has no normal to compare with.
+    const auto centerWeight = Wavelet::kernelAt(0) * Wavelet::kernelAt(0);
+
+    auto weightSum = centerWeight;
+    auto color = center.rgb * centerWeight;
+    auto variance = center.a * centerWeight * centerWeight;
+
+    for (int dy = -2; dy <= 2; dy++) {
+        for (int dx = -2; dx <= 2; dx++) {
+            if (dx == 0 && dy == 0) {
+                continue;
+            }
+
+            const auto offset = int2(dx, dy) * int(args.step);
+            const auto at = int2(id) + offset;
+            if (at.x < 0 || at.y < 0 || at.x >= size.x || at.y >= size.y) {
+                continue;
+            }
+
+            const auto other = args.source.read(uint2(at));
+            const auto otherGuide = args.normalDepth.read(uint2(at));
+
+            const auto weight = Wavelet::kernelAt(dx) * Wavelet::kernelAt(dy)
+                * Wavelet::normalWeightOf(centerGuide.xyz, otherGuide.xyz)
+                * metal::exp(Wavelet::exponentOf(
+                    centerGuide.w, otherGuide.w, metal::length(float2(offset)),
+                    luminance, Accumulation::luminanceOf(other.rgb), centerVariance
+                ));
+
+            weightSum += weight;
+            color += other.rgb * weight;
+            variance += other.a * weight * weight;
+        }
+    }
+
+    args.destination.write(float4(color / weightSum, variance / (weightSum * weightSum)), id);
+}
+}
+}
+}
+
+namespace Raytrace {
+namespace Denoise {
+namespace Modulate {
+struct Args {
+public:
+    metal::texture2d<float> irradiance;
+    metal::texture2d<float> albedo;
+    metal::texture2d<float, metal::access::write> target;
+};
+
+// Multiplies the filtered irradiance by the albedo again.
+kernel void compute(
+    const uint2 id [[thread_position_in_grid]],
+    constant Args& args [[buffer(0)]]
+)
+{
+    if (id.x >= args.target.get_width() || id.y >= args.target.get_height()) {
+        return;
+    }
+
+    const auto irradiance = args.irradiance.read(id).rgb;
+    const auto albedo = metal::max(args.albedo.read(id).rgb, float3(1e-3));
+
+    args.target.write(float4(irradiance * albedo, 1), id);
+}
+}
+}
+}
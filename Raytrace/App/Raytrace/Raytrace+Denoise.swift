@@ -0,0 +1,277 @@
+// tomocy
+
+import Metal
+
+extension Raytrace {
+    struct Denoise {
+        var pipelineStates: PipelineStates
+
+        var resourcePool: ResourcePool
+
+        // The irradiance is filtered back and forth between them.
+        var irradiances: [any MTLTexture]
+    }
+}
+
+extension Raytrace.Denoise {
+    // Each iteration doubles the step between the taps, as Raytrace::Denoise::Wavelet.
+    static let iterationCount = 5
+
+    init(
+        device: some MTLDevice,
+        resolution: CGSize
+    ) throws {
+        let lib = device.makeDefaultLibrary()!
+
+        pipelineStates = .init(
+            demodulate: try PipelineStates.make(with: device, for: lib.makeFunction(name: "Raytrace::Denoise::Demodulate::compute")!),
+            filter: try PipelineStates.make(with: device, for: lib.makeFunction(name: "Raytrace::Denoise::Filter::compute")!),
+            modulate: try PipelineStates.make(with: device, for: lib.makeFunction(name: "Raytrace::Denoise::Modulate::compute")!)
+        )
+
+        resourcePool = .init()
+
+        irradiances = [
+            Self.makeIrradiance(with: device, label: "Irradiance/0", resolution: resolution)!,
+            Self.makeIrradiance(with: device, label: "Irradiance/1", resolution: resolution)!,
+        ]
+    }
+}
+
+extension Raytrace.Denoise {
+    static func makeIrradiance(
+        with device: some MTLDevice,
+        label: String,
+        resolution: CGSize
+    ) -> (any MTLTexture)? {
+        return Raytrace.Texture.make2D(
+            with: device,
+            label: label,
+            format: .rgba32Float,
+            size: .init(
+                .init(resolution.width),
+                .init(resolution.height)
+            ),
+            usage: [.shaderRead, .shaderWrite],
+            storageMode: .private,
+            mipmapped: false
+        )
+    }
+}
+
+extension Raytrace.Denoise {
+    // Denoises the accumulation of raytrace into its target, once it has been encoded.
+    func encode(
+        to buffer: some MTLCommandBuffer,
+        raytrace: Raytrace.Raytrace
+    ) {
+        let target = raytrace.target.texture
+
+        let encoder = buffer.makeComputeCommandEncoder()!
+        defer { encoder.endEncoding() }
+
+        encoder.label = "Denoise"
+
+        let threadsSizePerGroup = encoder.defaultThreadsSizePerGroup
+        let threadsGroupSize = encoder.threadsGroupSize(
+            for: .init(target.width, target.height),
+            as: threadsSizePerGroup
+        )
+
+        do {
+            encoder.setComputePipelineState(pipelineStates.demodulate)
+
+            let args = DemodulateArgs.init(
+                accumulation: raytrace.accumulation,
+                schedule: raytrace.schedule.texture,
+                albedo: raytrace.albedo,
+                irradiance: irradiances[0]
+            )
+
+            let buffer = args.build(with: encoder, resourcePool: resourcePool, label: "DemodulateArgs")!
+            encoder.setBuffer(buffer, offset: 0, index: 0)
+
+            encoder.dispatchThreadgroups(threadsGroupSize, threadsPerThreadgroup: threadsSizePerGroup)
+        }
+
+        for i in 0..<Self.iterationCount {
+            encoder.setComputePipelineState(pipelineStates.filter)
+
+            let args = FilterArgs.init(
+                source: irradiances[i % 2],
+                normalDepth: raytrace.normalDepth,
+                destination: irradiances[(i + 1) % 2],
+                step: 1 << i
+            )
+
+            // Each iteration keeps its own args, as the earlier ones have not run yet.
+            let buffer = args.build(with: encoder, resourcePool: resourcePool, label: "FilterArgs/\(i)")!
+            encoder.setBuffer(buffer, offset: 0, index: 0)
+
+            encoder.dispatchThreadgroups(threadsGroupSize, threadsPerThreadgroup: threadsSizePerGroup)
+        }
+
+        do {
+            encoder.setComputePipelineState(pipelineStates.modulate)
+
+            let args = ModulateArgs.init(
+                irradiance: irradiances[Self.iterationCount % 2],
+                albedo: raytrace.albedo,
+                target: target
+            )
+
+            let buffer = args.build(with: encoder, resourcePool: resourcePool, label: "ModulateArgs")!
+            encoder.setBuffer(buffer, offset: 0, index: 0)
+
+            encoder.dispatchThreadgroups(threadsGroupSize, threadsPerThreadgroup: threadsSizePerGroup)
+        }
+    }
+}
+
+extension Raytrace.Denoise {
+    struct PipelineStates {
+        var demodulate: any MTLComputePipelineState
+        var filter: any MTLComputePipelineState
+        var modulate: any MTLComputePipelineState
+    }
+}
+
+extension Raytrace.Denoise.PipelineStates {
+    static func make(with device: some MTLDevice, for function: some MTLFunction) throws -> some MTLComputePipelineState {
+        return try device.makeComputePipelineState(
+            function: function
+        )
+    }
+}
+
+extension Raytrace.Denoise {
+    struct DemodulateArgs {
+        var accumulation: any MTLTexture
+        var schedule: any MTLTexture
+        var albedo: any MTLTexture
+        var irradiance: any MTLTexture
+    }
+}
+
+extension Raytrace.Denoise.DemodulateArgs {
+    func build(
+        with encoder: some MTLComputeCommandEncoder,
+        resourcePool: Raytrace.ResourcePool,
+        label: String
+    ) -> (any MTLBuffer)? {
+        let forGPU = ForGPU.init(
+            accumulation: accumulation.use(with: encoder, usage: .read),
+            schedule: schedule.use(with: encoder, usage: .read),
+            albedo: albedo.use(with: encoder, usage: .read),
+            irradiance: irradiance.use(with: encoder, usage: .write)
+        )
+
+        let buffer = resourcePool.buffers.take(at: label) {
+            Raytrace.Metal.Buffer.buildable(forGPU).build(
+                with: encoder.device,
+                label: label,
+                options: .storageModeShared
+            )
+        }!
+
+        Raytrace.IO.writable(forGPU).write(to: buffer)
+
+        return buffer
+    }
+}
+
+extension Raytrace.Denoise.DemodulateArgs {
+    struct ForGPU {
+        var accumulation: MTLResourceID
+        var schedule: MTLResourceID
+        var albedo: MTLResourceID
+        var irradiance: MTLResourceID
+    }
+}
+
+extension Raytrace.Denoise {
+    struct FilterArgs {
+        var source: any MTLTexture
+        var normalDepth: any MTLTexture
+        var destination: any MTLTexture
+        var step: UInt32
+    }
+}
+
+extension Raytrace.Denoise.FilterArgs {
+    func build(
+        with encoder: some MTLComputeCommandEncoder,
+        resourcePool: Raytrace.ResourcePool,
+        label: String
+    ) -> (any MTLBuffer)? {
+        let forGPU = ForGPU.init(
+            source: source.use(with: encoder, usage: .read),
+            normalDepth: normalDepth.use(with: encoder, usage: .read),
+            destination: destination.use(with: encoder, usage: .write),
+            step: step
+        )
+
+        let buffer = resourcePool.buffers.take(at: label) {
+            Raytrace.Metal.Buffer.buildable(forGPU).build(
+                with: encoder.device,
+                label: label,
+                options: .storageModeShared
+            )
+        }!
+
+        Raytrace.IO.writable(forGPU).write(to: buffer)
+
+        return buffer
+    }
+}
+
+extension Raytrace.Denoise.FilterArgs {
+    struct ForGPU {
+        var source: MTLResourceID
+        var normalDepth: MTLResourceID
+        var destination: MTLResourceID
+        var step: UInt32
+    }
+}
+
+extension Raytrace.Denoise {
+    struct ModulateArgs {
+        var irradiance: any MTLTexture
+        var albedo: any MTLTexture
+        var target: any MTLTexture
+    }
+}
+
+extension Raytrace.Denoise.ModulateArgs {
+    func build(
+        with encoder: some MTLComputeCommandEncoder,
+        resourcePool: Raytrace.ResourcePool,
+        label: String
+    ) -> (any MTLBuffer)? {
+        let forGPU = ForGPU.init(
+            irradiance: irradiance.use(with: encoder, usage: .read),
+            albedo: albedo.use(with: encoder, usage: .read),
+            target: target.use(with: encoder, usage: .write)
+        )
+
+        let buffer = resourcePool.buffers.take(at: label) {
+            Raytrace.Metal.Buffer.buildable(forGPU).build(
+                with: encoder.device,
+                label: label,
+                options: .storageModeShared
+            )
+        }!
+
+        Raytrace.IO.writable(forGPU).write(to: buffer)
+
+        return buffer
+    }
+}
+
+extension Raytrace.Denoise.ModulateArgs {
+    struct ForGPU {
+        var irradiance: MTLResourceID
+        var albedo: MTLResourceID
+        var target: MTLResourceID
+    }
+}
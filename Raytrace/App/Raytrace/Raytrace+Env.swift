@@ -14,35 +14,121 @@ extension Raytrace {
 extension Raytrace.Env {
     init(device: some MTLDevice) throws {
         // We know the textures for now.
+        // Each is mapped from its container if Prelight saved one, and decoded from its PNGs otherwise.
 
-        diffuse = try MTKTextureLoader.init(device: device).newTexture(
-            URL: Bundle.main.url(forResource: "Env_Prelight_Diffuse", withExtension: "png", subdirectory: "Farm/Env")!,
-            options: [
-                .textureUsage: MTLTextureUsage.shaderRead.rawValue,
-                .textureStorageMode: MTLStorageMode.private.rawValue,
-                .cubeLayout: MTKTextureLoader.CubeLayout.vertical.rawValue,
-                .generateMipmaps: false,
-            ]
-        )
+        diffuse = try Self.loadContainer(named: "Env_Prelight_Diffuse", with: device, label: "Env/Diffuse")
+            ?? MTKTextureLoader.init(device: device).newTexture(
+                URL: Bundle.main.url(forResource: "Env_Prelight_Diffuse", withExtension: "png", subdirectory: "Farm/Env")!,
+                options: [
+                    .textureUsage: MTLTextureUsage.shaderRead.rawValue,
+                    .textureStorageMode: MTLStorageMode.private.rawValue,
+                    .cubeLayout: MTKTextureLoader.CubeLayout.vertical.rawValue,
+                    .generateMipmaps: false,
+                ]
+            )
+
+        specular = try Self.loadContainer(named: "Env_Prelight_Specular", with: device, label: "Env/Specular")
+            ?? Self.loadSpecular(with: device)
+
+        lut = try Self.loadContainer(named: "Env_Prelight_Env_GGX", with: device, label: "Env/LUT")
+            ?? MTKTextureLoader.init(device: device).newTexture(
+                URL: Bundle.main.url(forResource: "Env_Prelight_Env_GGX", withExtension: "png", subdirectory: "Farm/Env")!,
+                options: [
+                    .textureUsage: MTLTextureUsage.shaderRead.rawValue,
+                    .textureStorageMode: MTLStorageMode.private.rawValue,
+                    .generateMipmaps: false,
+                ]
+            )
+    }
+}
+
+extension Raytrace.Env {
+    static func loadContainer(named name: String, with device: some MTLDevice, label: String) throws -> (any MTLTexture)? {
+        guard let url = Bundle.main.url(forResource: name, withExtension: "prelit", subdirectory: "Farm/Env") else {
+            return nil
+        }
+
+        return try Raytrace.Container.load(at: url, with: device, label: label)
+    }
+}
 
-        specular = try MTKTextureLoader.init(device: device).newTexture(
-            URL: Bundle.main.url(forResource: "Env_Prelight_Specular", withExtension: "png", subdirectory: "Farm/Env")!,
-            options: [
-                .textureUsage: MTLTextureUsage.shaderRead.rawValue,
-                .textureStorageMode: MTLStorageMode.private.rawValue,
-                .cubeLayout: MTKTextureLoader.CubeLayout.vertical.rawValue,
-                .generateMipmaps: true,
-            ]
+extension Raytrace.Env {
+    // Prelight saves a level of the specular for each step of roughness,
+    // the first as Env_Prelight_Specular and the others as Env_Prelight_Specular_1, _2 and so on,
+    // which are put back together as the levels of a cube.
+    static func loadSpecular(with device: some MTLDevice) throws -> any MTLTexture {
+        let loader = MTKTextureLoader.init(device: device)
+
+        let urls = Array(
+            sequence(first: 0) { $0 + 1 }
+                .lazy
+                .map { level in
+                    Bundle.main.url(
+                        forResource: level == 0 ? "Env_Prelight_Specular" : "Env_Prelight_Specular_\(level)",
+                        withExtension: "png",
+                        subdirectory: "Farm/Env"
+                    )
+                }
+                .prefix { $0 != nil }
+                .map { $0! }
         )
 
-        lut = try MTKTextureLoader.init(device: device).newTexture(
-            URL: Bundle.main.url(forResource: "Env_Prelight_Env_GGX", withExtension: "png", subdirectory: "Farm/Env")!,
-            options: [
-                .textureUsage: MTLTextureUsage.shaderRead.rawValue,
-                .textureStorageMode: MTLStorageMode.private.rawValue,
-                .generateMipmaps: false,
-            ]
+        // A specular of a single level comes from a Prelight before the levels,
+        // whose mipmaps are only a blur of it.
+        if urls.count == 1 {
+            return try loader.newTexture(
+                URL: urls[0],
+                options: [
+                    .textureUsage: MTLTextureUsage.shaderRead.rawValue,
+                    .textureStorageMode: MTLStorageMode.private.rawValue,
+                    .cubeLayout: MTKTextureLoader.CubeLayout.vertical.rawValue,
+                    .generateMipmaps: true,
+                ]
+            )
+        }
+
+        let levels = try urls.map { url in
+            try loader.newTexture(
+                URL: url,
+                options: [
+                    .textureUsage: MTLTextureUsage.shaderRead.rawValue,
+                    .textureStorageMode: MTLStorageMode.private.rawValue,
+                    .cubeLayout: MTKTextureLoader.CubeLayout.vertical.rawValue,
+                    .generateMipmaps: false,
+                ]
+            )
+        }
+
+        let desc = MTLTextureDescriptor.textureCubeDescriptor(
+            pixelFormat: levels[0].pixelFormat,
+            size: levels[0].width,
+            mipmapped: true
         )
+        desc.mipmapLevelCount = levels.count
+        desc.usage = .shaderRead
+        desc.storageMode = .private
+
+        let specular = device.makeTexture(descriptor: desc)!
+        specular.label = "Env/Specular"
+
+        do {
+            let command = device.makeCommandQueue()!.makeCommandBuffer()!
+
+            let encoder = command.makeBlitCommandEncoder()!
+            for (i, level) in levels.enumerated() {
+                encoder.copy(
+                    from: level, sourceSlice: 0, sourceLevel: 0,
+                    to: specular, destinationSlice: 0, destinationLevel: i,
+                    sliceCount: 6 /* face count in a cube */, levelCount: 1
+                )
+            }
+            encoder.endEncoding()
+
+            command.commit()
+            command.waitUntilCompleted()
+        }
+
+        return specular
     }
 }
 
@@ -3,6 +3,8 @@
 #pragma once
 
 namespace Raytrace {
+// Frame is what the passes that add samples to the same accumulation share,
+// whose id only changes once the accumulation starts over, so that the samples of all its passes continue one sequence.
 struct Frame {
 public:
     uint32_t id [[id(0)]];
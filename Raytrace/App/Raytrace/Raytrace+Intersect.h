@@ -14,8 +14,8 @@ public:
 
 public:
     Intersection(const metal::raytracing::ray ray, const Raw raw)
-        : raw_(raw)
-        , ray_(ray)
+        : ray_(ray)
+        , raw_(raw)
     {
     }
 
@@ -31,9 +31,21 @@ public:
         return ray().origin + ray().direction * raw_.distance;
     }
 
+    float distance() const { return raw_.distance; }
+
 public:
-    Primitive toPrimitive() const
+    // The piece tells how the data of the triangle is laid out.
+    Primitive toPrimitive(const thread Mesh::Piece& piece) const
     {
+        if (piece.layout == Primitive::Layout::compactTriangle) {
+            const auto triangle = *(const device Primitive::CompactTriangle*)raw_.primitive_data;
+
+            return Primitive::from(
+                triangle,
+                raw_.triangle_barycentric_coord
+            );
+        }
+
         const auto triangle = *(const device Primitive::Triangle*)raw_.primitive_data;
 
         return Primitive::from(
@@ -45,11 +57,16 @@ public:
 public:
     constant Mesh::Piece& pieceIn(const thread Acceleration& acceleration) const
     {
-        return acceleration.pieces[raw_.instance_id + raw_.geometry_id];
+        return acceleration.pieces[pieceIndex()];
     }
 
+    // Which of the pieces of the acceleration has been hit, so that hits can be grouped by their material,
+    // where each instance has the index of the first piece of its mesh as its user ID.
+    uint32_t pieceIndex() const { return raw_.user_instance_id + raw_.geometry_id; }
+
 public:
     const thread metal::raytracing::ray& ray() const { return ray_; }
+    const thread Raw& raw() const { return raw_; }
 
 private:
     metal::raytracing::ray ray_;
@@ -62,12 +79,16 @@ struct Intersector {
 public:
     using Raw = typename metal::raytracing::intersector<metal::raytracing::instancing, metal::raytracing::triangle_data>;
 
+    // Shadow rays only ask whether anything is in the way, so they fetch no triangle data.
+    using Occluder = typename metal::raytracing::intersector<metal::raytracing::instancing>;
+
     using Accelerator = metal::raytracing::instance_acceleration_structure;
 
 public:
     Intersector(const Acceleration acceleration)
         : acceleration(acceleration)
     {
+        occluder_.accept_any_intersection(true);
     }
 
 public:
@@ -77,10 +98,18 @@ public:
         return { ray, intersection };
     }
 
+    // Whether anything is along the ray up to its max distance, which ends at the first hit found instead of the closest.
+    bool occluded(const thread metal::raytracing::ray& ray, const uint32_t mask = 0xff) const
+    {
+        const auto intersection = occluder_.intersect(ray, acceleration.structure, mask);
+        return intersection.type != metal::raytracing::intersection_type::none;
+    }
+
 public:
     Acceleration acceleration;
 
 private:
     Raw raw_;
+    Occluder occluder_;
 };
 }
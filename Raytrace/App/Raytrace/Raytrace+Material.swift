@@ -56,3 +56,11 @@ extension Raytrace.Material {
         var metalRoughness: MTLResourceID = .init()
     }
 }
+
+extension Raytrace.Material {
+    init(albedo url: URL?, device: some MTLDevice) throws {
+        if let url = url {
+            albedo = try MTKTextureLoader.init(device: device).newTexture(URL: url)
+        }
+    }
+}
@@ -1,5 +1,8 @@
 // tomocy
 
+import Foundation
+import Metal
+
 extension UnsafeMutableRawPointer {
     func copy(from base: UnsafeRawPointer, count: Int, offset: Int = 0) {
         advanced(by: offset).copyMemory(
@@ -19,3 +22,68 @@ extension UnsafeMutableRawPointer {
         )
     }
 }
+
+extension Raytrace {
+    enum Memory {}
+}
+
+extension Raytrace.Memory {
+    // Mapping maps a file privately, which is unmapped once the mapping and every buffer that wraps a part of it are released.
+    // Private pages are writable without writing to the file, which Metal expects of memory that it wraps.
+    final class Mapping {
+        let pointer: UnsafeMutableRawPointer
+        let length: Int
+
+        init(_ url: URL) throws {
+            let file = open(url.path(), O_RDONLY)
+            guard file >= 0 else {
+                throw Error.unreadable(url)
+            }
+            defer { close(file) }
+
+            var status = stat()
+            guard fstat(file, &status) == 0, status.st_size > 0 else {
+                throw Error.unreadable(url)
+            }
+
+            length = Int(status.st_size)
+
+            guard let pointer = mmap(nil, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0),
+                  pointer != MAP_FAILED else {
+                throw Error.unreadable(url)
+            }
+
+            self.pointer = pointer
+        }
+
+        deinit {
+            munmap(pointer, length)
+        }
+    }
+}
+
+extension Raytrace.Memory.Mapping {
+    // Wraps the part as a buffer without a copy, which has to start on a page and take whole pages.
+    func buffer(at offset: Int, length: Int, with device: some MTLDevice, label: String? = nil) -> (any MTLBuffer)? {
+        guard offset + length <= self.length else { return nil }
+
+        guard let buffer = device.makeBuffer(
+            bytesNoCopy: pointer.advanced(by: offset),
+            length: length,
+            options: .storageModeShared,
+            deallocator: { _, _ in
+                withExtendedLifetime(self) {}
+            }
+        ) else { return nil }
+
+        buffer.label = label
+
+        return buffer
+    }
+}
+
+extension Raytrace.Memory {
+    enum Error: Swift.Error {
+        case unreadable(URL)
+    }
+}
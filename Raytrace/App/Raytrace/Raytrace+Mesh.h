@@ -3,6 +3,7 @@
 #pragma once
 
 #include "../../Shader/PBR/PBR+Material.h"
+#include "Raytrace+Primitive.h"
 #include <metal_stdlib>
 
 namespace Raytrace {
@@ -11,6 +12,10 @@ public:
     struct Piece {
     public:
         Shader::PBR::Material material;
+        Primitive::Layout layout;
+
+        // How much of the texture coordinate a unit of the surface spans on average, for the footprints of cones.
+        float textureScale;
     };
 };
 }
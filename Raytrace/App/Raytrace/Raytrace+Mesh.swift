@@ -88,7 +88,10 @@ extension Array where Element == Raytrace.Mesh.Piece {
                 material: .init(
                     albedo: piece.material!.albedo!.gpuResourceID,
                     metalRoughness: piece.material!.metalRoughness!.gpuResourceID
-                )
+                ),
+                layout: piece.data.layout.rawValue,
+                // The textures here have no mipmaps to pick from by the footprint, so the base levels are always sampled.
+                textureScale: 0
             )
         }
 
@@ -108,6 +111,8 @@ extension Array where Element == Raytrace.Mesh.Piece {
 extension Raytrace.Mesh.Piece {
     struct ForGPU {
         var material: Raytrace.Material.ForGPU
+        var layout: UInt32
+        var textureScale: Float
     }
 }
 
@@ -133,6 +138,103 @@ extension Raytrace.Mesh {
     }
 }
 
+extension Raytrace.Mesh {
+    // Cluster is a run of the triangles of a piece on the host, which takes a piece of its own,
+    // so that no piece is too huge for the data of its triangles to stay in the caches while they are shaded.
+    struct Cluster {
+        var indices: Values
+        var data: Triangles
+    }
+}
+
+extension Raytrace.Mesh.Cluster {
+    static let maxTriangleCount = 1 << 14
+
+    enum Values {
+        case uint16([UInt16])
+        case uint32([UInt32])
+    }
+}
+
+extension Raytrace.Mesh.Cluster.Values {
+    var type: MTLIndexType {
+        switch self {
+        case .uint16:
+            return .uint16
+        case .uint32:
+            return .uint32
+        }
+    }
+
+    var count: Int {
+        switch self {
+        case let .uint16(values):
+            return values.count
+        case let .uint32(values):
+            return values.count
+        }
+    }
+
+    func withUnsafeBytes<R>(_ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R {
+        switch self {
+        case let .uint16(values):
+            return try values.withUnsafeBytes(body)
+        case let .uint32(values):
+            return try values.withUnsafeBytes(body)
+        }
+    }
+}
+
+extension Raytrace.Mesh.Cluster {
+    enum Triangles {
+        case triangle([Raytrace.Primitive.Triangle])
+        case compactTriangle([Raytrace.Primitive.CompactTriangle])
+    }
+}
+
+extension Raytrace.Mesh.Cluster.Triangles {
+    var layout: Raytrace.Primitive.Layout {
+        switch self {
+        case .triangle:
+            return .triangle
+        case .compactTriangle:
+            return .compactTriangle
+        }
+    }
+
+    func withUnsafeBytes<R>(_ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R {
+        switch self {
+        case let .triangle(values):
+            return try values.withUnsafeBytes(body)
+        case let .compactTriangle(values):
+            return try values.withUnsafeBytes(body)
+        }
+    }
+}
+
+extension Raytrace.Mesh.Cluster {
+    func toPiece(with device: some MTLDevice, material: Raytrace.Material?) -> Raytrace.Mesh.Piece {
+        return .init(
+            type: .triangle,
+            indices: .init(
+                buffer: indices.withUnsafeBytes { bytes in
+                    device.makeBuffer(bytes: bytes.baseAddress!, length: bytes.count, options: .storageModeShared)
+                }!,
+                type: indices.type,
+                count: indices.count
+            ),
+            data: .init(
+                buffer: data.withUnsafeBytes { bytes in
+                    device.makeBuffer(bytes: bytes.baseAddress!, length: bytes.count, options: .storageModeShared)
+                }!,
+                layout: data.layout,
+                stride: data.layout.stride
+            ),
+            material: material
+        )
+    }
+}
+
 extension MDLMesh {
     static func load(url: URL, with device: some MTLDevice) throws -> [MDLMesh] {
         let asset = MDLAsset.init(
@@ -197,15 +299,24 @@ extension MDLMesh {
 }
 
 extension MDLMesh {
-    func toMesh(with device: some MTLDevice, instances: [Raytrace.Mesh.Instance]) throws -> Raytrace.Mesh {
+    func toMesh(
+        with device: some MTLDevice,
+        instances: [Raytrace.Mesh.Instance],
+        layout: Raytrace.Primitive.Layout = .triangle
+    ) throws -> Raytrace.Mesh {
         assert(
             vertexDescriptor.defaultLayouts![0].stride == MemoryLayout<Layout.PNT>.stride
         )
 
         let vertices: [Layout.PNT] = vertexBuffers.first!.contents().toArray(count: vertexCount)
 
-        let pieces = try defaultSubmeshes!.map {
-            try $0.toPiece(with: device, vertices: vertices)
+        // The clusters of a submesh share its material, which is loaded once.
+        let pieces = try defaultSubmeshes!.flatMap { submesh in
+            let material = try Raytrace.Material.init(submesh.material, device: device)
+
+            return submesh.toClusters(vertices: vertices, layout: layout).map {
+                $0.toPiece(with: device, material: material)
+            }
         }
 
         let positions = Raytrace.Mesh.Positions.init(
@@ -265,50 +376,47 @@ extension MDLSubmesh {
 }
 
 extension MDLSubmesh {
-    func toPiece(with device: some MTLDevice, vertices: [MDLMesh.Layout.PNT]) throws -> Raytrace.Mesh.Piece {
+    // Splits the triangles into clusters, de-indexing the normals and the texture coordinates of the vertices
+    // into the data of each triangle in a single pass, with no allocation for each triangle.
+    // The indices of a cluster take 16 bits if the vertices of the whole mesh fit in them, and 32 bits otherwise.
+    // The data of the triangles is encoded as CompactTriangles if the layout asks for them.
+    func toClusters(vertices: [MDLMesh.Layout.PNT], layout: Raytrace.Primitive.Layout) -> [Raytrace.Mesh.Cluster] {
         assert(geometryType == .triangles)
-        assert(indexType == .uint16)
 
-        let indices: [UInt16] = indexBuffer.contents().toArray(count: indexCount)
-
-        var data: [Raytrace.Primitive.Triangle] = []
-        let primitiveCount = indices.count / 3
-        for primitiveI in 0..<primitiveCount {
-            var datum = Raytrace.Primitive.Datum.init(
-                normals: [],
-                textureCoordinates: []
-            )
-
-            for vertexI in 0..<3 {
-                let i = Int(indices[primitiveI * 3 + vertexI])
-                let v = vertices[i]
-
-                datum.normals.append(v.normal)
-                datum.textureCoordinates.append(v.textureCoordinate)
+        let indices: [UInt32] = indexBuffer(asIndexType: .uInt32).contents().toArray(count: indexCount)
+        let fitsIn16Bits = vertices.count <= Int(UInt16.max) + 1
+
+        let triangleCount = indices.count / 3
+        let clusterSize = Raytrace.Mesh.Cluster.maxTriangleCount
+
+        return stride(from: 0, to: triangleCount, by: clusterSize).map { start in
+            let triangles = start..<min(start + clusterSize, triangleCount)
+            let clusterIndices = indices[(triangles.lowerBound * 3)..<(triangles.upperBound * 3)]
+
+            let data = vertices.withUnsafeBufferPointer { vertices in
+                [Raytrace.Primitive.Triangle].init(unsafeUninitializedCapacity: triangles.count) { data, count in
+                    for (i, triangleI) in triangles.enumerated() {
+                        let a = vertices[Int(indices[triangleI * 3 + 0])]
+                        let b = vertices[Int(indices[triangleI * 3 + 1])]
+                        let c = vertices[Int(indices[triangleI * 3 + 2])]
+
+                        (data.baseAddress! + i).initialize(
+                            to: .init(
+                                normals: (a.normal, b.normal, c.normal),
+                                textureCoordinates: (a.textureCoordinate, b.textureCoordinate, c.textureCoordinate)
+                            )
+                        )
+                    }
+
+                    count = triangles.count
+                }
             }
 
-            data.append(.init(datum))
+            return .init(
+                indices: fitsIn16Bits ? .uint16(clusterIndices.map { UInt16($0) }) : .uint32(Array(clusterIndices)),
+                data: layout == .compactTriangle ? .compactTriangle(data.map { .init($0) }) : .triangle(data)
+            )
         }
-
-        return .init(
-            type: .triangle,
-            indices: .init(
-                buffer: Raytrace.Metal.Buffer.buildable(indices).build(
-                    with: device,
-                    options: .storageModeShared
-                )!,
-                type: .uint16,
-                count: indices.count
-            ),
-            data: .init(
-                buffer: Raytrace.Metal.Buffer.buildable(data).build(
-                    with: device,
-                    options: .storageModeShared
-                )!,
-                stride: MemoryLayout<Raytrace.Primitive.Triangle>.stride
-            ),
-            material: try .init(material, device: device)
-        )
     }
 }
 
@@ -3,18 +3,33 @@
 #pragma once
 
 #include "../../Shader/Geometry/Geometry+Normalized.h"
+#include "../../Shader/Geometry/Geometry+Octahedral.h"
 #include "../../Shader/Interpolate.h"
 #include <metal_stdlib>
 
 namespace Raytrace {
 struct Primitive {
 public:
+    // Layout tells which of the triangles below the data of a piece holds.
+    enum class Layout : uint32_t {
+        triangle = 0,
+        compactTriangle = 1,
+    };
+
     struct Triangle {
     public:
         packed_float3 normals[3];
         float2 textureCoordinates[3];
     };
 
+    // CompactTriangle takes 24 bytes instead of the 60 of Triangle,
+    // where each normal is octahedral (see Shader::Geometry::Octahedral) and each texture coordinate is 2 halves.
+    struct CompactTriangle {
+    public:
+        uint normals[3];
+        uint textureCoordinates[3];
+    };
+
 public:
     static Primitive from(const thread Triangle& triangle, const thread float2& position)
     {
@@ -45,6 +60,33 @@ public:
         return primitive;
     }
 
+    static Primitive from(const thread CompactTriangle& compact, const thread float2& position)
+    {
+        Triangle triangle = {};
+
+        for (auto i = 0; i < 3; i++) {
+            triangle.normals[i] = Shader::Geometry::Octahedral::decode(compact.normals[i]).value();
+            triangle.textureCoordinates[i] = unpackHalf2(compact.textureCoordinates[i]);
+        }
+
+        return from(triangle, position);
+    }
+
+private:
+    static float2 unpackHalf2(const uint packed)
+    {
+        return float2(widenHalf(packed & 0xffff), widenHalf(packed >> 16));
+    }
+
+    // Widens a half by its bits, which holds as long as it is finite,
+    // as the exponent only needs its bias moved from that of half (15) to that of float (127), by 2^112.
+    static float widenHalf(const uint bits)
+    {
+        const auto rebias = metal::as_type<float>(uint(127 + 112) << 23);
+        const auto magnitude = metal::as_type<float>((bits & 0x7fff) << 13) * rebias;
+        return (bits & 0x8000) != 0 ? -magnitude : magnitude;
+    }
+
 public:
     Shader::Geometry::Normalized<float3> normal;
     float2 textureCoordinate;
@@ -9,12 +9,27 @@ extension Raytrace {
 extension Raytrace.Primitive {
     struct Data {
         var buffer: any MTLBuffer
+        var layout: Layout
         var stride: Int
     }
+}
+
+extension Raytrace.Primitive {
+    // Layout tells which of the triangles the data holds, as Raytrace::Primitive::Layout does.
+    enum Layout: UInt32 {
+        case triangle = 0
+        case compactTriangle = 1
+    }
+}
 
-    struct Datum {
-        var normals: [SIMD3<Float>.Packed]
-        var textureCoordinates: [SIMD2<Float>]
+extension Raytrace.Primitive.Layout {
+    var stride: Int {
+        switch self {
+        case .triangle:
+            return MemoryLayout<Raytrace.Primitive.Triangle>.stride
+        case .compactTriangle:
+            return MemoryLayout<Raytrace.Primitive.CompactTriangle>.stride
+        }
     }
 }
 
@@ -25,11 +40,48 @@ extension Raytrace.Primitive {
     }
 }
 
-extension Raytrace.Primitive.Triangle {
-    init(_ other: Raytrace.Primitive.Datum) {
+extension Raytrace.Primitive {
+    // CompactTriangle is what Raytrace::Primitive::CompactTriangle decodes, see there for the encoding.
+    struct CompactTriangle {
+        var normals: (UInt32, UInt32, UInt32)
+        var textureCoordinates: (UInt32, UInt32, UInt32)
+    }
+}
+
+extension Raytrace.Primitive.CompactTriangle {
+    init(_ other: Raytrace.Primitive.Triangle) {
         self.init(
-            normals: (other.normals[0], other.normals[1], other.normals[2]),
-            textureCoordinates: (other.textureCoordinates[0], other.textureCoordinates[1], other.textureCoordinates[2])
+            normals: (
+                Self.encode(normal: .init(other.normals.0)),
+                Self.encode(normal: .init(other.normals.1)),
+                Self.encode(normal: .init(other.normals.2))
+            ),
+            textureCoordinates: (
+                Self.encode(textureCoordinate: other.textureCoordinates.0),
+                Self.encode(textureCoordinate: other.textureCoordinates.1),
+                Self.encode(textureCoordinate: other.textureCoordinates.2)
+            )
         )
     }
+
+    // Folds the normal onto an octahedron as Shader::Geometry::Octahedral::encode does.
+    private static func encode(normal: SIMD3<Float>) -> UInt32 {
+        let n = normal / (abs(normal.x) + abs(normal.y) + abs(normal.z))
+
+        let folded = n.z >= 0
+            ? SIMD2<Float>.init(n.x, n.y)
+            : SIMD2<Float>.init(
+                (1 - abs(n.y)) * (n.x >= 0 ? 1 : -1),
+                (1 - abs(n.x)) * (n.y >= 0 ? 1 : -1)
+            )
+
+        let snorms = (folded.clamped(lowerBound: .init(repeating: -1), upperBound: .init(repeating: 1)) * 32767)
+            .rounded(.toNearestOrAwayFromZero)
+
+        return UInt32(UInt16(bitPattern: Int16(snorms.x))) | UInt32(UInt16(bitPattern: Int16(snorms.y))) << 16
+    }
+
+    private static func encode(textureCoordinate: SIMD2<Float>) -> UInt32 {
+        return UInt32(Float16(textureCoordinate.x).bitPattern) | UInt32(Float16(textureCoordinate.y).bitPattern) << 16
+    }
 }
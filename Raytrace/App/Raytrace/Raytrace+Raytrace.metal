@@ -1,228 +1,137 @@
 // tomocy
 
-#include "../../Shader/AddressSpace.h"
-#include "../../Shader/Distribution.h"
-#include "../../Shader/Geometry/Geometry+Normalized.h"
-#include "../../Shader/Geometry/Geometry.h"
-#include "../../Shader/Sample.h"
-#include "../../Shader/Sequence/Sequence+Halton.h"
 #include "Raytrace+Acceleration.h"
+#include "Raytrace+Accumulation.h"
 #include "Raytrace+Background.h"
+#include "Raytrace+Denoise.h"
 #include "Raytrace+Env.h"
 #include "Raytrace+Frame.h"
-#include "Raytrace+Intersect.h"
-#include "Raytrace+Mesh.h"
-#include "Raytrace+Primitive.h"
-#include "Raytrace+Surface.h"
+#include "Raytrace+Tracer.h"
 #include <metal_stdlib>
 
 namespace Raytrace {
-struct Tracer {
+struct Args {
 public:
-    // For some reason, the metal compiler fails to compile recursive trace.
-    // As a workaround, we implement tracing in a loop instead.
-    float3 trace(const metal::raytracing::ray ray) const
-    {
-        if (maxTraceCount <= 0) {
-            return 0;
-        }
-
-        struct {
-            float3 color;
-            metal::raytracing::ray incidentRay;
-        } state = {
-            .color = 1,
-            .incidentRay = ray,
-        };
-
-        for (uint32_t bounceCount = 0;; bounceCount++) {
-            const auto result = trace(state.incidentRay, bounceCount);
-
-            state.color *= result.color;
-
-            if (!result.hasIncident) {
-                break;
-            }
-
-            state.incidentRay = result.incidentRay;
-        }
+    metal::texture2d<float, metal::access::write> target;
+    metal::texture2d<float, metal::access::read_write> accumulation;
 
-        return state.color;
-    }
+    // The samples that each tile of Accumulation::tileSize pixels has accumulated so far (r) and gets in this pass (g).
+    metal::texture2d<uint32_t> schedule;
 
-private:
-    struct TraceResult {
-    public:
-        float3 color;
-
-        bool hasIncident;
-        metal::raytracing::ray incidentRay;
-    };
-
-    TraceResult trace(const metal::raytracing::ray ray, const uint32_t bounceCount) const
-    {
-        if (bounceCount >= maxTraceCount) {
-            return {
-                .color = 1,
-                .hasIncident = false,
-            };
-        }
+    // What the primary ray of each pixel hits first, written with its first sample, see Denoise::Guide.
+    metal::texture2d<float, metal::access::write> albedo;
+    metal::texture2d<float, metal::access::write> normalDepth;
 
-        const auto intersection = intersector.intersectAlong(ray, 0xff);
+    Frame frame;
+    uint32_t maxTraceCount;
 
-        if (!intersection.has()) {
-            auto color = background.colorFor(ray);
+    Background background;
+    Env env;
+    Acceleration acceleration;
+};
 
-            if (bounceCount != 0) {
-                color *= directionalLight.color;
-            }
+// Adds the samples of the pixel, whose primary ray hits what the primary intersection tells,
+// so that the host can hand in what its packets have intersected.
+inline void computeWith(const uint2 id, constant Args& args, const thread Intersection& primary)
+{
+    const auto schedule = args.schedule.read(id / Accumulation::tileSize);
+    const auto accumulatedCount = schedule.r;
+    const auto sampleCount = schedule.g;
 
-            return {
-                .color = color,
-                .hasIncident = false,
-            };
-        }
+    const auto size = uint2(args.target.get_width(), args.target.get_height());
 
-        const auto surface = Surface(
-            intersection.toPrimitive(),
-            intersection.pieceIn(intersector.acceleration)
-        );
+    const auto inScreen = Shader::Coordinate::InScreen(id);
 
-        TraceResult result = {};
+    auto tracer = Tracer::make(
+        Camera::make(), size, args.background, args.env, args.acceleration, args.maxTraceCount, Sampler::make(id, args.frame.id, 0)
+    );
 
-        {
-            const struct {
-                Shader::Geometry::Normalized<float3> light;
-                Shader::Geometry::Normalized<float3> view;
-            } dirs = {
-                .light = -directionalLight.direction.value(),
-                .view = Shader::Geometry::normalize(view.position - intersection.position()),
-            };
+    // Add the samples to the ones of the previous passes, as long as nothing has changed since them.
+    auto accumulation = Accumulation::from(args.accumulation.read(inScreen.value()), accumulatedCount);
 
-            result.color = surface.colorWith(dirs.light, dirs.view);
+    for (uint32_t i = 0; i < sampleCount; i++) {
+        tracer.sampler.sampleIndex = accumulatedCount + i;
 
-            result.color += env.colorWith(
-                surface.albedo(),
-                surface.roughness(),
-                surface.normal(), dirs.view
-            );
+        // The primary ray never changes, so neither does what it hits first.
+        if (tracer.sampler.sampleIndex != 0) {
+            accumulation = accumulation.adding(tracer.trace(primary));
+            continue;
         }
 
-        {
-            result.hasIncident = true;
+        auto guide = Denoise::Guide::miss();
+        accumulation = accumulation.adding(tracer.trace(primary, guide));
 
-            result.incidentRay.origin = intersection.position();
-            result.incidentRay.min_distance = 1e-3;
-            result.incidentRay.max_distance = INFINITY;
-
-            if (!surface.material().isMetalicAt(surface.textureCoordinate())) {
-                const auto v = float2(
-                    Shader::Sequence::Halton::at(bounceCount * 5 + 5, seed + frame.id),
-                    Shader::Sequence::Halton::at(bounceCount * 5 + 6, seed + frame.id)
-                );
-
-                result.incidentRay.direction = Shader::Sample::CosineWeighted::sample(v, surface.normal());
-            } else {
-                result.incidentRay.direction = metal::reflect(ray.direction, surface.normal().value());
-            }
-        }
-
-        return result;
+        args.albedo.write(guide.albedoTexel(), inScreen.value());
+        args.normalDepth.write(guide.normalDepthTexel(), inScreen.value());
     }
 
-public:
-    uint32_t maxTraceCount = 3;
-
-    Frame frame;
-    uint32_t seed;
+    args.accumulation.write(accumulation.toTexel(), inScreen.value());
+    args.target.write(float4(accumulation.mean, 1), inScreen.value());
+}
 
-    Background background;
-    Env env;
+kernel void compute(
+    const uint2 id [[thread_position_in_grid]],
+    constant Args& args [[buffer(0)]]
+)
+{
+    // The tile has converged, so keep what it has.
+    if (args.schedule.read(id / Accumulation::tileSize).g == 0) {
+        return;
+    }
 
-    Intersector intersector;
+    const auto size = uint2(args.target.get_width(), args.target.get_height());
 
-    struct {
-        Shader::Geometry::Normalized<float3> direction;
-        float3 color;
-    } directionalLight;
+    // The camera does not jitter, so the primary ray is the same for every sample. Intersect it once for all of them,
+    // which the host counts as a single primary ray for the pixel rather than one for each sample.
+    const auto ray = Camera::make().rayAt(Shader::Coordinate::InScreen(id), size);
+    const auto primary = Intersector(args.acceleration).intersectAlong(ray, 0xff);
 
-    struct {
-        float3 position;
-    } view;
-};
+    computeWith(id, args, primary);
+}
 }
 
 namespace Raytrace {
+namespace Measure {
 struct Args {
 public:
-    metal::texture2d<float, metal::access::write> target;
-    Frame frame;
-    metal::texture2d<uint32_t> seeds;
-    Background background;
-    Env env;
-    Acceleration acceleration;
+    metal::texture2d<float> accumulation;
+    metal::texture2d<uint32_t> schedule;
+    metal::texture2d<float, metal::access::write> errors;
 };
 
+// Writes the mean error of the pixels of each tile, once the pass has been accumulated.
 kernel void compute(
     const uint2 id [[thread_position_in_grid]],
     constant Args& args [[buffer(0)]]
 )
 {
-    namespace raytracing = metal::raytracing;
-
-    // We know the size of the target texture for now.
-    const auto size = uint2(1600, 1200);
-
-    // We know the camera for now.
-    const struct {
-        Shader::Geometry::Normalized<float3> forward;
-        Shader::Geometry::Normalized<float3> right;
-        Shader::Geometry::Normalized<float3> up;
-        float3 position;
-    } camera = {
-        .forward = float3(0, 0, 1),
-        .right = float3(1, 0, 0),
-        .up = float3(0, 1, 0),
-        .position = float3(0, 0.5, -2),
-    };
-
-    const auto seed = args.seeds.read(id).r;
-
-    // Map Screen (0...width, 0...height) to UV (0...1, 0...1),
-    // then UV to NDC (-1...1, 1...-1).
-    const auto inScreen = Shader::Coordinate::InScreen(id);
-    const auto inUV = Shader::Coordinate::InUV::from(inScreen, size);
-    const auto inNDC = Shader::Coordinate::InNDC::from(inUV, 1);
-
-    const auto tracer = Tracer {
-        .maxTraceCount = 3,
-        .frame = args.frame,
-        .seed = seed,
-        .background = args.background,
-        .env = args.env,
-        .intersector = Intersector(args.acceleration),
-
-        // We know the directional light for now.
-        .directionalLight = {
-            .direction = Shader::Geometry::normalize(float3(-1, -1, 1)),
-            .color = float3(1) * M_PI_F,
-        },
-
-        .view = {
-            .position = camera.position,
-        },
-    };
-
-    const auto ray = raytracing::ray(
-        camera.position,
-        Shader::Geometry::normalize(
-            Shader::Geometry::alignAs(inNDC.value(), camera.forward, camera.right, camera.up)
-        )
-            .value()
-    );
+    const auto size = uint2(args.accumulation.get_width(), args.accumulation.get_height());
+
+    const auto origin = id * Accumulation::tileSize;
+    if (origin.x >= size.x || origin.y >= size.y) {
+        return;
+    }
+
+    const auto end = metal::min(origin + Accumulation::tileSize, size);
 
-    const auto color = tracer.trace(ray);
+    const auto schedule = args.schedule.read(id);
+    const auto accumulatedCount = schedule.r + schedule.g;
 
-    args.target.write(float4(color, 1), inScreen.value());
+    auto sum = 0.0f;
+    for (auto y = origin.y; y < end.y; y++) {
+        for (auto x = origin.x; x < end.x; x++) {
+            const auto accumulation = Accumulation::from(
+                args.accumulation.read(uint2(x, y)),
+                accumulatedCount
+            );
+
+            sum += accumulation.error();
+        }
+    }
+
+    const auto count = (end.x - origin.x) * (end.y - origin.y);
+
+    args.errors.write(float4(sum / float(count)), id);
+}
 }
 }
@@ -11,7 +11,17 @@ extension Raytrace {
         var resourcePool: ResourcePool
 
         var target: Target
-        var seeds: any MTLTexture
+
+        var accumulation: any MTLTexture
+        var errors: any MTLTexture
+        var schedule: Schedule
+
+        // What the primary ray of each pixel hits first, for Denoise.
+        var albedo: any MTLTexture
+        var normalDepth: any MTLTexture
+
+        // The hard cap of the rays of a path, see Raytrace::Tracer.
+        var maxTraceCount: UInt32 = 3
     }
 }
 
@@ -21,16 +31,22 @@ extension Raytrace.Raytrace {
         resolution: CGSize
     ) throws {
         let lib = device.makeDefaultLibrary()!
-        let fn = lib.makeFunction(name: "Raytrace::compute")!
 
         pipelineStates = .init(
-            compute: try PipelineStates.make(with: device, for: fn)
+            compute: try PipelineStates.make(with: device, for: lib.makeFunction(name: "Raytrace::compute")!),
+            measure: try PipelineStates.make(with: device, for: lib.makeFunction(name: "Raytrace::Measure::compute")!)
         )
 
         resourcePool = .init()
 
         target = Self.makeTarget(with: device, resolution: resolution)!
-        seeds = Self.makeSeeds(with: device, resolution: resolution)!
+
+        accumulation = Self.makeAccumulation(with: device, resolution: resolution)!
+        errors = Self.makeErrors(with: device, resolution: resolution)!
+        schedule = .init(with: device, resolution: resolution, options: .init())!
+
+        albedo = Self.makeGuide(with: device, label: "Albedo", format: .rgba16Float, resolution: resolution)!
+        normalDepth = Self.makeGuide(with: device, label: "NormalDepth", format: .rgba32Float, resolution: resolution)!
     }
 }
 
@@ -57,42 +73,60 @@ extension Raytrace.Raytrace {
 }
 
 extension Raytrace.Raytrace {
-    static func makeSeeds(
+    static func makeAccumulation(
         with device: some MTLDevice,
         resolution: CGSize
     ) -> (any MTLTexture)? {
-        guard let texture = Raytrace.Texture.make2D(
+        return Raytrace.Texture.make2D(
             with: device,
-            label: "Seeds",
-            format: .r32Uint,
+            label: "Accumulation",
+            format: .rgba32Float,
             size: .init(
                 .init(resolution.width),
                 .init(resolution.height)
             ),
             usage: [.shaderRead, .shaderWrite],
-            storageMode: .managed,
+            storageMode: .private,
             mipmapped: false
-        ) else { return nil }
-
-        let count = texture.width * texture.height
-
-        var seeds: [UInt32] = []
-        seeds.reserveCapacity(count)
+        )
+    }
 
-        for _ in 0..<count {
-            seeds.append(.random(in: 0...UInt32.max))
-        }
+    static func makeGuide(
+        with device: some MTLDevice,
+        label: String,
+        format: MTLPixelFormat,
+        resolution: CGSize
+    ) -> (any MTLTexture)? {
+        return Raytrace.Texture.make2D(
+            with: device,
+            label: label,
+            format: format,
+            size: .init(
+                .init(resolution.width),
+                .init(resolution.height)
+            ),
+            usage: [.shaderRead, .shaderWrite],
+            storageMode: .private,
+            mipmapped: false
+        )
+    }
 
-        seeds.withUnsafeBytes { bytes in
-            texture.replace(
-                region: MTLRegionMake2D(0, 0, texture.width, texture.height),
-                mipmapLevel: 0,
-                withBytes: bytes.baseAddress!,
-                bytesPerRow: MemoryLayout<UInt32>.stride * texture.width
-            )
-        }
+    // The errors are read back on the CPU, one texel for each tile.
+    static func makeErrors(
+        with device: some MTLDevice,
+        resolution: CGSize
+    ) -> (any MTLTexture)? {
+        let tileCount = Convergence.tileCount(for: resolution)
 
-        return texture
+        return Raytrace.Texture.make2D(
+            with: device,
+            label: "Errors",
+            format: .r32Float,
+            size: tileCount,
+            usage: [.shaderRead, .shaderWrite],
+            storageMode: .managed,
+            mipmapped: false
+        )
     }
 }
 
@@ -115,8 +149,12 @@ extension Raytrace.Raytrace {
             do {
                 let args = Args.init(
                     target: target.texture,
+                    accumulation: accumulation,
+                    schedule: schedule.texture,
+                    albedo: albedo,
+                    normalDepth: normalDepth,
                     frame: frame,
-                    seeds: seeds,
+                    maxTraceCount: maxTraceCount,
                     background: background,
                     env: env,
                     acceleration: acceleration
@@ -143,9 +181,244 @@ extension Raytrace.Raytrace {
     }
 }
 
+extension Raytrace.Raytrace {
+    // Measures the noise of the accumulation once the frame has been encoded, for convergence to read back.
+    func encodeMeasure(
+        to buffer: some MTLCommandBuffer
+    ) {
+        do {
+            let encoder = buffer.makeComputeCommandEncoder()!
+            defer { encoder.endEncoding() }
+
+            encoder.label = "Raytrace/Measure"
+
+            encoder.setComputePipelineState(pipelineStates.measure)
+
+            do {
+                let args = MeasureArgs.init(
+                    accumulation: accumulation,
+                    schedule: schedule.texture,
+                    errors: errors
+                )
+
+                let buffer = args.build(with: encoder, resourcePool: resourcePool, label: "MeasureArgs")!
+
+                encoder.setBuffer(buffer, offset: 0, index: 0)
+            }
+
+            do {
+                let threadsSizePerGroup = encoder.defaultThreadsSizePerGroup
+                let threadsGroupSize = encoder.threadsGroupSize(
+                    for: .init(errors.width, errors.height),
+                    as: threadsSizePerGroup
+                )
+
+                encoder.dispatchThreadgroups(
+                    threadsGroupSize,
+                    threadsPerThreadgroup: threadsSizePerGroup
+                )
+            }
+        }
+
+        do {
+            let encoder = buffer.makeBlitCommandEncoder()!
+            defer { encoder.endEncoding() }
+
+            encoder.label = "Raytrace/Measure/Synchronize"
+
+            encoder.synchronize(resource: errors)
+        }
+    }
+
+    // Reads back what encodeMeasure has measured, after the command buffer has completed.
+    func convergence() -> Convergence {
+        var errors = [Float].init(repeating: 0, count: self.errors.width * self.errors.height)
+
+        errors.withUnsafeMutableBytes { bytes in
+            self.errors.getBytes(
+                bytes.baseAddress!,
+                bytesPerRow: MemoryLayout<Float>.stride * self.errors.width,
+                from: MTLRegionMake2D(0, 0, self.errors.width, self.errors.height),
+                mipmapLevel: 0
+            )
+        }
+
+        return .init(
+            resolution: .init(target.texture.width, target.texture.height),
+            tileCount: .init(self.errors.width, self.errors.height),
+            errors: errors
+        )
+    }
+}
+
+extension Raytrace.Raytrace {
+    // Convergence is the noise of the accumulation by tiles of Raytrace::Accumulation::tileSize pixels,
+    // as the relative standard error of the mean luminance of their pixels.
+    struct Convergence {
+        static let tileSize = 16
+
+        var resolution: SIMD2<Int>
+        var tileCount: SIMD2<Int>
+        var errors: [Float]
+    }
+}
+
+extension Raytrace.Raytrace.Convergence {
+    static func tileCount(for resolution: CGSize) -> SIMD2<Int> {
+        return .init(
+            Int(resolution.width).align(by: tileSize) / tileSize,
+            Int(resolution.height).align(by: tileSize) / tileSize
+        )
+    }
+
+    var error: Float { error(in: .init(0, 0), size: resolution) }
+
+    // The error of the noisiest tile which overlaps the region, in pixels.
+    func error(in origin: SIMD2<Int>, size: SIMD2<Int>) -> Float {
+        let end = SIMD2<Int>.init(
+            min(origin.x + size.x, resolution.x),
+            min(origin.y + size.y, resolution.y)
+        )
+
+        let from = origin / Self.tileSize
+        let to = SIMD2<Int>.init(
+            min(end.x.align(by: Self.tileSize) / Self.tileSize, tileCount.x),
+            min(end.y.align(by: Self.tileSize) / Self.tileSize, tileCount.y)
+        )
+
+        var error: Float = 0
+
+        // Regions out of the image have no tiles, where stride never traps unlike ranges.
+        for y in stride(from: from.y, to: to.y, by: 1) {
+            for x in stride(from: from.x, to: to.x, by: 1) {
+                error = max(error, errors[y * tileCount.x + x])
+            }
+        }
+
+        return error
+    }
+}
+
+extension Raytrace.Raytrace {
+    // Schedule gives each tile of Raytrace::Accumulation::tileSize pixels a budget of samples for the next pass,
+    // only sending them to the tiles whose error is still above the threshold.
+    struct Schedule {
+        struct Options {
+            // Tiles get samples until their error falls below this, or uniformly up to maxCount if it is not positive.
+            var threshold: Float = 0.05
+
+            var maxCount: UInt32 = 1024
+            var maxCountPerPass: UInt32 = 16
+        }
+
+        // Fewer samples than this may agree by chance, as Raytrace::Accumulation::minCount.
+        static let minCount: UInt32 = 4
+
+        var options: Options
+        var tileCount: SIMD2<Int>
+
+        var counts: [UInt32]
+        var budgets: [UInt32]
+
+        // The samples accumulated so far (r) and for the next pass (g) of each tile, for Raytrace::Args::schedule.
+        var texture: any MTLTexture
+    }
+}
+
+extension Raytrace.Raytrace.Schedule {
+    init?(
+        with device: some MTLDevice,
+        resolution: CGSize,
+        options: Options
+    ) {
+        self.options = options
+        tileCount = Raytrace.Raytrace.Convergence.tileCount(for: resolution)
+
+        guard let texture = Raytrace.Texture.make2D(
+            with: device,
+            label: "Schedule",
+            format: .rg32Uint,
+            size: tileCount,
+            usage: [.shaderRead],
+            storageMode: .managed,
+            mipmapped: false
+        ) else { return nil }
+        self.texture = texture
+
+        // Every tile needs a few samples before its error means anything.
+        let first = options.threshold > 0 ? Self.minCount : 1
+
+        counts = .init(repeating: 0, count: tileCount.x * tileCount.y)
+        budgets = .init(repeating: min(first, options.maxCount), count: counts.count)
+
+        write()
+    }
+}
+
+extension Raytrace.Raytrace.Schedule {
+    var hasWork: Bool { budgets.contains { $0 != 0 } }
+
+    // Adds the budgets of the pass that has just completed to the counts and plans the next pass from its convergence.
+    // It returns whether any tile gets samples in the next pass.
+    mutating func advance(with convergence: Raytrace.Raytrace.Convergence) -> Bool {
+        for i in counts.indices {
+            counts[i] += budgets[i]
+
+            let count = counts[i]
+
+            if count >= options.maxCount {
+                budgets[i] = 0
+                continue
+            }
+
+            if options.threshold <= 0 {
+                budgets[i] = 1
+                continue
+            }
+
+            let error = convergence.errors[i]
+            if error < options.threshold {
+                budgets[i] = 0
+                continue
+            }
+
+            // The error falls with the square root of the count, which tells how many samples the tile still needs.
+            // Cap them per pass, as the estimate of the error is noisy itself.
+            let ratio = Double(error) / Double(options.threshold)
+            let needed = ratio.isFinite ? (Double(count) * ratio * ratio).rounded(.up) : Double(UInt32.max)
+            let more = UInt32(min(max(needed - Double(count), 1), Double(options.maxCountPerPass)))
+
+            budgets[i] = min(more, options.maxCount - count)
+        }
+
+        write()
+
+        return hasWork
+    }
+
+    private func write() {
+        var texels: [SIMD2<UInt32>] = []
+        texels.reserveCapacity(counts.count)
+
+        for i in counts.indices {
+            texels.append(.init(counts[i], budgets[i]))
+        }
+
+        texels.withUnsafeBytes { bytes in
+            texture.replace(
+                region: MTLRegionMake2D(0, 0, texture.width, texture.height),
+                mipmapLevel: 0,
+                withBytes: bytes.baseAddress!,
+                bytesPerRow: MemoryLayout<SIMD2<UInt32>>.stride * texture.width
+            )
+        }
+    }
+}
+
 extension Raytrace.Raytrace {
     struct PipelineStates {
         var compute: any MTLComputePipelineState
+        var measure: any MTLComputePipelineState
     }
 }
 
@@ -167,8 +440,12 @@ extension Raytrace.Raytrace {
 extension Raytrace.Raytrace {
     struct Args {
         var target: any MTLTexture
+        var accumulation: any MTLTexture
+        var schedule: any MTLTexture
+        var albedo: any MTLTexture
+        var normalDepth: any MTLTexture
         var frame: Raytrace.Frame
-        var seeds: any MTLTexture
+        var maxTraceCount: UInt32
         var background: Raytrace.Background
         var env: Raytrace.Env
         var acceleration: Raytrace.Acceleration
@@ -183,8 +460,12 @@ extension Raytrace.Raytrace.Args {
     ) -> (any MTLBuffer)? {
         let forGPU = ForGPU.init(
             target: target.use(with: encoder, usage: .write),
+            accumulation: accumulation.use(with: encoder, usage: [.read, .write]),
+            schedule: schedule.use(with: encoder, usage: .read),
+            albedo: albedo.use(with: encoder, usage: .write),
+            normalDepth: normalDepth.use(with: encoder, usage: .write),
             frame: frame,
-            seeds: seeds.use(with: encoder, usage: .read),
+            maxTraceCount: maxTraceCount,
             background: background.use(with: encoder, usage: .read),
             env: env.use(with: encoder, usage: .read),
             acceleration: acceleration.use(
@@ -211,11 +492,59 @@ extension Raytrace.Raytrace.Args {
 extension Raytrace.Raytrace.Args {
     struct ForGPU {
         var target: MTLResourceID
+        var accumulation: MTLResourceID
+        var schedule: MTLResourceID
+
+        var albedo: MTLResourceID
+        var normalDepth: MTLResourceID
 
         var frame: Raytrace.Frame
-        var seeds: MTLResourceID
+        var maxTraceCount: UInt32
+
         var background: Raytrace.Background.ForGPU
         var env: Raytrace.Env.ForGPU
         var acceleration: Raytrace.Acceleration.ForGPU
     }
 }
+
+extension Raytrace.Raytrace {
+    struct MeasureArgs {
+        var accumulation: any MTLTexture
+        var schedule: any MTLTexture
+        var errors: any MTLTexture
+    }
+}
+
+extension Raytrace.Raytrace.MeasureArgs {
+    func build(
+        with encoder: some MTLComputeCommandEncoder,
+        resourcePool: Raytrace.ResourcePool,
+        label: String
+    ) -> (any MTLBuffer)? {
+        let forGPU = ForGPU.init(
+            accumulation: accumulation.use(with: encoder, usage: .read),
+            schedule: schedule.use(with: encoder, usage: .read),
+            errors: errors.use(with: encoder, usage: .write)
+        )
+
+        let buffer = resourcePool.buffers.take(at: label) {
+            Raytrace.Metal.Buffer.buildable(forGPU).build(
+                with: encoder.device,
+                label: label,
+                options: .storageModeShared
+            )
+        }!
+
+        Raytrace.IO.writable(forGPU).write(to: buffer)
+
+        return buffer
+    }
+}
+
+extension Raytrace.Raytrace.MeasureArgs {
+    struct ForGPU {
+        var accumulation: MTLResourceID
+        var schedule: MTLResourceID
+        var errors: MTLResourceID
+    }
+}
@@ -0,0 +1,36 @@
+// tomocy
+
+#pragma once
+
+#include "../../Shader/Sequence/Sequence+Sobol.h"
+#include <metal_stdlib>
+
+namespace Raytrace {
+// Sampler hands out the random numbers of a sample of a pixel from a Sobol sequence scrambled by a hash of the pixel
+// and of the frame, so that neither the pixels nor the frames correlate without a texture of seeds.
+struct Sampler {
+public:
+    static Sampler make(const uint2 pixel, const uint32_t frameID, const uint32_t sampleIndex)
+    {
+        using Shader::Sequence::Sobol;
+
+        return {
+            .seed = Sobol::hash(pixel.x ^ Sobol::hash(pixel.y ^ Sobol::hash(frameID))),
+            .sampleIndex = sampleIndex,
+        };
+    }
+
+    // The 4 dimensions of a bounce, whose sequence is scrambled by a seed of its own,
+    // which pads the bounces with each other instead of taking the higher dimensions of Sobol.
+    float4 at(const uint32_t bounceCount) const
+    {
+        return Shader::Sequence::Sobol::at(sampleIndex, Shader::Sequence::Sobol::hash(seed ^ bounceCount));
+    }
+
+public:
+    uint32_t seed;
+
+    // Which sample of the pixel this is, so that each of them takes other directions.
+    uint32_t sampleIndex;
+};
+}
@@ -8,6 +8,7 @@ extension Raytrace {
 
         var accelerator: Accelerator
         var raytrace: Raytrace
+        var denoise: Denoise
         var echo: Echo
     }
 }
@@ -19,6 +20,7 @@ extension Raytrace.Shader {
         accelerator = .init()
 
         raytrace = try .init(device: device, resolution: resolution)
+        denoise = try .init(device: device, resolution: resolution)
         echo = try .init(device: device, format: format)
     }
 }
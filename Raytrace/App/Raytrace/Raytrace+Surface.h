@@ -12,9 +12,11 @@
 namespace Raytrace {
 struct Surface {
 public:
-    Surface(const Primitive primitive, const Mesh::Piece piece)
+    // The footprint is that of the ray on the texture, see Shader::PBR::Material::texelAt.
+    Surface(const Primitive primitive, const Mesh::Piece piece, const float footprint)
         : primitive_(primitive)
         , piece_(piece)
+        , texel_(piece.material.texelAt(primitive.textureCoordinate, footprint))
     {
     }
 
@@ -77,16 +79,17 @@ public:
 public:
     const thread Shader::PBR::Material& material() const thread { return piece().material; }
 
-    Shader::PBR::Material::Albedo albedo() const { return material().albedoAt(textureCoordinate()); }
+    Shader::PBR::Material::Albedo albedo() const { return texel_.albedo(); }
 
-    bool isMetallic() const { return material().isMetalicAt(textureCoordinate()); }
+    bool isMetallic() const { return texel_.isMetallic(); }
 
-    float metalness() const { return material().metalnessAt(textureCoordinate()); }
+    float metalness() const { return texel_.metalness; }
 
-    float roughness() const { return material().roughnessAt(textureCoordinate()); }
+    float roughness() const { return texel_.roughness; }
 
 private:
     Primitive primitive_;
     Mesh::Piece piece_;
+    Shader::PBR::Material::Texel texel_;
 };
 }
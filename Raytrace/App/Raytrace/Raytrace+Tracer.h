@@ -0,0 +1,372 @@
+// tomocy
+
+#pragma once
+
+#include "../../Shader/AddressSpace.h"
+#include "../../Shader/Distribution.h"
+#include "../../Shader/Geometry/Geometry+Normalized.h"
+#include "../../Shader/Geometry/Geometry.h"
+#include "../../Shader/Sample.h"
+#include "Raytrace+Acceleration.h"
+#include "Raytrace+Accumulation.h"
+#include "Raytrace+Background.h"
+#include "Raytrace+Denoise.h"
+#include "Raytrace+Env.h"
+#include "Raytrace+Frame.h"
+#include "Raytrace+Intersect.h"
+#include "Raytrace+Mesh.h"
+#include "Raytrace+Primitive.h"
+#include "Raytrace+Sampler.h"
+#include "Raytrace+Surface.h"
+#include <metal_stdlib>
+
+namespace Raytrace {
+struct Camera {
+public:
+    // We know the camera for now.
+    static Camera make()
+    {
+        return {
+            .forward = float3(0, 0, 1),
+            .right = float3(1, 0, 0),
+            .up = float3(0, 1, 0),
+            .position = float3(0, 0.5, -2),
+        };
+    }
+
+public:
+    metal::raytracing::ray rayAt(const Shader::Coordinate::InScreen inScreen, const uint2 size) const
+    {
+        // Map Screen (0...width, 0...height) to UV (0...1, 0...1),
+        // then UV to NDC (-1...1, 1...-1).
+        const auto inUV = Shader::Coordinate::InUV::from(inScreen, size);
+        const auto inNDC = Shader::Coordinate::InNDC::from(inUV, 1);
+
+        return metal::raytracing::ray(
+            position,
+            Shader::Geometry::normalize(
+                Shader::Geometry::alignAs(inNDC.value(), forward, right, up)
+            )
+                .value()
+        );
+    }
+
+    // The angle that a pixel spans around the forward, where the screen spans 2 on its height at 1 ahead.
+    float spreadAngleFor(const uint2 size) const
+    {
+        return 2.0 / float(size.y);
+    }
+
+public:
+    Shader::Geometry::Normalized<float3> forward;
+    Shader::Geometry::Normalized<float3> right;
+    Shader::Geometry::Normalized<float3> up;
+    float3 position;
+};
+}
+
+namespace Raytrace {
+// Cone bounds what a ray covers (Akenine-Moller et al., Texture Level of Detail Strategies for Real-Time Ray Tracing),
+// which widens with the distance that it travels and spreads more at each bounce,
+// so that the hits of incoherent rays sample the coarse levels of textures instead of their base levels.
+struct Cone {
+public:
+    static Cone primary(const float spreadAngle)
+    {
+        return {
+            .width = 0,
+            .spreadAngle = spreadAngle,
+        };
+    }
+
+public:
+    float widthAt(const float distance) const { return width + spreadAngle * distance; }
+
+    // The cone that goes on from a hit at the distance, spread by the angle of the lobe that it is sampled from.
+    Cone bounced(const float distance, const float lobeAngle) const
+    {
+        return {
+            .width = widthAt(distance),
+            .spreadAngle = spreadAngle + lobeAngle,
+        };
+    }
+
+public:
+    // Rather than the whole hemisphere of a cosine-weighted bounce,
+    // as the samples of a pixel average over it instead of a single ray covering it.
+    static constexpr constant float diffuseLobeAngle = 0.2;
+
+public:
+    float width;
+    float spreadAngle;
+};
+}
+
+namespace Raytrace {
+struct Tracer {
+public:
+    // The tracer of the pixels of the camera, which the kernel and the wavefront stages of the host share.
+    static Tracer make(
+        const Camera camera,
+        const uint2 size,
+        const Background background,
+        const Env env,
+        const Acceleration acceleration,
+        const uint32_t maxTraceCount,
+        const Sampler sampler
+    )
+    {
+        return {
+            .maxTraceCount = maxTraceCount,
+            .pixelSpreadAngle = camera.spreadAngleFor(size),
+            .sampler = sampler,
+            .background = background,
+            .env = env,
+            .intersector = Intersector(acceleration),
+
+            // We know the directional light for now.
+            .directionalLight = {
+                .direction = Shader::Geometry::normalize(float3(-1, -1, 1)),
+                .color = float3(1) * M_PI_F,
+            },
+
+            .view = {
+                .position = camera.position,
+            },
+        };
+    }
+
+public:
+    // For some reason, the metal compiler fails to compile recursive trace.
+    // As a workaround, we implement tracing in a loop instead.
+    // The path starts from what its primary ray hits, which the caller intersects once for all the samples of a pixel.
+    float3 trace(const thread Intersection& primary) const
+    {
+        auto guide = Denoise::Guide::miss();
+        return trace(primary, guide);
+    }
+
+    // Also tells what the primary ray hits, for the denoiser.
+    float3 trace(const thread Intersection& primary, thread Denoise::Guide& guide) const
+    {
+        if (maxTraceCount <= 0) {
+            return 0;
+        }
+
+        struct {
+            float3 color;
+            metal::raytracing::ray incidentRay;
+            Cone incidentCone;
+        } state = {
+            .color = 1,
+            .incidentRay = primary.ray(),
+            .incidentCone = Cone::primary(pixelSpreadAngle),
+        };
+
+        for (uint32_t bounceCount = 0;; bounceCount++) {
+            const auto result = bounceCount == 0
+                ? shade(state.incidentRay, state.incidentCone, primary, bounceCount)
+                : trace(state.incidentRay, state.incidentCone, bounceCount);
+
+            if (bounceCount == 0) {
+                guide = result.guide;
+            }
+
+            const auto isOccluded = result.hasShadowRay && intersector.occluded(result.shadowRay);
+            state.color *= result.colorWith(isOccluded);
+
+            if (!result.hasIncident) {
+                break;
+            }
+
+            if (!survives(state.color, bounceCount)) {
+                state.color = 0;
+                break;
+            }
+
+            state.incidentRay = result.incidentRay;
+            state.incidentCone = result.incidentCone;
+        }
+
+        return state.color;
+    }
+
+public:
+    struct TraceResult {
+    public:
+        // What the shadow ray tells adds the light to the color.
+        float3 colorWith(const bool isOccluded) const
+        {
+            return isOccluded ? color : color + lightColor;
+        }
+
+    public:
+        // The color besides the directional light, which only reaches the surface unless the shadow ray is occluded.
+        float3 color;
+
+        bool hasIncident;
+        metal::raytracing::ray incidentRay;
+        Cone incidentCone;
+
+        Denoise::Guide guide;
+
+        bool hasShadowRay;
+        metal::raytracing::ray shadowRay;
+        float3 lightColor;
+    };
+
+    // Shades what the ray of the bounce has hit, and samples the ray that comes in from there.
+    TraceResult shade(
+        const metal::raytracing::ray ray,
+        const Cone cone,
+        const thread Intersection& intersection,
+        const uint32_t bounceCount
+    ) const
+    {
+        if (!intersection.has()) {
+            auto color = background.colorFor(ray);
+
+            if (bounceCount != 0) {
+                color *= directionalLight.color;
+            }
+
+            return {
+                .color = color,
+                .hasIncident = false,
+                .incidentRay = {},
+                .incidentCone = {},
+                .guide = Denoise::Guide::miss(),
+                .hasShadowRay = false,
+                .shadowRay = {},
+                .lightColor = 0,
+            };
+        }
+
+        const auto piece = intersection.pieceIn(intersector.acceleration);
+        const auto primitive = intersection.toPrimitive(piece);
+
+        // The cone covers more of the surface the more grazing the ray is.
+        const auto footprint = cone.widthAt(intersection.distance()) * piece.textureScale
+            / metal::max(metal::abs(metal::dot(primitive.normal.value(), ray.direction)), 0.1);
+
+        const auto surface = Surface(primitive, piece, footprint);
+
+        TraceResult result = {};
+
+        {
+            const struct {
+                Shader::Geometry::Normalized<float3> light;
+                Shader::Geometry::Normalized<float3> view;
+            } dirs = {
+                .light = -directionalLight.direction.value(),
+                .view = Shader::Geometry::normalize(view.position - intersection.position()),
+            };
+
+            const auto albedo = surface.albedo();
+
+            result.color = env.colorWith(
+                albedo,
+                surface.roughness(),
+                surface.normal(), dirs.view
+            );
+
+            result.guide = {
+                .albedo = albedo.diffuse + albedo.specular,
+                .normal = surface.normal().value(),
+                .depth = intersection.distance(),
+            };
+
+            // Surfaces which face away from the light get none of it, so they need no shadow ray.
+            if (metal::dot(surface.normal().value(), dirs.light.value()) > 0) {
+                result.hasShadowRay = true;
+                result.shadowRay = metal::raytracing::ray(intersection.position(), dirs.light.value(), 1e-3, INFINITY);
+                result.lightColor = surface.colorWith(dirs.light, dirs.view);
+            }
+        }
+
+        {
+            result.hasIncident = true;
+
+            result.incidentRay.origin = intersection.position();
+            result.incidentRay.min_distance = 1e-3;
+            result.incidentRay.max_distance = INFINITY;
+
+            if (!surface.isMetallic()) {
+                result.incidentRay.direction = Shader::Sample::CosineWeighted::sample(
+                    sampler.at(bounceCount).xy, surface.normal()
+                );
+                result.incidentCone = cone.bounced(intersection.distance(), Cone::diffuseLobeAngle);
+            } else {
+                result.incidentRay.direction = metal::reflect(ray.direction, surface.normal().value());
+                result.incidentCone = cone.bounced(intersection.distance(), 0);
+            }
+        }
+
+        return result;
+    }
+
+    // Russian roulette: end the path with a chance that grows as its throughput falls,
+    // and make up for it in the paths that go on, so that dark paths stop early without bias.
+    bool survives(thread float3& throughput, const uint32_t bounceCount) const
+    {
+        if (bounceCount + 1 < minTraceCount) {
+            return true;
+        }
+
+        const auto survival = metal::min(metal::max(throughput.r, metal::max(throughput.g, throughput.b)), 1.0f);
+
+        if (sampler.at(bounceCount).z >= survival) {
+            return false;
+        }
+
+        throughput /= survival;
+        return true;
+    }
+
+private:
+    TraceResult trace(const metal::raytracing::ray ray, const Cone cone, const uint32_t bounceCount) const
+    {
+        if (bounceCount >= maxTraceCount) {
+            return {
+                .color = 1,
+                .hasIncident = false,
+                .incidentRay = {},
+                .incidentCone = {},
+                .guide = Denoise::Guide::miss(),
+                .hasShadowRay = false,
+                .shadowRay = {},
+                .lightColor = 0,
+            };
+        }
+
+        return shade(ray, cone, intersector.intersectAlong(ray, 0xff), bounceCount);
+    }
+
+public:
+    // Paths always reach this many rays before the roulette, as the first bounces carry most of the light.
+    static constexpr constant uint32_t minTraceCount = 2;
+
+public:
+    // The hard cap of the rays of a path, which the roulette ends most paths before.
+    uint32_t maxTraceCount = 3;
+
+    // What the cone of a camera ray spreads by, see Cone.
+    float pixelSpreadAngle;
+
+    Sampler sampler;
+
+    Background background;
+    Env env;
+
+    Intersector intersector;
+
+    struct {
+        Shader::Geometry::Normalized<float3> direction;
+        float3 color;
+    } directionalLight;
+
+    struct {
+        float3 position;
+    } view;
+};
+}
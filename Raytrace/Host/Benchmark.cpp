@@ -0,0 +1,365 @@
+// tomocy
+
+#include "../Shader/Coordinate.h"
+#include "../Shader/Geometry/Geometry.h"
+#include "../Shader/Interpolate.h"
+#include "../Shader/PBR/PBR+CookTorrance.h"
+#include "../Shader/PBR/PBR+Lambertian.h"
+#include "../Shader/Sample.h"
+#include "../Shader/Sequence/Sequence+Halton.h"
+#include "../Shader/Sequence/Sequence+Sobol.h"
+#include "../Shader/Sequence/Sequence+VanDerCorput.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+using Shader::Geometry::Normalized;
+
+// Inputs holds random arguments for the kernels, few enough by default to stay in the caches, so that memory does not get in the way.
+struct Inputs {
+public:
+    static Inputs make(const std::size_t count)
+    {
+        auto random = std::mt19937(0);
+        auto uniform = std::uniform_real_distribution<float>(0, 1);
+
+        const auto direction = [&]() {
+            const auto z = uniform(random) * 2 - 1;
+            const auto phi = uniform(random) * 2 * M_PI_F;
+            const auto r = metal::sqrt(metal::max(1 - z * z, 0.0f));
+
+            return float3(r * metal::cos(phi), r * metal::sin(phi), z);
+        };
+
+        auto inputs = Inputs();
+        for (std::size_t i = 0; i < count; i++) {
+            const auto normal = direction();
+            const auto light = direction();
+            const auto view = direction();
+
+            inputs.roughnesses.push_back(metal::max(uniform(random), 0.04f));
+            inputs.albedos.push_back(float3(uniform(random), uniform(random), uniform(random)));
+            inputs.normals.push_back(Shader::Geometry::normalize(normal));
+            inputs.lights.push_back(Shader::Geometry::normalize(light));
+            inputs.views.push_back(Shader::Geometry::normalize(view));
+            inputs.halfways.push_back(Shader::Geometry::normalize(light + view));
+            inputs.tangents.push_back(direction());
+            inputs.randoms.push_back(float2(uniform(random), uniform(random)));
+            inputs.bits.push_back(uint32_t(random()));
+            inputs.screens.push_back(uint2(random() % 1024, random() % (1024 * 6)));
+        }
+
+        return inputs;
+    }
+
+public:
+    std::size_t size() const { return roughnesses.size(); }
+
+public:
+    std::vector<float> roughnesses;
+    std::vector<float3> albedos;
+    std::vector<Normalized<float3>> normals;
+    std::vector<Normalized<float3>> lights;
+    std::vector<Normalized<float3>> views;
+    std::vector<Normalized<float3>> halfways;
+    std::vector<float3> tangents;
+    std::vector<float2> randoms;
+    std::vector<uint32_t> bits;
+    std::vector<uint2> screens;
+};
+
+// Keeps the compiler from dropping what is computed into the value, which it can no longer see through.
+template <typename T>
+void keep(const T& value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+float firstOf(const float value) { return value; }
+float firstOf(const float3 value) { return value.x; }
+float firstOf(const float4 value) { return value.x; }
+
+// Suite runs each kernel over the inputs in two variants and writes what it takes as JSON:
+// scalar feeds each call with the one before, so that it measures the latency of a call,
+// while batched writes independent calls into an array, so that it measures the throughput of calls in a loop.
+class Suite {
+public:
+    struct Result {
+    public:
+        std::string name;
+        const char* variant;
+        double nsPerOp;
+        double minNSPerOp;
+        std::size_t opCount;
+    };
+
+public:
+    Suite(const std::size_t inputCount, const double minSeconds, const std::string& filter)
+        : inputCount_(inputCount)
+        , minSeconds_(minSeconds)
+        , filter_(filter)
+    {
+    }
+
+public:
+    // The code takes the index of its inputs and a dependency, which is 0 but not known to be by the compiler
+    // in the scalar variant, and which it adds to one of its inputs.
+    template <typename Code>
+    void run(const std::string& name, const Code& code)
+    {
+        if (!filter_.empty() && name.find(filter_) == std::string::npos) {
+            return;
+        }
+
+        results_.push_back(measure(name, "scalar", [&]() {
+            auto dependency = 0.0f;
+            for (std::size_t i = 0; i < inputCount_; i++) {
+                // Multiplying by 0 is not folded without fast math, as it does not give 0 for infinities and NaNs.
+                dependency = firstOf(code(i, dependency)) * 0.0f;
+            }
+
+            keep(dependency);
+        }));
+
+        using Output = decltype(code(std::size_t(0), 0.0f));
+        auto outputs = std::vector<Output>(inputCount_);
+
+        results_.push_back(measure(name, "batched", [&]() {
+            for (std::size_t i = 0; i < inputCount_; i++) {
+                outputs[i] = code(i, 0.0f);
+            }
+
+            keep(outputs.data());
+        }));
+
+        std::fprintf(
+            stderr,
+            "%-32s %8.3f ns/op scalar, %8.3f ns/op batched\n",
+            name.c_str(),
+            results_[results_.size() - 2].nsPerOp,
+            results_.back().nsPerOp
+        );
+    }
+
+    void write(std::FILE* file) const
+    {
+        std::fprintf(file, "{\n");
+        std::fprintf(file, "  \"inputCount\": %zu,\n", inputCount_);
+        std::fprintf(file, "  \"minSeconds\": %g,\n", minSeconds_);
+        std::fprintf(file, "  \"benchmarks\": [");
+
+        for (std::size_t i = 0; i < results_.size(); i++) {
+            const auto& result = results_[i];
+            std::fprintf(
+                file,
+                "%s\n    {\"name\": \"%s\", \"variant\": \"%s\", \"nsPerOp\": %.4f, \"minNSPerOp\": %.4f, \"opsPerSecond\": %.1f, \"opCount\": %zu}",
+                i == 0 ? "" : ",",
+                result.name.c_str(),
+                result.variant,
+                result.nsPerOp,
+                result.minNSPerOp,
+                1e9 / result.nsPerOp,
+                result.opCount
+            );
+        }
+
+        std::fprintf(file, "\n  ]\n}\n");
+    }
+
+private:
+    // Runs passes over the inputs for at least minSeconds after a warm up, and takes the median of the passes,
+    // which shrugs off the passes that the system interrupts.
+    template <typename Pass>
+    Result measure(const std::string& name, const char* variant, const Pass& pass) const
+    {
+        pass();
+
+        std::vector<double> seconds;
+
+        auto total = 0.0;
+        while (total < minSeconds_ || seconds.size() < 5) {
+            const auto start = std::chrono::steady_clock::now();
+            pass();
+            const auto end = std::chrono::steady_clock::now();
+
+            seconds.push_back(std::chrono::duration<double>(end - start).count());
+            total += seconds.back();
+        }
+
+        const auto count = seconds.size();
+        std::nth_element(seconds.begin(), seconds.begin() + count / 2, seconds.end());
+        const auto median = seconds[count / 2];
+        const auto min = *std::min_element(seconds.begin(), seconds.end());
+
+        return {
+            .name = name,
+            .variant = variant,
+            .nsPerOp = median * 1e9 / double(inputCount_),
+            .minNSPerOp = min * 1e9 / double(inputCount_),
+            .opCount = count * inputCount_,
+        };
+    }
+
+private:
+    std::size_t inputCount_;
+    double minSeconds_;
+    std::string filter_;
+
+    std::vector<Result> results_;
+};
+}
+
+int main(const int argc, const char* const argv[])
+{
+    auto inputCount = std::size_t(1024);
+    auto minSeconds = 0.1;
+    auto filter = std::string();
+    auto outputPath = std::string();
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--inputs") == 0 && i + 1 < argc) {
+            inputCount = std::size_t(std::max(std::atoll(argv[++i]), 1ll));
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            minSeconds = std::max(std::atof(argv[++i]), 0.0);
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+            continue;
+        }
+
+        std::fprintf(stderr, "Usage: Benchmark [--inputs <count>] [--min-time <seconds>] [--filter <substring>] [--output <path>]\n");
+        return 1;
+    }
+
+    try {
+        const auto in = Inputs::make(inputCount);
+        auto suite = Suite(in.size(), minSeconds, filter);
+
+        using Shader::PBR::CookTorrance;
+
+        suite.run("CookTorrance::D", [&](const std::size_t i, const float dependency) {
+            return CookTorrance::D::compute(in.roughnesses[i] + dependency, in.normals[i], in.halfways[i]);
+        });
+
+        suite.run("CookTorrance::G", [&](const std::size_t i, const float dependency) {
+            return CookTorrance::G::compute(
+                in.roughnesses[i] + dependency, in.normals[i], in.lights[i], in.views[i], CookTorrance::G::Usage::analytic
+            );
+        });
+
+        suite.run("CookTorrance::F", [&](const std::size_t i, const float dependency) {
+            return CookTorrance::F::compute(in.albedos[i] + dependency, in.views[i], in.halfways[i]);
+        });
+
+        // What a hit pays for the specular term, all of D, G and F together.
+        suite.run("CookTorrance", [&](const std::size_t i, const float dependency) {
+            const auto roughness = in.roughnesses[i] + dependency;
+
+            return CookTorrance::compute(
+                CookTorrance::D::compute(roughness, in.normals[i], in.halfways[i]),
+                CookTorrance::G::compute(roughness, in.normals[i], in.lights[i], in.views[i], CookTorrance::G::Usage::analytic),
+                CookTorrance::F::compute(in.albedos[i], in.views[i], in.halfways[i]),
+                in.normals[i], in.lights[i], in.views[i]
+            );
+        });
+
+        suite.run("Lambertian", [&](const std::size_t i, const float dependency) {
+            return Shader::PBR::Lambertian::compute(in.albedos[i] + dependency);
+        });
+
+        suite.run("Sample::CosineWeighted", [&](const std::size_t i, const float dependency) {
+            return Shader::Sample::CosineWeighted::sample(in.randoms[i] + dependency, in.normals[i]);
+        });
+
+        suite.run("Sample::GGX", [&](const std::size_t i, const float dependency) {
+            return Shader::Sample::GGX::sample(in.randoms[i] + dependency, in.roughnesses[i], in.normals[i]);
+        });
+
+        suite.run("Geometry::alignFromTangent", [&](const std::size_t i, const float dependency) {
+            return Shader::Geometry::alignFromTangent(in.tangents[i] + dependency, in.normals[i]);
+        });
+
+        suite.run("Sequence::Sobol", [&](const std::size_t i, const float dependency) {
+            return Shader::Sequence::Sobol::at(uint32_t(i) + uint32_t(dependency), in.bits[i]);
+        });
+
+        // What the sampler took before Sobol, for the same 4 dimensions at the same indices.
+        suite.run("Sequence::Halton", [&](const std::size_t i, const float dependency) {
+            const auto index = uint32_t(i) + uint32_t(dependency);
+
+            return float4(
+                Shader::Sequence::Halton::at(0, index),
+                Shader::Sequence::Halton::at(1, index),
+                Shader::Sequence::Halton::at(2, index),
+                Shader::Sequence::Halton::at(3, index)
+            );
+        });
+
+        suite.run("Sequence::VanDerCorput", [&](const std::size_t i, const float dependency) {
+            return Shader::Sequence::VanDerCorput::at(in.bits[i] + uint32_t(dependency));
+        });
+
+        suite.run("Interpolate::linear", [&](const std::size_t i, const float dependency) {
+            return Shader::Interpolate::linear(in.albedos[i], in.tangents[i], in.roughnesses[i] + dependency);
+        });
+
+        // The barycentric variant, as the tracer interpolates the attributes of a triangle.
+        suite.run("Interpolate::linear (barycentric)", [&](const std::size_t i, const float dependency) {
+            return Shader::Interpolate::linear(in.albedos[i], in.tangents[i], in.lights[i].value(), in.randoms[i] * 0.5f + dependency);
+        });
+
+        suite.run("Coordinate::InNDC (screen)", [&](const std::size_t i, const float dependency) {
+            const auto inScreen = Shader::Coordinate::InScreen(in.screens[i] + uint(dependency));
+            const auto inUV = Shader::Coordinate::InUV::from(inScreen, uint2(1024, 1024 * 6));
+
+            return Shader::Coordinate::InNDC::from(inUV, 0.0f).value();
+        });
+
+        // From a texel of a cube laid out face after face, as Texture::Cube reads them, to its direction.
+        suite.run("Coordinate::InNDC (cube face)", [&](const std::size_t i, const float dependency) {
+            constexpr auto size = 1024u;
+
+            const auto inScreen = Shader::Coordinate::InScreen(in.screens[i] + uint(dependency));
+            const auto face = Shader::Coordinate::Face(inScreen.value().y / size);
+            const auto inFace = Shader::Coordinate::InFace::from(inScreen, size);
+            const auto inUV = Shader::Coordinate::InUV::from(inFace, size);
+
+            return Shader::Coordinate::InNDC::from(inUV, face).value();
+        });
+
+        if (outputPath.empty()) {
+            suite.write(stdout);
+        } else {
+            auto* file = std::fopen(outputPath.c_str(), "w");
+            if (!file) {
+                throw std::runtime_error("failed to open: " + outputPath);
+            }
+
+            suite.write(file);
+            std::fclose(file);
+        }
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "Error:\n%s\n", error.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+// tomocy
+
+#pragma once
+
+#include "../App/Raytrace/Raytrace+Acceleration.h"
+#include "Host+AccelerationStructure.h"
+#include "Host+Mesh.h"
+#include <memory>
+#include <metal_stdlib>
+#include <vector>
+
+namespace Host {
+struct Acceleration {
+public:
+    Acceleration(
+        std::shared_ptr<InstanceAccelerationStructure> structure,
+        const std::vector<Mesh>& meshes
+    )
+        : structure(structure)
+        , pieces(piecesOf(meshes))
+    {
+    }
+
+public:
+    Raytrace::Acceleration forShader()
+    {
+        return {
+            .structure = metal::raytracing::instance_acceleration_structure(structure.get()),
+            .pieces = pieces.data(),
+        };
+    }
+
+public:
+    std::shared_ptr<InstanceAccelerationStructure> structure;
+    std::vector<Raytrace::Mesh::Piece> pieces;
+};
+}
@@ -0,0 +1,368 @@
+// tomocy
+
+#include "Host+AccelerationStructure.h"
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+namespace Host {
+namespace {
+thread_local uint64_t countOnThread = 0;
+thread_local uint64_t occlusionCountOnThread = 0;
+
+// Möller-Trumbore, reporting the barycentric coordinate as Metal does:
+// position = (1 - u - v) * p0 + u * p1 + v * p2.
+bool intersectTriangle(
+    const metal::raytracing::ray& ray,
+    const float3 p0, const float3 p1, const float3 p2,
+    const float maxDistance,
+    float& distance,
+    float2& barycentric
+)
+{
+    const auto e1 = p1 - p0;
+    const auto e2 = p2 - p0;
+
+    const auto p = metal::cross(ray.direction, e2);
+    const auto det = metal::dot(e1, p);
+    if (std::fabs(det) < 1e-12f) {
+        return false;
+    }
+
+    const auto invDet = 1 / det;
+
+    const auto t = ray.origin - p0;
+    const auto u = metal::dot(t, p) * invDet;
+    if (u < 0 || u > 1) {
+        return false;
+    }
+
+    const auto q = metal::cross(t, e1);
+    const auto v = metal::dot(ray.direction, q) * invDet;
+    if (v < 0 || u + v > 1) {
+        return false;
+    }
+
+    const auto d = metal::dot(e2, q) * invDet;
+    if (d < ray.min_distance || d > maxDistance) {
+        return false;
+    }
+
+    distance = d;
+    barycentric = float2(u, v);
+
+    return true;
+}
+
+// FNV-1a over the boxes, which are all that the BVH depends on.
+uint64_t keyOf(const std::vector<BVH::Box>& boxes)
+{
+    auto key = uint64_t(14695981039346656037ull);
+
+    for (const auto& box : boxes) {
+        const float values[] = { box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z };
+
+        const auto* bytes = reinterpret_cast<const uint8_t*>(values);
+        for (std::size_t i = 0; i < sizeof(values); i++) {
+            key = (key ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+
+    return key;
+}
+}
+}
+
+namespace Host {
+PrimitiveAccelerationStructure::PrimitiveAccelerationStructure(
+    Pool& pool,
+    std::vector<Geometry> geometries,
+    const std::string& cacheDirectory
+)
+    : geometries_(std::move(geometries))
+{
+    auto boxes = std::vector<BVH::Box>();
+
+    for (std::size_t geometryI = 0; geometryI < geometries_.size(); geometryI++) {
+        const auto& geometry = geometries_[geometryI];
+
+        for (std::size_t primitiveI = 0; primitiveI < geometry.triangleCount; primitiveI++) {
+            const auto* indices = geometry.indices + primitiveI * 3;
+
+            auto box = BVH::Box();
+            for (std::size_t i = 0; i < 3; i++) {
+                box.grow(float3(geometry.positions[indices[i]]));
+            }
+
+            boxes.push_back(box);
+            references_.push_back({
+                .geometry = uint32_t(geometryI),
+                .primitive = uint32_t(primitiveI),
+            });
+        }
+    }
+
+    if (cacheDirectory.empty()) {
+        bvh_ = WideBVH::build(pool, boxes);
+        return;
+    }
+
+    const auto key = keyOf(boxes);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016" PRIx64 ".bvh", key);
+    const auto path = cacheDirectory + "/" + name;
+
+    if (auto cached = WideBVH::load(path, key, boxes.size())) {
+        bvh_ = std::move(*cached);
+        return;
+    }
+
+    bvh_ = WideBVH::build(pool, boxes);
+
+    // The cache only saves time, so a directory that cannot be written to skips it rather than failing the build.
+    try {
+        bvh_.save(path, key);
+    } catch (const std::exception&) {
+    }
+}
+
+bool PrimitiveAccelerationStructure::intersect(
+    const metal::raytracing::ray& ray,
+    metal::raytracing::intersection_result& result
+) const
+{
+    auto hits = false;
+
+    traverse(bvh_, ray, std::fmin(ray.max_distance, result.distance), [&](const uint32_t i, const float maxDistance) {
+        const auto& reference = references_[i];
+        const auto& geometry = geometries_[reference.geometry];
+
+        const auto* indices = geometry.indices + std::size_t(reference.primitive) * 3;
+
+        float distance = 0;
+        float2 barycentric = 0;
+
+        const auto intersects = intersectTriangle(
+            ray,
+            geometry.positions[indices[0]],
+            geometry.positions[indices[1]],
+            geometry.positions[indices[2]],
+            maxDistance,
+            distance,
+            barycentric
+        );
+        if (!intersects) {
+            return maxDistance;
+        }
+
+        hits = true;
+
+        result.type = metal::raytracing::intersection_type::triangle;
+        result.distance = distance;
+        result.geometry_id = reference.geometry;
+        result.primitive_id = reference.primitive;
+        result.triangle_barycentric_coord = barycentric;
+        result.primitive_data = static_cast<const uint8_t*>(geometry.primitiveData)
+            + std::size_t(reference.primitive) * geometry.primitiveDataStride;
+
+        return distance;
+    });
+
+    return hits;
+}
+
+bool PrimitiveAccelerationStructure::occluded(const metal::raytracing::ray& ray) const
+{
+    auto hits = false;
+
+    traverse(bvh_, ray, ray.max_distance, [&](const uint32_t i, const float maxDistance) {
+        const auto& reference = references_[i];
+        const auto& geometry = geometries_[reference.geometry];
+
+        const auto* indices = geometry.indices + std::size_t(reference.primitive) * 3;
+
+        float distance = 0;
+        float2 barycentric = 0;
+
+        hits = intersectTriangle(
+            ray,
+            geometry.positions[indices[0]],
+            geometry.positions[indices[1]],
+            geometry.positions[indices[2]],
+            maxDistance,
+            distance,
+            barycentric
+        );
+
+        return hits ? -INFINITY : maxDistance;
+    });
+
+    return hits;
+}
+}
+
+namespace Host {
+InstanceAccelerationStructure::InstanceAccelerationStructure(Pool& pool, std::vector<Instance> instances)
+    : instances_(std::move(instances))
+{
+    boxes_.reserve(instances_.size());
+    for (const auto& instance : instances_) {
+        boxes_.push_back(boxOf(instance));
+    }
+
+    bvh_ = WideBVH::build(pool, boxes_);
+    builtCost_ = bvh_.cost();
+}
+
+bool InstanceAccelerationStructure::move(Pool& pool, const std::vector<Transform::Matrix>& transforms)
+{
+    if (transforms.size() != instances_.size()) {
+        throw std::runtime_error(
+            "the transforms do not match the instances: " + std::to_string(transforms.size()) + " for " + std::to_string(instances_.size())
+        );
+    }
+
+    for (std::size_t i = 0; i < instances_.size(); i++) {
+        auto& instance = instances_[i];
+
+        instance.transform = transforms[i];
+        instance.inverse = transforms[i].inverse();
+
+        boxes_[i] = boxOf(instance);
+    }
+
+    bvh_.refit(boxes_);
+
+    if (bvh_.cost() <= builtCost_ * maxCostGrowth) {
+        return false;
+    }
+
+    bvh_ = WideBVH::build(pool, boxes_);
+    builtCost_ = bvh_.cost();
+
+    return true;
+}
+
+BVH::Box InstanceAccelerationStructure::boxOf(const Instance& instance)
+{
+    const auto local = instance.structure->bounds();
+
+    auto box = BVH::Box();
+    if (local.isEmpty()) {
+        // Keep a point so that the build can still place the instance.
+        box.grow(instance.transform.columns[3]);
+        return box;
+    }
+
+    for (std::size_t i = 0; i < 8; i++) {
+        const auto corner = float3(
+            i & 1 ? local.max.x : local.min.x,
+            i & 2 ? local.max.y : local.min.y,
+            i & 4 ? local.max.z : local.min.z
+        );
+        box.grow(instance.transform.apply(corner));
+    }
+
+    return box;
+}
+
+metal::raytracing::intersection_result InstanceAccelerationStructure::intersect(
+    const metal::raytracing::ray& ray,
+    const uint mask
+) const
+{
+    countOnThread++;
+
+    metal::raytracing::intersection_result result = {};
+
+    traverse(bvh_, ray, ray.max_distance, [&](const uint32_t i, const float) {
+        const auto& instance = instances_[i];
+
+        if ((instance.mask & mask) == 0) {
+            return result.distance;
+        }
+
+        // Keep the direction unnormalized so that distances in both spaces agree.
+        const auto local = metal::raytracing::ray(
+            instance.inverse.apply(ray.origin),
+            instance.inverse.applyToDirection(ray.direction),
+            ray.min_distance,
+            ray.max_distance
+        );
+
+        if (instance.structure->intersect(local, result)) {
+            result.instance_id = uint(i);
+            result.user_instance_id = instance.userID;
+        }
+
+        return result.distance;
+    });
+
+    return result;
+}
+
+bool InstanceAccelerationStructure::occluded(const metal::raytracing::ray& ray, const uint mask) const
+{
+    occlusionCountOnThread++;
+
+    const auto visitCountBefore = NodeVisits::onThread.count;
+
+    auto hits = false;
+
+    traverse(bvh_, ray, ray.max_distance, [&](const uint32_t i, const float maxDistance) {
+        const auto& instance = instances_[i];
+
+        if ((instance.mask & mask) == 0) {
+            return maxDistance;
+        }
+
+        const auto local = metal::raytracing::ray(
+            instance.inverse.apply(ray.origin),
+            instance.inverse.applyToDirection(ray.direction),
+            ray.min_distance,
+            ray.max_distance
+        );
+
+        hits = instance.structure->occluded(local);
+
+        return hits ? -INFINITY : maxDistance;
+    });
+
+    NodeVisits::onThread.shadowCount += NodeVisits::onThread.count - visitCountBefore;
+
+    return hits;
+}
+
+uint64_t InstanceAccelerationStructure::intersectionCount() { return countOnThread; }
+
+uint64_t InstanceAccelerationStructure::occlusionCount() { return occlusionCountOnThread; }
+}
+
+namespace metal {
+namespace raytracing {
+namespace detail {
+intersection_result intersect(
+    const ray& ray,
+    const instance_acceleration_structure& structure,
+    const uint mask,
+    const bool acceptsAny
+)
+{
+    if (!acceptsAny) {
+        return structure.raw->intersect(ray, mask);
+    }
+
+    intersection_result result = {};
+    if (structure.raw->occluded(ray, mask)) {
+        result.type = intersection_type::triangle;
+    }
+
+    return result;
+}
+}
+}
+}
@@ -0,0 +1,132 @@
+// tomocy
+
+#pragma once
+
+#include "Host+BVH.h"
+#include "Host+Pool.h"
+#include "Host+Transform.h"
+#include "Host+WideBVH.h"
+#include <cstddef>
+#include <cstdint>
+#include <metal_stdlib>
+#include <string>
+#include <vector>
+
+namespace Host {
+// PrimitiveAccelerationStructure is the host counterpart of a primitive MTLAccelerationStructure,
+// holding the triangle geometries of a mesh in its own space.
+class PrimitiveAccelerationStructure {
+public:
+    struct Geometry {
+    public:
+        const packed_float3* positions;
+        const uint32_t* indices;
+        std::size_t triangleCount;
+
+        const void* primitiveData;
+        std::size_t primitiveDataStride;
+    };
+
+public:
+    // Loads the BVH from cacheDirectory if it has been built for the same triangles, and saves it there otherwise.
+    // An empty cacheDirectory always builds the BVH.
+    PrimitiveAccelerationStructure(Pool& pool, std::vector<Geometry> geometries, const std::string& cacheDirectory = "");
+
+public:
+    // Intersects the ray with the triangles, keeping the closest hit in result.
+    bool intersect(
+        const metal::raytracing::ray& ray,
+        metal::raytracing::intersection_result& result
+    ) const;
+
+    // Whether the ray hits any of the triangles, which skips what a hit tells besides that.
+    bool occluded(const metal::raytracing::ray& ray) const;
+
+public:
+    const std::vector<Geometry>& geometries() const { return geometries_; }
+
+    BVH::Box bounds() const { return bvh_.bounds; }
+    const BVH::Stats& stats() const { return bvh_.stats; }
+
+public:
+    // Reference locates the triangle behind each box of the BVH.
+    struct Reference {
+    public:
+        uint32_t geometry;
+        uint32_t primitive;
+    };
+
+    const WideBVH& bvh() const { return bvh_; }
+    const std::vector<Reference>& references() const { return references_; }
+
+private:
+    std::vector<Geometry> geometries_;
+
+    std::vector<Reference> references_;
+    WideBVH bvh_;
+};
+}
+
+namespace Host {
+// InstanceAccelerationStructure is the host counterpart of an instance MTLAccelerationStructure.
+class InstanceAccelerationStructure {
+public:
+    struct Instance {
+    public:
+        const PrimitiveAccelerationStructure* structure;
+
+        Transform::Matrix transform;
+        Transform::Matrix inverse;
+
+        uint mask;
+
+        // What hits on the instance report as user_instance_id, as MTLAccelerationStructureUserIDInstanceDescriptor does.
+        uint userID;
+    };
+
+public:
+    InstanceAccelerationStructure(Pool& pool, std::vector<Instance> instances);
+
+public:
+    // Moves each instance to its transform and refits the BVH to where they are,
+    // or builds it again once refitting has made it cost rays too much more than the last build did, see WideBVH::cost.
+    // Returns whether it has been built again.
+    bool move(Pool& pool, const std::vector<Transform::Matrix>& transforms);
+
+public:
+    metal::raytracing::intersection_result intersect(
+        const metal::raytracing::ray& ray,
+        const uint mask
+    ) const;
+
+    // Ends at the first hit that it finds, in any instance, instead of the closest one.
+    bool occluded(const metal::raytracing::ray& ray, const uint mask) const;
+
+public:
+    const std::vector<Instance>& instances() const { return instances_; }
+
+    const WideBVH& bvh() const { return bvh_; }
+    const BVH::Stats& stats() const { return bvh_.stats; }
+
+public:
+    // The number of rays intersected on the calling thread so far.
+    static uint64_t intersectionCount();
+
+    // The number of rays tested for occlusion on the calling thread so far.
+    static uint64_t occlusionCount();
+
+public:
+    static constexpr float maxCostGrowth = 1.25f;
+
+private:
+    static BVH::Box boxOf(const Instance& instance);
+
+private:
+    std::vector<Instance> instances_;
+    WideBVH bvh_;
+
+    // The box of each instance, kept so that moving them allocates nothing.
+    std::vector<BVH::Box> boxes_;
+    float builtCost_ = 0;
+};
+}
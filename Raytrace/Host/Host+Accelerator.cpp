@@ -0,0 +1,117 @@
+// tomocy
+
+#include "Host+Accelerator.h"
+#include <algorithm>
+
+namespace Host {
+void Accelerator::Primitive::encode(Pool& pool, Mesh& mesh) const
+{
+    std::vector<PrimitiveAccelerationStructure::Geometry> geometries;
+    geometries.reserve(mesh.pieces.size());
+
+    for (const auto& piece : mesh.pieces) {
+        geometries.push_back({
+            .positions = mesh.positions.data(),
+            .indices = piece.indices.data(),
+            .triangleCount = piece.indices.size() / 3,
+            .primitiveData = piece.primitiveData(),
+            .primitiveDataStride = piece.primitiveDataStride(),
+        });
+    }
+
+    mesh.accelerationStructure = std::make_shared<PrimitiveAccelerationStructure>(pool, std::move(geometries), cacheDirectory);
+}
+
+void Accelerator::Primitive::encode(Pool& pool, std::vector<Mesh>& meshes) const
+{
+    pool.dispatch(meshes.size(), [&](const std::size_t i) { encode(pool, meshes[i]); });
+}
+}
+
+namespace Host {
+void Accelerator::Instanced::encode(Pool& pool, const std::vector<Mesh>& meshes)
+{
+    if (target && isSameLayout(meshes)) {
+        transforms_.clear();
+        for (const auto& mesh : meshes) {
+            for (const auto& instance : mesh.instances) {
+                transforms_.push_back(instance.transform.resolve());
+            }
+        }
+
+        hasRefitted = !target->move(pool, transforms_);
+        return;
+    }
+
+    hasRefitted = false;
+
+    std::vector<InstanceAccelerationStructure::Instance> instances;
+
+    // The pieces of all the meshes are laid out one mesh after another, where each instance points at the first of its mesh.
+    auto pieceBase = uint(0);
+
+    for (const auto& mesh : meshes) {
+        for (const auto& instance : mesh.instances) {
+            const auto transform = instance.transform.resolve();
+
+            instances.push_back({
+                .structure = mesh.accelerationStructure.get(),
+                .transform = transform,
+                .inverse = transform.inverse(),
+                .mask = 0xff,
+                .userID = pieceBase,
+            });
+        }
+
+        pieceBase += uint(mesh.pieces.size());
+    }
+
+    target = std::make_shared<InstanceAccelerationStructure>(pool, std::move(instances));
+}
+
+bool Accelerator::Instanced::isSameLayout(const std::vector<Mesh>& meshes) const
+{
+    const auto& instances = target->instances();
+
+    std::size_t i = 0;
+    auto pieceBase = uint(0);
+
+    for (const auto& mesh : meshes) {
+        for (std::size_t j = 0; j < mesh.instances.size(); j++, i++) {
+            if (i >= instances.size() || instances[i].structure != mesh.accelerationStructure.get() || instances[i].userID != pieceBase) {
+                return false;
+            }
+        }
+
+        pieceBase += uint(mesh.pieces.size());
+    }
+
+    return i == instances.size();
+}
+}
+
+namespace Host {
+Accelerator::Stats Accelerator::stats(const std::vector<Mesh>& meshes) const
+{
+    auto stats = Stats();
+
+    // The primitive structures are built in parallel, so their seconds overlap and are not summed up.
+    for (const auto& mesh : meshes) {
+        const auto& each = mesh.accelerationStructure->stats();
+
+        stats.primitive.boxCount += each.boxCount;
+        stats.primitive.nodeCount += each.nodeCount;
+        stats.primitive.leafCount += each.leafCount;
+        stats.primitive.depth = std::max(stats.primitive.depth, each.depth);
+        stats.primitive.bytes += each.bytes;
+        stats.primitive.bytesPerNode = each.bytesPerNode;
+        stats.primitive.seconds = std::max(stats.primitive.seconds, each.seconds);
+    }
+
+    if (instanced.target) {
+        stats.instanced = instanced.target->stats();
+    }
+
+    return stats;
+}
+}
@@ -0,0 +1,62 @@
+// tomocy
+
+#pragma once
+
+#include "Host+AccelerationStructure.h"
+#include "Host+Mesh.h"
+#include "Host+Pool.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Host {
+struct Accelerator {
+public:
+    struct Primitive {
+    public:
+        void encode(Pool& pool, Mesh& mesh) const;
+
+        // Builds the meshes in parallel, each of which is also built in parallel if it is large enough.
+        void encode(Pool& pool, std::vector<Mesh>& meshes) const;
+
+    public:
+        // Where the BVHs of the meshes are saved so that the next launches need not build them again, if not empty.
+        std::string cacheDirectory;
+    };
+
+    struct Instanced {
+    public:
+        // Moves the instances of the target in place if only their transforms have changed since the last encode,
+        // see InstanceAccelerationStructure::move, and builds a new target otherwise.
+        void encode(Pool& pool, const std::vector<Mesh>& meshes);
+
+    public:
+        std::shared_ptr<InstanceAccelerationStructure> target;
+
+        // Whether the last encode has moved the instances of the target without building it again.
+        bool hasRefitted = false;
+
+    private:
+        bool isSameLayout(const std::vector<Mesh>& meshes) const;
+
+    private:
+        // The transforms of the instances, kept so that moving them allocates nothing.
+        std::vector<Transform::Matrix> transforms_;
+    };
+
+public:
+    // Stats sums up the stats of all the structures that the accelerator has built.
+    struct Stats {
+    public:
+        BVH::Stats primitive;
+        BVH::Stats instanced;
+    };
+
+public:
+    Stats stats(const std::vector<Mesh>& meshes) const;
+
+public:
+    Primitive primitive;
+    Instanced instanced;
+};
+}
@@ -0,0 +1,329 @@
+// tomocy
+
+#include "Host+BVH.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+
+namespace Host {
+namespace {
+constexpr std::size_t binCount = 16;
+
+// Ranges above this are always split, whatever the SAH says.
+constexpr std::size_t maxLeafSize = 8;
+
+// The costs of a step down the tree and of a box test, relative to each other.
+constexpr float traversalCost = 1;
+constexpr float intersectionCost = 1;
+
+// Subtrees over this many boxes are built in parallel with their siblings.
+constexpr std::size_t parallelSubtreeSize = 4096;
+
+// Ranges over this many boxes are binned in parallel by chunks.
+constexpr std::size_t parallelBinSize = 1 << 16;
+constexpr std::size_t chunkSize = 1 << 14;
+
+struct Bins {
+public:
+    struct Bin {
+    public:
+        BVH::Box box;
+        std::size_t count = 0;
+    };
+
+public:
+    void merge(const Bins& other)
+    {
+        bounds.grow(other.bounds);
+        centroidBounds.grow(other.centroidBounds);
+
+        for (std::size_t axis = 0; axis < 3; axis++) {
+            for (std::size_t i = 0; i < binCount; i++) {
+                bins[axis][i].box.grow(other.bins[axis][i].box);
+                bins[axis][i].count += other.bins[axis][i].count;
+            }
+        }
+    }
+
+public:
+    BVH::Box bounds;
+    BVH::Box centroidBounds;
+    std::array<std::array<Bin, binCount>, 3> bins;
+};
+
+class Builder {
+public:
+    Builder(Pool& pool, const std::vector<BVH::Box>& boxes, BVH& bvh)
+        : pool_(pool)
+        , boxes_(boxes)
+        , centroids_(boxes.size())
+        , bvh_(bvh)
+    {
+    }
+
+public:
+    void build()
+    {
+        const auto count = boxes_.size();
+
+        bvh_.indices.resize(count);
+        std::iota(bvh_.indices.begin(), bvh_.indices.end(), 0);
+
+        if (count == 0) {
+            return;
+        }
+
+        // A binary tree with a box or more in each leaf never has more nodes than this.
+        bvh_.nodes.resize(2 * count - 1);
+
+        pool_.dispatch((count + chunkSize - 1) / chunkSize, [&](const std::size_t chunkI) {
+            const auto end = std::min(count, (chunkI + 1) * chunkSize);
+            for (auto i = chunkI * chunkSize; i < end; i++) {
+                centroids_[i] = boxes_[i].centroid();
+            }
+        });
+
+        // The bounds of the centroids are only known for the root, so compute them first.
+        auto root = boundsOf(0, uint32_t(count));
+        buildNode(0, 0, uint32_t(count), 0, root.bounds, root.centroidBounds);
+
+        bvh_.nodes.resize(nodeCount_.load());
+
+        bvh_.stats.boxCount = count;
+        bvh_.stats.nodeCount = bvh_.nodes.size();
+        bvh_.stats.leafCount = leafCount_.load();
+        bvh_.stats.depth = depth_.load();
+        bvh_.stats.bytes = bvh_.nodes.size() * sizeof(BVH::Node) + bvh_.indices.size() * sizeof(uint32_t);
+    }
+
+private:
+    void buildNode(
+        const uint32_t nodeI,
+        const uint32_t first,
+        const uint32_t count,
+        const std::size_t depth,
+        const BVH::Box& bounds,
+        const BVH::Box& centroidBounds
+    )
+    {
+        auto& node = bvh_.nodes[nodeI];
+        node.min = bounds.min;
+        node.max = bounds.max;
+
+        noteDepth(depth + 1);
+
+        // Keep the traversal stack within BVH::maxDepth.
+        if (count == 1 || depth + 2 >= BVH::maxDepth) {
+            makeLeaf(node, first, count);
+            return;
+        }
+
+        const auto extent = centroidBounds.max - centroidBounds.min;
+
+        auto axis = std::size_t(0);
+        auto split = std::size_t(0);
+        auto cost = INFINITY;
+        auto bins = Bins();
+
+        if (metal::any(extent > 0)) {
+            bins = binsOf(first, count, centroidBounds);
+            findSplit(bins, extent, axis, split, cost);
+        }
+
+        const auto leafCost = float(count) * intersectionCost;
+        const auto splitCost = traversalCost + cost / bounds.area();
+        if (count <= maxLeafSize && (cost == INFINITY || splitCost >= leafCost)) {
+            makeLeaf(node, first, count);
+            return;
+        }
+
+        auto* const begin = bvh_.indices.data() + first;
+        auto* const end = begin + count;
+
+        auto leftCount = uint32_t(0);
+        if (cost != INFINITY) {
+            const auto middle = std::partition(begin, end, [&](const uint32_t i) {
+                return binOf(centroids_[i], centroidBounds, axis) < split;
+            });
+
+            leftCount = uint32_t(middle - begin);
+        }
+
+        // The centroids cannot be told apart, so split in the middle.
+        if (leftCount == 0 || leftCount == count) {
+            leftCount = count / 2;
+        }
+
+        const auto childI = nodeCount_.fetch_add(2);
+        node.first = childI;
+        node.count = 0;
+
+        const uint32_t firsts[] = { first, first + leftCount };
+        const uint32_t counts[] = { leftCount, count - leftCount };
+
+        const auto buildChild = [&](const std::size_t i) {
+            const auto child = boundsOf(firsts[i], counts[i]);
+            buildNode(childI + uint32_t(i), firsts[i], counts[i], depth + 1, child.bounds, child.centroidBounds);
+        };
+
+        if (count >= parallelSubtreeSize) {
+            pool_.dispatch(2, buildChild);
+        } else {
+            buildChild(0);
+            buildChild(1);
+        }
+    }
+
+    void makeLeaf(BVH::Node& node, const uint32_t first, const uint32_t count)
+    {
+        node.first = first;
+        node.count = count;
+
+        leafCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void noteDepth(const std::size_t depth)
+    {
+        auto current = depth_.load(std::memory_order_relaxed);
+        while (current < depth && !depth_.compare_exchange_weak(current, depth, std::memory_order_relaxed)) { }
+    }
+
+private:
+    Bins boundsOf(const uint32_t first, const uint32_t count) const
+    {
+        auto bins = Bins();
+
+        for (auto i = first; i < first + count; i++) {
+            const auto index = bvh_.indices[i];
+
+            bins.bounds.grow(boxes_[index]);
+            bins.centroidBounds.grow(centroids_[index]);
+        }
+
+        return bins;
+    }
+
+    Bins binsOf(const uint32_t first, const uint32_t count, const BVH::Box& centroidBounds) const
+    {
+        const auto binRange = [&](const uint32_t from, const uint32_t to) {
+            auto bins = Bins();
+
+            for (auto i = from; i < to; i++) {
+                const auto index = bvh_.indices[i];
+
+                for (std::size_t axis = 0; axis < 3; axis++) {
+                    auto& bin = bins.bins[axis][binOf(centroids_[index], centroidBounds, axis)];
+                    bin.box.grow(boxes_[index]);
+                    bin.count++;
+                }
+            }
+
+            return bins;
+        };
+
+        if (count < parallelBinSize) {
+            return binRange(first, first + count);
+        }
+
+        const auto chunkCount = (count + chunkSize - 1) / chunkSize;
+        auto chunks = std::vector<Bins>(chunkCount);
+
+        pool_.dispatch(chunkCount, [&](const std::size_t chunkI) {
+            const auto from = first + uint32_t(chunkI * chunkSize);
+            const auto to = std::min(first + count, from + uint32_t(chunkSize));
+
+            chunks[chunkI] = binRange(from, to);
+        });
+
+        auto bins = Bins();
+        for (const auto& chunk : chunks) {
+            bins.merge(chunk);
+        }
+
+        return bins;
+    }
+
+    static std::size_t binOf(const float3 centroid, const BVH::Box& centroidBounds, const std::size_t axis)
+    {
+        const auto extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if (extent <= 0) {
+            return 0;
+        }
+
+        const auto i = std::size_t(float(binCount) * (centroid[axis] - centroidBounds.min[axis]) / extent);
+        return std::min(i, binCount - 1);
+    }
+
+    // Finds the plane with the least SAH cost, splitting the bins of axis into [0, split) and [split, binCount).
+    static void findSplit(
+        const Bins& bins,
+        const float3 extent,
+        std::size_t& axis,
+        std::size_t& split,
+        float& cost
+    )
+    {
+        for (std::size_t a = 0; a < 3; a++) {
+            if (extent[a] <= 0) {
+                continue;
+            }
+
+            const auto& axisBins = bins.bins[a];
+
+            // The cost of the left side of each plane, swept from the left.
+            std::array<float, binCount> leftCosts;
+            {
+                auto box = BVH::Box();
+                auto count = std::size_t(0);
+                for (std::size_t i = 0; i < binCount - 1; i++) {
+                    box.grow(axisBins[i].box);
+                    count += axisBins[i].count;
+                    leftCosts[i + 1] = box.area() * float(count);
+                }
+            }
+
+            auto box = BVH::Box();
+            auto count = std::size_t(0);
+            for (std::size_t i = binCount - 1; i > 0; i--) {
+                box.grow(axisBins[i].box);
+                count += axisBins[i].count;
+
+                const auto c = leftCosts[i] + box.area() * float(count);
+                if (c < cost) {
+                    axis = a;
+                    split = i;
+                    cost = c;
+                }
+            }
+        }
+    }
+
+private:
+    Pool& pool_;
+    const std::vector<BVH::Box>& boxes_;
+    std::vector<float3> centroids_;
+
+    BVH& bvh_;
+
+    std::atomic<uint32_t> nodeCount_ = 1;
+    std::atomic<std::size_t> leafCount_ = 0;
+    std::atomic<std::size_t> depth_ = 0;
+};
+}
+}
+
+namespace Host {
+BVH BVH::build(Pool& pool, const std::vector<Box>& boxes)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    auto bvh = BVH();
+    Builder(pool, boxes, bvh).build();
+
+    bvh.stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return bvh;
+}
+}
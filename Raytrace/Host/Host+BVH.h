@@ -0,0 +1,104 @@
+// tomocy
+
+#pragma once
+
+#include "Host+Pool.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <metal_stdlib>
+#include <vector>
+
+namespace Host {
+// BVH is a bounding volume hierarchy over boxes, built with binned SAH.
+// It only knows the boxes, so that both the primitive and instance acceleration structures can share it.
+// The acceleration structures trace it after collapsing it into a WideBVH.
+struct BVH {
+public:
+    struct Box {
+    public:
+        // Boxes grow a lot while building, so avoid the NaN handling of metal::min and metal::max.
+        void grow(const float3 point) { grow(point, point); }
+        void grow(const Box& other) { grow(other.min, other.max); }
+
+        void grow(const float3 otherMin, const float3 otherMax)
+        {
+            for (int i = 0; i < 3; i++) {
+                min[i] = otherMin[i] < min[i] ? otherMin[i] : min[i];
+                max[i] = otherMax[i] > max[i] ? otherMax[i] : max[i];
+            }
+        }
+
+    public:
+        bool isEmpty() const { return metal::any(max < min); }
+
+        float3 centroid() const { return (min + max) * 0.5f; }
+
+        float area() const
+        {
+            if (isEmpty()) {
+                return 0;
+            }
+
+            const auto extent = max - min;
+            return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+        }
+
+    public:
+        float3 min = INFINITY;
+        float3 max = -INFINITY;
+    };
+
+    // Node is either an inner node with its children at first and first + 1,
+    // or a leaf with the indices of its boxes at indices[first..<first + count].
+    struct Node {
+    public:
+        bool isLeaf() const { return count != 0; }
+
+    public:
+        packed_float3 min;
+        uint32_t first;
+        packed_float3 max;
+        uint32_t count;
+    };
+
+    struct Stats {
+    public:
+        std::size_t boxCount = 0;
+        std::size_t nodeCount = 0;
+        std::size_t leafCount = 0;
+        std::size_t depth = 0;
+
+        // The bytes of both the nodes and the indices.
+        std::size_t bytes = 0;
+        std::size_t bytesPerNode = sizeof(Node);
+
+        double seconds = 0;
+    };
+
+public:
+    static constexpr std::size_t maxDepth = 64;
+
+public:
+    static BVH build(Pool& pool, const std::vector<Box>& boxes);
+
+public:
+    Box bounds() const
+    {
+        if (nodes.empty()) {
+            return {};
+        }
+
+        return {
+            .min = float3(nodes[0].min),
+            .max = float3(nodes[0].max),
+        };
+    }
+
+public:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> indices;
+
+    Stats stats;
+};
+}
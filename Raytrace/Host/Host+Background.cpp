@@ -0,0 +1,47 @@
+// tomocy
+
+#include "Host+Background.h"
+#include "../Shader/Coordinate.h"
+
+namespace Host {
+namespace {
+float3 skyColorFor(const float3 direction)
+{
+    const auto horizon = float3(0.85, 0.9, 1.0);
+    const auto zenith = float3(0.25, 0.45, 0.85);
+    const auto ground = float3(0.3, 0.27, 0.25);
+
+    if (direction.y < 0) {
+        return metal::mix(horizon, ground, metal::saturate(-direction.y * 4));
+    }
+
+    return metal::mix(horizon, zenith, metal::sqrt(direction.y));
+}
+}
+
+Background Background::make()
+{
+    // We know the background for now.
+    const uint size = 64;
+
+    auto source = Texture<float>::makeCube(size, true);
+
+    for (uint face = 0; face < 6; face++) {
+        for (uint y = 0; y < size; y++) {
+            for (uint x = 0; x < size; x++) {
+                const auto inFace = Shader::Coordinate::InFace(uint2(x, y));
+                const auto inUV = Shader::Coordinate::InUV::from(inFace, size);
+                const auto inNDC = Shader::Coordinate::InNDC::from(inUV, Shader::Coordinate::Face(face));
+
+                const auto color = skyColorFor(metal::normalize(inNDC.value()));
+
+                source.asCube<metal::access::write>().write(float4(color, 1), uint2(x, y), face);
+            }
+        }
+    }
+
+    source.generateMipmaps();
+
+    return { .source = source };
+}
+}
@@ -0,0 +1,25 @@
+// tomocy
+
+#pragma once
+
+#include "../App/Raytrace/Raytrace+Background.h"
+#include "Host+Texture.h"
+#include <metal_stdlib>
+
+namespace Host {
+struct Background {
+public:
+    static Background make();
+
+public:
+    Raytrace::Background forShader() const
+    {
+        return {
+            .source = source.asCube(),
+        };
+    }
+
+public:
+    Texture<float> source;
+};
+}
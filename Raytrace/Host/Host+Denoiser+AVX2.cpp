@@ -0,0 +1,14 @@
+// tomocy
+
+#include "Host+Denoiser+Filter.h"
+
+// This file is compiled with AVX2 enabled, and only runs when the CPU supports it.
+
+namespace Host {
+namespace Denoise {
+void filter8(const Planes& source, const Planes& guides, const Planes& destination, const uint32_t step, const uint32_t y)
+{
+    filter<8>(source, guides, destination, step, y);
+}
+}
+}
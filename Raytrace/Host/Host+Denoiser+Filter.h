@@ -0,0 +1,134 @@
+// tomocy
+
+#pragma once
+
+#include "Host+Denoiser.h"
+#include "Host+SIMD.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// This header is included by the translation units of each instruction set.
+// Everything in it has internal linkage, so that code compiled for AVX2 never leaks into the others.
+// It only reads constants from Raytrace::Denoise::Wavelet, as calling into it would compile it for AVX2 too.
+
+namespace Host {
+namespace Denoise {
+namespace {
+using SIMD::Lanes;
+
+// Raytrace::Denoise::Wavelet::kernelAt from -2 to 2.
+constexpr float kernelWeights[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+// Raytrace::Denoise::Wavelet::varianceKernelAt from -1 to 1 on each axis.
+constexpr float varianceKernelWeights[3] = { 0.25f, 0.5f, 0.25f };
+
+template <int N>
+void filter(const Planes& source, const Planes& guides, const Planes& destination, const uint32_t step, const uint32_t y)
+{
+    using L = Lanes<N>;
+    using Float = typename L::Float;
+
+    constexpr auto sigmaDepth = Raytrace::Denoise::Wavelet::sigmaDepth;
+    constexpr auto sigmaLuminance = Raytrace::Denoise::Wavelet::sigmaLuminance;
+
+    const auto luminanceOf = [](const Float r, const Float g, const Float b) {
+        return r * 0.2126f + g * 0.7152f + b * 0.0722f;
+    };
+
+    // Channels of the pixel x in the row y, where x may reach into the border.
+    const auto at = [](const Planes& planes, const std::size_t channel, const uint32_t y, const std::ptrdiff_t x) {
+        return planes.origin + channel * planes.channelStride + y * planes.rowStride + x;
+    };
+
+    for (std::ptrdiff_t x = 0; x < std::ptrdiff_t(source.width); x += N) {
+        Float center[4];
+        Float centerGuide[4];
+        for (std::size_t i = 0; i < 4; i++) {
+            center[i] = L::load(at(source, i, y, x));
+            centerGuide[i] = L::load(at(guides, i, y, x));
+        }
+
+        const auto luminance = luminanceOf(center[0], center[1], center[2]);
+
+        auto centerVariance = L::splat(0.0f);
+        for (int dy = -1; dy <= 1; dy++) {
+            const auto otherY = std::ptrdiff_t(y) + dy;
+            if (otherY < 0 || otherY >= std::ptrdiff_t(source.height)) {
+                continue;
+            }
+
+            for (int dx = -1; dx <= 1; dx++) {
+                const auto weight = varianceKernelWeights[dx + 1] * varianceKernelWeights[dy + 1];
+                centerVariance += L::load(at(source, 3, uint32_t(otherY), x + dx)) * weight;
+            }
+        }
+
+        // The deviation of the center stays the same for every tap, so take its scalar square roots once.
+        float luminanceScales[N];
+        for (int lane = 0; lane < N; lane++) {
+            luminanceScales[lane] = 1 / (sigmaLuminance * std::sqrt(centerVariance[lane]) + 1e-4f);
+        }
+        const auto luminanceScale = L::load(luminanceScales);
+
+        const auto depthScale = centerGuide[3] * sigmaDepth;
+
+        // The center always weighs in, even when it has no normal to compare with.
+        const auto centerWeight = kernelWeights[2] * kernelWeights[2];
+
+        auto weightSum = L::splat(centerWeight);
+        Float color[3] = { center[0] * centerWeight, center[1] * centerWeight, center[2] * centerWeight };
+        auto variance = center[3] * (centerWeight * centerWeight);
+
+        for (int dy = -2; dy <= 2; dy++) {
+            const auto otherY = std::ptrdiff_t(y) + dy * std::ptrdiff_t(step);
+            if (otherY < 0 || otherY >= std::ptrdiff_t(source.height)) {
+                continue;
+            }
+
+            for (int dx = -2; dx <= 2; dx++) {
+                if (dx == 0 && dy == 0) {
+                    continue;
+                }
+
+                const auto otherX = x + dx * std::ptrdiff_t(step);
+
+                Float other[4];
+                Float otherGuide[4];
+                for (std::size_t i = 0; i < 4; i++) {
+                    other[i] = L::load(at(source, i, uint32_t(otherY), otherX));
+                    otherGuide[i] = L::load(at(guides, i, uint32_t(otherY), otherX));
+                }
+
+                auto normalWeight = L::max(
+                    centerGuide[0] * otherGuide[0] + centerGuide[1] * otherGuide[1] + centerGuide[2] * otherGuide[2],
+                    L::splat(0.0f)
+                );
+                for (int i = 0; i < 7; i++) {
+                    normalWeight *= normalWeight;
+                }
+
+                const auto offsetLength = float(step) * std::sqrt(float(dx * dx + dy * dy));
+
+                const auto depthTerm = L::abs(centerGuide[3] - otherGuide[3]) / (depthScale * offsetLength + 1e-4f);
+                const auto luminanceTerm = L::abs(luminance - luminanceOf(other[0], other[1], other[2])) * luminanceScale;
+
+                const auto weight = kernelWeights[dx + 2] * kernelWeights[dy + 2] * normalWeight * L::exp(-(depthTerm + luminanceTerm));
+
+                weightSum += weight;
+                for (std::size_t i = 0; i < 3; i++) {
+                    color[i] += other[i] * weight;
+                }
+                variance += other[3] * weight * weight;
+            }
+        }
+
+        for (std::size_t i = 0; i < 3; i++) {
+            L::store(color[i] / weightSum, at(destination, i, y, x));
+        }
+        L::store(variance / (weightSum * weightSum), at(destination, 3, y, x));
+    }
+}
+}
+}
+}
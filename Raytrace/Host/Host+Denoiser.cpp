@@ -0,0 +1,146 @@
+// tomocy
+
+#include "Host+Denoiser.h"
+#include "../App/Raytrace/Raytrace+Denoise.metal"
+#include "Host+Denoiser+Filter.h"
+#include "Host+Packet.h"
+#include <chrono>
+#include <utility>
+
+namespace Host {
+namespace Denoise {
+void filter4(const Planes& source, const Planes& guides, const Planes& destination, const uint32_t step, const uint32_t y)
+{
+    filter<4>(source, guides, destination, step, y);
+}
+
+#if !defined(HOST_HAS_AVX2)
+// Denoiser never asks for 8 lanes without AVX2, though keep them working.
+void filter8(const Planes& source, const Planes& guides, const Planes& destination, const uint32_t step, const uint32_t y)
+{
+    filter<8>(source, guides, destination, step, y);
+}
+#endif
+}
+}
+
+namespace Host {
+namespace {
+// Rows are padded to a multiple of 8 pixels, so that both widths of the filter write whole vectors.
+constexpr std::size_t rowAlignment = 8;
+
+std::size_t rowStrideOf(const uint2 resolution)
+{
+    const auto width = (std::size_t(resolution.x) + rowAlignment - 1) / rowAlignment * rowAlignment;
+    return Denoise::Planes::border + width + Denoise::Planes::border;
+}
+}
+
+Denoiser::Denoiser(const uint2 resolution)
+    : resolution_(resolution)
+    , irradiance_(Texture<float>::make2D(resolution, false))
+{
+    // The borders stay 0, which has no normal for the guides and so no weight.
+    for (auto& planes : planes_) {
+        planes.assign(rowStrideOf(resolution) * resolution.y * 4, 0);
+    }
+}
+
+Denoiser::Stats Denoiser::encode(Pool& pool, Raytracer& raytracer, const Schedule& schedule)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto dispatchRows = [&](const auto& code) {
+        pool.dispatch(resolution_.y, [&](const std::size_t y) { code(uint32_t(y)); });
+    };
+
+    {
+        auto args = Raytrace::Denoise::Demodulate::Args {
+            .accumulation = raytracer.accumulation.as2D(),
+            .schedule = schedule.texture().as2D(),
+            .albedo = raytracer.albedo.as2D(),
+            .irradiance = irradiance_.as2D<metal::access::write>(),
+        };
+
+        dispatchRows([&](const uint32_t y) {
+            for (uint x = 0; x < resolution_.x; x++) {
+                Raytrace::Denoise::Demodulate::compute(uint2(x, y), args);
+            }
+        });
+    }
+
+    auto source = planesOf(planes_[0]);
+    auto destination = planesOf(planes_[1]);
+    const auto guides = planesOf(planes_[2]);
+
+    // Lay the texels out channel by channel.
+    dispatchRows([&](const uint32_t y) {
+        const auto& irradiance = irradiance_.texels().levels[0].texels;
+        const auto& normalDepth = raytracer.normalDepth.texels().levels[0].texels;
+
+        for (uint32_t x = 0; x < resolution_.x; x++) {
+            const auto i = std::size_t(y) * resolution_.x + x;
+
+            for (std::size_t channel = 0; channel < 4; channel++) {
+                source.origin[channel * source.channelStride + y * source.rowStride + x] = irradiance[i][channel];
+                guides.origin[channel * guides.channelStride + y * guides.rowStride + x] = normalDepth[i][channel];
+            }
+        }
+    });
+
+    const auto filter = PacketIntersector::width() == 8 ? Denoise::filter8 : Denoise::filter4;
+
+    for (uint32_t i = 0; i < Raytrace::Denoise::Wavelet::iterationCount; i++) {
+        const auto step = Raytrace::Denoise::Wavelet::stepAt(i);
+
+        dispatchRows([&](const uint32_t y) { filter(source, guides, destination, step, y); });
+
+        std::swap(source, destination);
+    }
+
+    dispatchRows([&](const uint32_t y) {
+        auto& irradiance = irradiance_.texels().levels[0].texels;
+
+        for (uint32_t x = 0; x < resolution_.x; x++) {
+            const auto i = std::size_t(y) * resolution_.x + x;
+
+            for (std::size_t channel = 0; channel < 4; channel++) {
+                irradiance[i][channel] = source.origin[channel * source.channelStride + y * source.rowStride + x];
+            }
+        }
+    });
+
+    {
+        auto args = Raytrace::Denoise::Modulate::Args {
+            .irradiance = irradiance_.as2D(),
+            .albedo = raytracer.albedo.as2D(),
+            .target = raytracer.target.texture.as2D<metal::access::write>(),
+        };
+
+        dispatchRows([&](const uint32_t y) {
+            for (uint x = 0; x < resolution_.x; x++) {
+                Raytrace::Denoise::Modulate::compute(uint2(x, y), args);
+            }
+        });
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+
+    return {
+        .seconds = std::chrono::duration<double>(end - start).count(),
+    };
+}
+
+Denoise::Planes Denoiser::planesOf(std::vector<float>& values)
+{
+    const auto rowStride = rowStrideOf(resolution_);
+
+    return {
+        .origin = values.data() + Denoise::Planes::border,
+        .rowStride = rowStride,
+        .channelStride = rowStride * resolution_.y,
+        .width = resolution_.x,
+        .height = resolution_.y,
+    };
+}
+}
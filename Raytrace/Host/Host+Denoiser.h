@@ -0,0 +1,73 @@
+// tomocy
+
+#pragma once
+
+#include "../App/Raytrace/Raytrace+Denoise.h"
+#include "Host+Pool.h"
+#include "Host+Raytracer.h"
+#include "Host+Schedule.h"
+#include "Host+Texture.h"
+#include <cstddef>
+#include <cstdint>
+#include <metal_stdlib>
+#include <vector>
+
+namespace Host {
+namespace Denoise {
+// Planes is a flat view of an image with its channels one after another, where each row has a border of empty pixels,
+// so that the filter loads neighboring pixels into SIMD lanes without checking the edges.
+// It only holds plain data so that the filter can be compiled for other instruction sets.
+struct Planes {
+public:
+    // The taps of the last iteration reach 2 steps to each side.
+    static constexpr std::size_t border = std::size_t(2) << (Raytrace::Denoise::Wavelet::iterationCount - 1);
+
+public:
+    // The pixel (0, 0) of the first channel.
+    float* origin;
+
+    // The floats from a row to the next one, and from a channel to the next one.
+    std::size_t rowStride;
+    std::size_t channelStride;
+
+    uint32_t width;
+    uint32_t height;
+};
+
+// Runs an iteration of Raytrace::Denoise::Filter::compute over a row of the irradiance (r, g, b, variance)
+// guided by (normal x, y, z, depth), 4 or 8 pixels at a time, including the pixels up to the next multiple of 8.
+void filter4(const Planes& source, const Planes& guides, const Planes& destination, uint32_t step, uint32_t y);
+void filter8(const Planes& source, const Planes& guides, const Planes& destination, uint32_t step, uint32_t y);
+}
+}
+
+namespace Host {
+// Denoiser runs Raytrace::Denoise over the accumulation of a raytracer into its target, like Raytrace.Denoise does on a GPU,
+// except that the iterations of the filter run on planes of the image in SIMD lanes.
+class Denoiser {
+public:
+    struct Stats {
+    public:
+        double seconds = 0;
+    };
+
+public:
+    explicit Denoiser(const uint2 resolution);
+
+public:
+    // Denoises the accumulation into the target of the raytracer, once the schedule has been encoded.
+    Stats encode(Pool& pool, Raytracer& raytracer, const Schedule& schedule);
+
+private:
+    Denoise::Planes planesOf(std::vector<float>& values);
+
+private:
+    uint2 resolution_;
+
+    // The irradiance with its variance before and after the filter.
+    Texture<float> irradiance_;
+
+    // The irradiance is filtered back and forth between the first two, while the last holds the guides.
+    std::vector<float> planes_[3];
+};
+}
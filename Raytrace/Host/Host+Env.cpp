@@ -0,0 +1,142 @@
+// tomocy
+
+#include "Host+Env.h"
+#include "../Prelight/Specular.h"
+#include "../Shader/Coordinate.h"
+#include "../Shader/Distribution.h"
+#include "../Shader/Geometry/Geometry+Normalized.h"
+#include "../Shader/Sample.h"
+#include "../Shader/SphericalHarmonics.h"
+
+namespace Host {
+namespace {
+Texture<float> irradianceOf(const Texture<float>& source, const uint size, const uint sampleCount)
+{
+    constexpr auto sampler = metal::sampler(
+        metal::filter::linear
+    );
+
+    auto target = Texture<float>::makeCube(size, false);
+
+    for (uint face = 0; face < 6; face++) {
+        for (uint y = 0; y < size; y++) {
+            for (uint x = 0; x < size; x++) {
+                const auto inFace = Shader::Coordinate::InFace(uint2(x, y));
+                const auto inUV = Shader::Coordinate::InUV::from(inFace, size);
+                const auto inNDC = Shader::Coordinate::InNDC::from(inUV, Shader::Coordinate::Face(face));
+
+                const auto normal = Shader::Geometry::normalize(inNDC.value());
+
+                float3 color = 0;
+                for (uint i = 0; i < sampleCount; i++) {
+                    const auto v = Shader::Distribution::Hammersley::distribute(sampleCount, i);
+                    const auto subject = Shader::Sample::CosineWeighted::sample(v, normal);
+
+                    color += source.asCube().sample(sampler, subject).rgb;
+                }
+
+                target.asCube<metal::access::write>().write(float4(color / float(sampleCount), 1), uint2(x, y), face);
+            }
+        }
+    }
+
+    return target;
+}
+
+// Projects the source into spherical harmonics once, instead of integrating the hemisphere of each texel,
+// and reconstructs the irradiance of each texel from them.
+Texture<float> irradianceInSphericalHarmonicsOf(const Texture<float>& source, const uint size)
+{
+    const auto sourceSize = source.asCube().get_width();
+
+    auto irradiance = Shader::SphericalHarmonics::Irradiance();
+
+    for (uint face = 0; face < 6; face++) {
+        for (uint y = 0; y < sourceSize; y++) {
+            for (uint x = 0; x < sourceSize; x++) {
+                const auto inUV = Shader::Coordinate::InUV((float2(uint2(x, y)) + 0.5f) / float(sourceSize));
+                const auto inNDC = Shader::Coordinate::InNDC::from(inUV, Shader::Coordinate::Face(face));
+
+                const auto color = source.asCube().read(uint2(x, y), face).rgb;
+
+                irradiance = irradiance.adding(
+                    color,
+                    metal::normalize(inNDC.value()),
+                    Shader::SphericalHarmonics::Irradiance::solidAngleOf(inNDC.value(), sourceSize)
+                );
+            }
+        }
+    }
+
+    auto target = Texture<float>::makeCube(size, false);
+
+    for (uint face = 0; face < 6; face++) {
+        for (uint y = 0; y < size; y++) {
+            for (uint x = 0; x < size; x++) {
+                const auto inFace = Shader::Coordinate::InFace(uint2(x, y));
+                const auto inUV = Shader::Coordinate::InUV::from(inFace, size);
+                const auto inNDC = Shader::Coordinate::InNDC::from(inUV, Shader::Coordinate::Face(face));
+
+                // irradianceOf averages the radiance over the cosine-weighted hemisphere, which is the irradiance over pi.
+                const auto color = irradiance.at(metal::normalize(inNDC.value())) / M_PI_F;
+
+                target.asCube<metal::access::write>().write(float4(color, 1), uint2(x, y), face);
+            }
+        }
+    }
+
+    return target;
+}
+
+// Prefilters the source into a level for each step of roughness as Prelight::Specular does.
+Texture<float> prefilteredOf(const Texture<float>& source, const uint sampleCount)
+{
+    const auto size = source.width();
+    const auto levelCount = Prelight::Specular::levelCountFor(size);
+
+    auto target = Texture<float>::makeCube(size, true, levelCount);
+
+    auto cube = Shader::Texture::Cube<float, metal::access::sample>();
+    cube.raw() = source.asCube();
+
+    const auto integral = Prelight::Specular::Integral {
+        .sampleCount = sampleCount,
+        .source = cube,
+    };
+
+    for (uint level = 0; level < levelCount; level++) {
+        const auto levelSize = target.width(level);
+        const auto roughness = Prelight::Specular::roughnessAt(level, levelCount);
+
+        for (uint face = 0; face < 6; face++) {
+            for (uint y = 0; y < levelSize; y++) {
+                for (uint x = 0; x < levelSize; x++) {
+                    const auto inFace = Shader::Coordinate::InFace(uint2(x, y));
+                    const auto inUV = Shader::Coordinate::InUV::from(inFace, levelSize);
+                    const auto inNDC = Shader::Coordinate::InNDC::from(inUV, Shader::Coordinate::Face(face));
+
+                    // Integral scales the radiance by pi as Prelight does for the app, which the host does not.
+                    const auto color = integral.integrate(roughness, metal::normalize(inNDC.value())) / M_PI_F;
+
+                    target.asCube<metal::access::write>().write(float4(color, 1), uint2(x, y), face, level);
+                }
+            }
+        }
+    }
+
+    return target;
+}
+}
+
+Env Env::make(const Background& background, const LUT& lut, const Options& options)
+{
+    // We know the textures for now.
+    return {
+        .diffuse = options.projectsDiffuse
+            ? irradianceInSphericalHarmonicsOf(background.source, 8)
+            : irradianceOf(background.source, 8, 256),
+        .specular = prefilteredOf(background.source, 64),
+        .lut = lut.texture,
+    };
+}
+}
@@ -0,0 +1,39 @@
+// tomocy
+
+#pragma once
+
+#include "../App/Raytrace/Raytrace+Env.h"
+#include "Host+Background.h"
+#include "Host+LUT.h"
+#include "Host+Texture.h"
+#include <metal_stdlib>
+
+namespace Host {
+struct Env {
+public:
+    struct Options {
+    public:
+        // Whether the diffuse irradiance comes from the background projected into Shader::SphericalHarmonics,
+        // instead of an integral over the hemisphere of each texel.
+        bool projectsDiffuse = false;
+    };
+
+public:
+    static Env make(const Background& background, const LUT& lut, const Options& options);
+
+public:
+    Raytrace::Env forShader() const
+    {
+        return {
+            .diffuse = diffuse.asCube(),
+            .specular = specular.asCube(),
+            .lut = lut.as2D(),
+        };
+    }
+
+public:
+    Texture<float> diffuse;
+    Texture<float> specular;
+    Texture<float> lut;
+};
+}
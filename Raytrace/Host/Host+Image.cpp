@@ -0,0 +1,98 @@
+// tomocy
+
+#include "Host+Image.h"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+namespace Host {
+namespace Image {
+namespace {
+uint8_t toSRGB(const float linear)
+{
+    const auto c = metal::saturate(linear);
+    const auto encoded = c <= 0.0031308f
+        ? c * 12.92f
+        : 1.055f * metal::pow(c, 1 / 2.4f) - 0.055f;
+
+    return uint8_t(encoded * 255 + 0.5f);
+}
+
+float toLinear(const float encoded)
+{
+    return encoded <= 0.04045f
+        ? encoded / 12.92f
+        : metal::pow((encoded + 0.055f) / 1.055f, 2.4f);
+}
+}
+
+void save(const Texture<float>& texture, const std::string& path)
+{
+    const auto width = texture.width();
+    const auto height = texture.height() * texture.faceCount();
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(std::size_t(width) * height * 3);
+
+    for (const auto& texel : texture.texels().levels[0].texels) {
+        bytes.push_back(toSRGB(texel.r));
+        bytes.push_back(toSRGB(texel.g));
+        bytes.push_back(toSRGB(texel.b));
+    }
+
+    auto* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("failed to open: " + path);
+    }
+
+    std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+    const auto written = std::fwrite(bytes.data(), 1, bytes.size(), file);
+
+    std::fclose(file);
+
+    if (written != bytes.size()) {
+        throw std::runtime_error("failed to write: " + path);
+    }
+}
+
+Texture<float> load(const std::string& path)
+{
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("failed to open: " + path);
+    }
+
+    auto width = 0u;
+    auto height = 0u;
+    auto maxValue = 0u;
+    const auto isRead = std::fscanf(file, "P6 %u %u %u", &width, &height, &maxValue) == 3
+        && std::fgetc(file) != EOF
+        && width > 0 && height > 0 && maxValue > 0 && maxValue < 256;
+
+    auto bytes = std::vector<uint8_t>(std::size_t(width) * height * 3);
+    const auto isLoaded = isRead && std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+
+    std::fclose(file);
+
+    if (!isLoaded) {
+        throw std::runtime_error("failed to read a binary PPM: " + path);
+    }
+
+    // Every value is one of 256, which are decoded once, clamping those beyond the max.
+    float linears[256];
+    for (uint i = 0; i < 256; i++) {
+        linears[i] = toLinear(float(std::min(i, maxValue)) / float(maxValue));
+    }
+
+    auto texture = Texture<float>::make2D(uint2(width, height), false);
+
+    auto& texels = texture.texels().levels[0].texels;
+    for (std::size_t i = 0; i < texels.size(); i++) {
+        texels[i] = float4(linears[bytes[i * 3 + 0]], linears[bytes[i * 3 + 1]], linears[bytes[i * 3 + 2]], 1);
+    }
+
+    return texture;
+}
+}
+}
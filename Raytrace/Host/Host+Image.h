@@ -0,0 +1,17 @@
+// tomocy
+
+#pragma once
+
+#include "Host+Texture.h"
+#include <metal_stdlib>
+#include <string>
+
+namespace Host {
+namespace Image {
+// Saves the base level of a texture as a binary PPM, encoding linear colors in sRGB.
+void save(const Texture<float>& texture, const std::string& path);
+
+// Loads a binary PPM as a 2D texture, decoding its sRGB colors to linear ones.
+Texture<float> load(const std::string& path);
+}
+}
@@ -0,0 +1,14 @@
+// tomocy
+
+#include "Host+LUT+Integral.h"
+
+// This file is compiled with AVX2 enabled, and only runs when the CPU supports it.
+
+namespace Host {
+namespace SplitSum {
+void integrate8(const Row& row)
+{
+    integrate<8>(row);
+}
+}
+}
@@ -0,0 +1,68 @@
+// tomocy
+
+#pragma once
+
+#include "Host+LUT.h"
+#include "Host+SIMD.h"
+#include <cstdint>
+
+// This header is included by the translation units of each instruction set.
+// Everything in it has internal linkage, so that code compiled for AVX2 never leaks into the others.
+// It follows Prelight::Env::Integral with the G term of Shader::PBR::CookTorrance::G::Usage::holomorphic,
+// as calling into them would compile them for AVX2 too.
+
+namespace Host {
+namespace SplitSum {
+namespace {
+using SIMD::Lanes;
+
+template <int N>
+void integrate(const Row& row)
+{
+    using L = Lanes<N>;
+    using Float = typename L::Float;
+
+    // Shader::PBR::CookTorrance::G::schlick.
+    const auto k = row.roughness * row.roughness / 2;
+    const auto schlick = [k](const Float dot) {
+        return dot / (dot * (1 - k) + k);
+    };
+
+    for (uint32_t x = 0; x < row.width; x += N) {
+        const auto viewX = L::load(row.viewXs + x);
+        const auto dotNV = L::load(row.viewZs + x);
+
+        const auto occlusionOfView = schlick(dotNV);
+
+        auto scale = L::splat(0.0f);
+        auto bias = L::splat(0.0f);
+
+        for (uint32_t i = 0; i < row.sampleCount; i++) {
+            const auto halfwayX = row.halfwayXs[i];
+            const auto halfwayZ = row.halfwayZs[i];
+
+            const auto dotVS = viewX * halfwayX + dotNV * halfwayZ;
+            const auto dotNL = 2 * dotVS * halfwayZ - dotNV;
+
+            const auto saturatedVS = L::min(L::max(dotVS, L::splat(0.0f)), L::splat(1.0f));
+            const auto saturatedNL = L::min(L::max(dotNL, L::splat(0.0f)), L::splat(1.0f));
+
+            const auto occlusion = schlick(saturatedNL) * occlusionOfView;
+            const auto visibility = occlusion * saturatedVS / (halfwayZ * dotNV);
+
+            const auto t = 1 - saturatedVS;
+            const auto fresnel = t * t * t * t * t;
+
+            // The light under the surface adds nothing.
+            const auto mask = dotNL > 0;
+            scale += mask ? (1 - fresnel) * visibility : L::splat(0.0f);
+            bias += mask ? fresnel * visibility : L::splat(0.0f);
+        }
+
+        L::store(scale / float(row.sampleCount), row.scales + x);
+        L::store(bias / float(row.sampleCount), row.biases + x);
+    }
+}
+}
+}
+}
@@ -0,0 +1,263 @@
+// tomocy
+
+#include "Host+LUT.h"
+#include "../Shader/Distribution.h"
+#include "../Shader/Geometry/Geometry+Normalized.h"
+#include "../Shader/PBR/PBR+CookTorrance.h"
+#include "../Shader/Sample.h"
+#include "Host+LUT+Integral.h"
+#include "Host+Packet.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace Host {
+namespace SplitSum {
+void integrate4(const Row& row)
+{
+    integrate<4>(row);
+}
+
+#if !defined(HOST_HAS_AVX2)
+// LUT never asks for 8 lanes without AVX2, though keep them working.
+void integrate8(const Row& row)
+{
+    integrate<8>(row);
+}
+#endif
+}
+}
+
+namespace Host {
+namespace {
+// The G term that the table is integrated with, which is all but the options that it depends on.
+constexpr auto usage = Shader::PBR::CookTorrance::G::Usage::holomorphic;
+
+constexpr uint32_t fileVersion = 1;
+
+struct FileHeader {
+public:
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+
+    uint32_t size;
+    uint32_t sampleCount;
+    uint32_t usage;
+    uint32_t format;
+};
+
+constexpr char fileMagic[4] = { 'S', 'S', 'U', 'M' };
+
+// Rows are padded to a multiple of 8 texels, so that both widths of the integral write whole vectors.
+constexpr std::size_t rowAlignment = 8;
+
+// FNV-1a over what the table depends on, which names its file in the cache.
+uint64_t keyOf(const LUT::Options& options)
+{
+    const uint32_t values[] = { fileVersion, options.size, options.sampleCount, uint32_t(usage), uint32_t(options.format) };
+
+    auto key = uint64_t(14695981039346656037ull);
+
+    const auto* bytes = reinterpret_cast<const uint8_t*>(values);
+    for (std::size_t i = 0; i < sizeof(values); i++) {
+        key = (key ^ bytes[i]) * 1099511628211ull;
+    }
+
+    return key;
+}
+
+// The scale and the bias of each texel, one after another, rounded to the format.
+std::vector<float> generate(Pool& pool, const LUT::Options& options)
+{
+    const auto size = options.size;
+    const auto paddedSize = (std::size_t(size) + rowAlignment - 1) / rowAlignment * rowAlignment;
+
+    // Every row sees the same views, from the center of each texel.
+    auto viewXs = std::vector<float>(paddedSize, 0);
+    auto viewZs = std::vector<float>(paddedSize, 1);
+    for (uint32_t x = 0; x < size; x++) {
+        const auto dotNV = (float(x) + 0.5f) / float(size);
+
+        viewXs[x] = std::sqrt(1 - dotNV * dotNV);
+        viewZs[x] = dotNV;
+    }
+
+    const auto integrate = PacketIntersector::width() == 8 ? SplitSum::integrate8 : SplitSum::integrate4;
+
+    auto values = std::vector<float>(std::size_t(size) * size * 2);
+
+    pool.dispatch(size, [&](const std::size_t y) {
+        const auto roughness = (float(y) + 0.5f) / float(size);
+
+        auto halfwayXs = std::vector<float>(options.sampleCount);
+        auto halfwayZs = std::vector<float>(options.sampleCount);
+
+        const auto normal = Shader::Geometry::normalize(float3(0, 0, 1));
+        for (uint32_t i = 0; i < options.sampleCount; i++) {
+            const auto v = Shader::Distribution::Hammersley::distribute(options.sampleCount, i);
+            const auto halfway = Shader::Sample::GGX::sample(v, roughness, normal);
+
+            halfwayXs[i] = halfway.x;
+            halfwayZs[i] = metal::saturate(halfway.z);
+        }
+
+        auto scales = std::vector<float>(paddedSize);
+        auto biases = std::vector<float>(paddedSize);
+
+        integrate({
+            .roughness = roughness,
+            .halfwayXs = halfwayXs.data(),
+            .halfwayZs = halfwayZs.data(),
+            .sampleCount = options.sampleCount,
+            .viewXs = viewXs.data(),
+            .viewZs = viewZs.data(),
+            .width = size,
+            .scales = scales.data(),
+            .biases = biases.data(),
+        });
+
+        auto* row = values.data() + y * size * 2;
+        for (uint32_t x = 0; x < size; x++) {
+            row[x * 2 + 0] = scales[x];
+            row[x * 2 + 1] = biases[x];
+        }
+    });
+
+    if (options.format == LUT::Format::rg16Float) {
+        for (auto& value : values) {
+            value = float(_Float16(value));
+        }
+    }
+
+    return values;
+}
+
+// Loads what save wrote with the same key, or nothing if the file is missing, broken or for another key.
+std::optional<std::vector<float>> load(const std::string& path, const uint64_t key, const LUT::Options& options)
+{
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return std::nullopt;
+    }
+
+    auto header = FileHeader();
+    auto values = std::vector<float>(std::size_t(options.size) * options.size * 2);
+
+    auto isLoaded = std::fread(&header, sizeof(header), 1, file) == 1
+        && std::equal(std::begin(fileMagic), std::end(fileMagic), header.magic)
+        && header.version == fileVersion
+        && header.key == key
+        && header.size == options.size
+        && header.sampleCount == options.sampleCount
+        && header.usage == uint32_t(usage)
+        && header.format == uint32_t(options.format);
+
+    if (isLoaded) {
+        switch (options.format) {
+        case LUT::Format::rg16Float: {
+            auto halves = std::vector<_Float16>(values.size());
+            isLoaded = std::fread(halves.data(), sizeof(_Float16), halves.size(), file) == halves.size();
+            std::transform(halves.begin(), halves.end(), values.begin(), [](const _Float16 half) { return float(half); });
+            break;
+        }
+        case LUT::Format::rg32Float:
+            isLoaded = std::fread(values.data(), sizeof(float), values.size(), file) == values.size();
+            break;
+        }
+    }
+
+    std::fclose(file);
+
+    if (!isLoaded) {
+        return std::nullopt;
+    }
+
+    return values;
+}
+
+void save(const std::vector<float>& values, const std::string& path, const uint64_t key, const LUT::Options& options)
+{
+    auto header = FileHeader {
+        .magic = {},
+        .version = fileVersion,
+        .key = key,
+        .size = options.size,
+        .sampleCount = options.sampleCount,
+        .usage = uint32_t(usage),
+        .format = uint32_t(options.format),
+    };
+    std::copy(std::begin(fileMagic), std::end(fileMagic), header.magic);
+
+    auto* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("failed to open: " + path);
+    }
+
+    auto written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    switch (options.format) {
+    case LUT::Format::rg16Float: {
+        auto halves = std::vector<_Float16>(values.begin(), values.end());
+        written = written && std::fwrite(halves.data(), sizeof(_Float16), halves.size(), file) == halves.size();
+        break;
+    }
+    case LUT::Format::rg32Float:
+        written = written && std::fwrite(values.data(), sizeof(float), values.size(), file) == values.size();
+        break;
+    }
+
+    std::fclose(file);
+
+    if (!written) {
+        throw std::runtime_error("failed to write: " + path);
+    }
+}
+}
+
+LUT LUT::make(Pool& pool, const Options& options)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    auto lut = LUT();
+
+    auto values = std::vector<float>();
+
+    if (options.cacheDirectory.empty()) {
+        values = generate(pool, options);
+    } else {
+        const auto key = keyOf(options);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016" PRIx64 ".lut", key);
+        const auto path = options.cacheDirectory + "/" + name;
+
+        if (auto cached = load(path, key, options)) {
+            values = std::move(*cached);
+            lut.stats.isCached = true;
+        } else {
+            values = generate(pool, options);
+            save(values, path, key, options);
+        }
+    }
+
+    lut.texture = Texture<float>::make2D(uint2(options.size, options.size), false);
+
+    const auto target = lut.texture.as2D<metal::access::write>();
+    for (uint32_t y = 0; y < options.size; y++) {
+        for (uint32_t x = 0; x < options.size; x++) {
+            const auto* texel = values.data() + (std::size_t(y) * options.size + x) * 2;
+            target.write(float4(texel[0], texel[1], 0, 1), uint2(x, y));
+        }
+    }
+
+    lut.stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return lut;
+}
+}
@@ -0,0 +1,77 @@
+// tomocy
+
+#pragma once
+
+#include "Host+Pool.h"
+#include "Host+Texture.h"
+#include <cstdint>
+#include <metal_stdlib>
+#include <string>
+
+namespace Host {
+namespace SplitSum {
+// Row is what the integral of a row of the table needs, as plain data so that it can be compiled for other instruction sets.
+// The view of each texel and the halfway of each sample lie in the tangent space of the normal (0, 0, 1),
+// where the view has no y and so only x and z of the halfways matter.
+struct Row {
+public:
+    float roughness;
+
+    // The halfways of the samples for the roughness, which are the same for every texel of the row.
+    const float* halfwayXs;
+    const float* halfwayZs;
+    uint32_t sampleCount;
+
+    // The view of each texel, whose z is dotNV, padded to a multiple of 8.
+    const float* viewXs;
+    const float* viewZs;
+    uint32_t width;
+
+    // The scale and the bias of the albedo for each texel, padded as the views are.
+    float* scales;
+    float* biases;
+};
+
+// Runs Prelight::Env::Integral over the texels of the row, 4 or 8 of them at a time.
+void integrate4(const Row& row);
+void integrate8(const Row& row);
+}
+}
+
+namespace Host {
+// LUT tabulates the scale (r) and the bias (g) of the albedo in the split-sum approximation
+// by dotNV (x) and roughness (y), sampling the centers of the texels, as Prelight::Env does on a GPU.
+// The rows run on a pool with the samples of a row shared by the texels in SIMD lanes.
+struct LUT {
+public:
+    // The precision that the table keeps, both in the cache and in the texture.
+    enum class Format {
+        rg16Float,
+        rg32Float,
+    };
+
+    struct Options {
+    public:
+        uint32_t size = 128;
+        uint32_t sampleCount = 1024;
+        Format format = Format::rg16Float;
+
+        // Loads the table from cacheDirectory if it has been generated with the same options, and saves it there otherwise.
+        // An empty cacheDirectory always generates the table.
+        std::string cacheDirectory;
+    };
+
+    struct Stats {
+    public:
+        bool isCached = false;
+        double seconds = 0;
+    };
+
+public:
+    static LUT make(Pool& pool, const Options& options);
+
+public:
+    Texture<float> texture;
+    Stats stats;
+};
+}
@@ -0,0 +1,32 @@
+// tomocy
+
+#pragma once
+
+#include "../Shader/PBR/PBR+Material.h"
+#include "Host+Texture.h"
+#include <metal_stdlib>
+
+namespace Host {
+struct Material {
+public:
+    Shader::PBR::Material forShader() const
+    {
+        return {
+            .albedo = albedo.as2D(),
+            .metalRoughness = metalRoughness.as2D(),
+        };
+    }
+
+    Material tiled() const
+    {
+        return {
+            .albedo = albedo.tiled(),
+            .metalRoughness = metalRoughness.tiled(),
+        };
+    }
+
+public:
+    Texture<float> albedo;
+    Texture<float> metalRoughness;
+};
+}
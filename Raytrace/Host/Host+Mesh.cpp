@@ -0,0 +1,214 @@
+// tomocy
+
+#include "Host+Mesh.h"
+#include <bit>
+#include <cmath>
+
+namespace Host {
+namespace {
+Mesh meshOf(
+    const std::vector<Vertex>& vertices,
+    const std::vector<uint32_t>& indices,
+    const std::vector<Mesh::Instance>& instances
+)
+{
+    Mesh mesh = {};
+
+    mesh.positions.reserve(vertices.size());
+    for (const auto& vertex : vertices) {
+        mesh.positions.push_back(vertex.position);
+    }
+
+    auto piece = Mesh::Piece();
+    piece.indices = indices;
+    piece.data = toTriangles(vertices, indices);
+    piece.textureScale = textureScaleOf(mesh.positions, piece.indices, piece.data);
+
+    mesh.pieces.push_back(std::move(piece));
+
+    mesh.instances = instances;
+
+    return mesh;
+}
+}
+
+const void* Mesh::Piece::primitiveData() const
+{
+    return layout == Raytrace::Primitive::Layout::compactTriangle
+        ? static_cast<const void*>(compactData.data())
+        : static_cast<const void*>(data.data());
+}
+
+std::size_t Mesh::Piece::primitiveDataStride() const
+{
+    return layout == Raytrace::Primitive::Layout::compactTriangle
+        ? sizeof(Raytrace::Primitive::CompactTriangle)
+        : sizeof(Raytrace::Primitive::Triangle);
+}
+
+void Mesh::compact()
+{
+    for (auto& piece : pieces) {
+        if (piece.layout == Raytrace::Primitive::Layout::compactTriangle) {
+            continue;
+        }
+
+        piece.compactData = toCompactTriangles(piece.data);
+        piece.data = {};
+        piece.layout = Raytrace::Primitive::Layout::compactTriangle;
+    }
+}
+
+Mesh Mesh::plane(const float2 extent, const std::vector<Instance>& instances)
+{
+    const auto half = extent * 0.5f;
+
+    const std::vector<Vertex> vertices = {
+        { packed_float3(-half.x, 0, -half.y), packed_float3(0, 1, 0), float2(0, 0) },
+        { packed_float3(half.x, 0, -half.y), packed_float3(0, 1, 0), float2(1, 0) },
+        { packed_float3(half.x, 0, half.y), packed_float3(0, 1, 0), float2(1, 1) },
+        { packed_float3(-half.x, 0, half.y), packed_float3(0, 1, 0), float2(0, 1) },
+    };
+
+    const std::vector<uint32_t> indices = {
+        0, 2, 1,
+        0, 3, 2,
+    };
+
+    return meshOf(vertices, indices, instances);
+}
+
+Mesh Mesh::sphere(const float radius, const uint2 segments, const std::vector<Instance>& instances)
+{
+    std::vector<Vertex> vertices;
+    vertices.reserve(std::size_t(segments.x + 1) * (segments.y + 1));
+
+    for (uint y = 0; y <= segments.y; y++) {
+        const auto v = float(y) / float(segments.y);
+        const auto theta = v * M_PI_F;
+
+        for (uint x = 0; x <= segments.x; x++) {
+            const auto u = float(x) / float(segments.x);
+            const auto phi = u * 2 * M_PI_F;
+
+            const auto normal = float3(
+                metal::sin(theta) * metal::cos(phi),
+                metal::cos(theta),
+                metal::sin(theta) * metal::sin(phi)
+            );
+
+            vertices.push_back({
+                .position = normal * radius,
+                .normal = normal,
+                .textureCoordinate = float2(u, v),
+            });
+        }
+    }
+
+    std::vector<uint32_t> indices;
+    indices.reserve(std::size_t(segments.x) * segments.y * 6);
+
+    for (uint y = 0; y < segments.y; y++) {
+        for (uint x = 0; x < segments.x; x++) {
+            const auto i = y * (segments.x + 1) + x;
+            const auto below = i + segments.x + 1;
+
+            // The rows at the poles collapse to a point, so one triangle of each quad there has no area.
+            // Leave them out, as rays would otherwise hit them where they are not.
+            if (y != 0) {
+                indices.insert(indices.end(), { i, i + 1, below });
+            }
+            if (y != segments.y - 1) {
+                indices.insert(indices.end(), { i + 1, below + 1, below });
+            }
+        }
+    }
+
+    return meshOf(vertices, indices, instances);
+}
+}
+
+namespace Host {
+std::vector<Raytrace::Primitive::Triangle> toTriangles(
+    const std::vector<Vertex>& vertices,
+    const std::vector<uint32_t>& indices
+)
+{
+    std::vector<Raytrace::Primitive::Triangle> triangles(indices.size() / 3);
+
+    for (std::size_t i = 0; i < triangles.size(); i++) {
+        auto& triangle = triangles[i];
+
+        for (std::size_t v = 0; v < 3; v++) {
+            const auto& vertex = vertices[indices[i * 3 + v]];
+
+            triangle.normals[v] = vertex.normal;
+            triangle.textureCoordinates[v] = vertex.textureCoordinate;
+        }
+    }
+
+    return triangles;
+}
+
+float textureScaleOf(
+    const std::vector<packed_float3>& positions,
+    const std::vector<uint32_t>& indices,
+    const std::vector<Raytrace::Primitive::Triangle>& triangles
+)
+{
+    auto area = 0.0;
+    auto textureArea = 0.0;
+
+    for (std::size_t i = 0; i < triangles.size(); i++) {
+        const auto a = float3(positions[indices[i * 3 + 0]]);
+        const auto b = float3(positions[indices[i * 3 + 1]]);
+        const auto c = float3(positions[indices[i * 3 + 2]]);
+
+        const auto& coordinates = triangles[i].textureCoordinates;
+        const auto u = coordinates[1] - coordinates[0];
+        const auto v = coordinates[2] - coordinates[0];
+
+        area += metal::length(metal::cross(b - a, c - a));
+        textureArea += std::abs(u.x * v.y - u.y * v.x);
+    }
+
+    return area > 0 ? float(std::sqrt(textureArea / area)) : 0;
+}
+
+std::vector<Raytrace::Primitive::CompactTriangle> toCompactTriangles(
+    const std::vector<Raytrace::Primitive::Triangle>& triangles
+)
+{
+    std::vector<Raytrace::Primitive::CompactTriangle> compacts(triangles.size());
+
+    for (std::size_t i = 0; i < triangles.size(); i++) {
+        for (std::size_t v = 0; v < 3; v++) {
+            const auto normal = Shader::Geometry::normalize(float3(triangles[i].normals[v]));
+            const auto& textureCoordinate = triangles[i].textureCoordinates[v];
+
+            compacts[i].normals[v] = Shader::Geometry::Octahedral::encode(normal);
+            compacts[i].textureCoordinates[v] = uint(std::bit_cast<uint16_t>(_Float16(textureCoordinate.x)))
+                | (uint(std::bit_cast<uint16_t>(_Float16(textureCoordinate.y))) << 16);
+        }
+    }
+
+    return compacts;
+}
+
+std::vector<Raytrace::Mesh::Piece> piecesOf(const std::vector<Mesh>& meshes)
+{
+    std::vector<Raytrace::Mesh::Piece> pieces;
+
+    for (const auto& mesh : meshes) {
+        for (const auto& piece : mesh.pieces) {
+            pieces.push_back({
+                .material = piece.material.forShader(),
+                .layout = piece.layout,
+                .textureScale = piece.textureScale,
+            });
+        }
+    }
+
+    return pieces;
+}
+}
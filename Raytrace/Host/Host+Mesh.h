@@ -0,0 +1,88 @@
+// tomocy
+
+#pragma once
+
+#include "../App/Raytrace/Raytrace+Mesh.h"
+#include "../App/Raytrace/Raytrace+Primitive.h"
+#include "Host+Material.h"
+#include "Host+Transform.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <metal_stdlib>
+#include <vector>
+
+namespace Host {
+class PrimitiveAccelerationStructure;
+}
+
+namespace Host {
+struct Mesh {
+public:
+    struct Piece {
+    public:
+        std::vector<uint32_t> indices;
+        // Either of these holds the data of the triangles, as the layout tells.
+        std::vector<Raytrace::Primitive::Triangle> data;
+        std::vector<Raytrace::Primitive::CompactTriangle> compactData;
+        Raytrace::Primitive::Layout layout = Raytrace::Primitive::Layout::triangle;
+        Material material;
+
+        // See Raytrace::Mesh::Piece::textureScale.
+        float textureScale = 0;
+
+    public:
+        const void* primitiveData() const;
+        std::size_t primitiveDataStride() const;
+    };
+
+    struct Instance {
+    public:
+        Transform transform;
+    };
+
+public:
+    static Mesh plane(const float2 extent, const std::vector<Instance>& instances);
+    static Mesh sphere(const float radius, const uint2 segments, const std::vector<Instance>& instances);
+
+public:
+    // Encodes the data of the triangles of every piece as CompactTriangles, which must be done before it is accelerated.
+    void compact();
+
+public:
+    std::shared_ptr<PrimitiveAccelerationStructure> accelerationStructure;
+    std::vector<Piece> pieces;
+    std::vector<packed_float3> positions;
+
+    std::vector<Instance> instances;
+};
+}
+
+namespace Host {
+// Vertex is what an importer hands over before a mesh lays it out for the shaders.
+struct Vertex {
+public:
+    packed_float3 position;
+    packed_float3 normal;
+    float2 textureCoordinate;
+};
+
+// Builds the per-triangle data that Raytrace::Primitive::from reads on hits.
+std::vector<Raytrace::Primitive::Triangle> toTriangles(
+    const std::vector<Vertex>& vertices,
+    const std::vector<uint32_t>& indices
+);
+
+// The square root of the ratio of the area that the triangles take on the texture to the one that they take in space.
+float textureScaleOf(
+    const std::vector<packed_float3>& positions,
+    const std::vector<uint32_t>& indices,
+    const std::vector<Raytrace::Primitive::Triangle>& triangles
+);
+
+std::vector<Raytrace::Primitive::CompactTriangle> toCompactTriangles(
+    const std::vector<Raytrace::Primitive::Triangle>& triangles
+);
+
+std::vector<Raytrace::Mesh::Piece> piecesOf(const std::vector<Mesh>& meshes);
+}
@@ -0,0 +1,662 @@
+// tomocy
+
+#include "Host+OBJ.h"
+#include "Host+Image.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <fcntl.h>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Host {
+namespace {
+// Mapping maps a file to read for as long as it lives.
+class Mapping {
+public:
+    explicit Mapping(const std::string& path)
+    {
+        const auto file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("failed to open: " + path);
+        }
+
+        struct stat status = {};
+        const auto isStated = ::fstat(file, &status) == 0;
+
+        if (isStated && status.st_size > 0) {
+            size_ = std::size_t(status.st_size);
+
+            auto* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                ::madvise(data, size_, MADV_SEQUENTIAL);
+            }
+        }
+
+        ::close(file);
+
+        if (!isStated || (size_ > 0 && !data_)) {
+            throw std::runtime_error("failed to map: " + path);
+        }
+    }
+
+    ~Mapping()
+    {
+        if (data_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+public:
+    std::string_view view() const { return { data_, size_ }; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+}
+
+namespace {
+// Cursor walks a line token by token, skipping the spaces between them.
+struct Cursor {
+public:
+    bool isAtEnd()
+    {
+        skipSpaces();
+        return at == end;
+    }
+
+    void skipSpaces()
+    {
+        while (at < end && (*at == ' ' || *at == '\t' || *at == '\r')) {
+            at++;
+        }
+    }
+
+    std::string_view word()
+    {
+        skipSpaces();
+
+        const auto* start = at;
+        while (at < end && *at != ' ' && *at != '\t' && *at != '\r') {
+            at++;
+        }
+
+        return { start, std::size_t(at - start) };
+    }
+
+    // The rest of the line without the spaces around it, e.g. a name with spaces in it.
+    std::string_view rest()
+    {
+        skipSpaces();
+
+        auto* last = end;
+        while (last > at && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) {
+            last--;
+        }
+
+        return { at, std::size_t(last - at) };
+    }
+
+    // from_chars parses floats exactly and without a locale, which is what makes it fast.
+    template <typename T>
+    bool parse(T& value)
+    {
+        skipSpaces();
+
+        const auto [next, error] = std::from_chars(at, end, value);
+        if (error != std::errc()) {
+            return false;
+        }
+
+        at = next;
+        return true;
+    }
+
+    bool consume(const char c)
+    {
+        if (at < end && *at == c) {
+            at++;
+            return true;
+        }
+
+        return false;
+    }
+
+public:
+    const char* at;
+    const char* end;
+};
+
+// Calls code for each line of the text, with the cursor past the keyword of the line.
+template <typename Code>
+void forEachLine(const std::string_view text, Code code)
+{
+    std::size_t start = 0;
+    while (start < text.size()) {
+        auto end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+
+        auto cursor = Cursor { .at = text.data() + start, .end = text.data() + end };
+        const auto keyword = cursor.word();
+        if (!keyword.empty() && keyword[0] != '#') {
+            code(keyword, cursor);
+        }
+
+        start = end + 1;
+    }
+}
+}
+
+namespace {
+// An index of a corner that is missing, e.g. the texture coordinate of `f 1//1`.
+constexpr auto missing = std::numeric_limits<int64_t>::min();
+
+// Corner holds the indices of a corner as a chunk reads them.
+// A relative (negative) index is kept relative to the start of the chunk, as the chunks before are not counted yet.
+struct Corner {
+public:
+    int64_t position;
+    int64_t textureCoordinate;
+    int64_t normal;
+
+    // Which of the indices are relative, as bits in the order above.
+    uint8_t relatives;
+};
+
+struct Chunk {
+public:
+    struct Use {
+    public:
+        // The first triangle of the chunk that uses the material.
+        std::size_t triangleI;
+        std::string name;
+    };
+
+public:
+    std::string_view text;
+
+    std::vector<packed_float3> positions;
+    std::vector<float2> textureCoordinates;
+    std::vector<packed_float3> normals;
+
+    // 3 for each triangle, as faces are triangulated as fans.
+    std::vector<Corner> corners;
+    std::vector<Use> uses;
+    std::vector<std::string> libraries;
+
+    std::string error;
+};
+
+bool parseIndex(Cursor& cursor, const std::size_t count, int64_t& index, uint8_t& relatives, const uint8_t bit)
+{
+    auto raw = int64_t(0);
+    if (!cursor.parse(raw) || raw == 0) {
+        return false;
+    }
+
+    if (raw > 0) {
+        index = raw - 1;
+    } else {
+        index = int64_t(count) + raw;
+        relatives |= bit;
+    }
+
+    return true;
+}
+
+bool parseCorner(Cursor& cursor, const Chunk& chunk, Corner& corner)
+{
+    corner = {
+        .position = missing,
+        .textureCoordinate = missing,
+        .normal = missing,
+        .relatives = 0,
+    };
+
+    if (!parseIndex(cursor, chunk.positions.size(), corner.position, corner.relatives, 1 << 0)) {
+        return false;
+    }
+
+    if (!cursor.consume('/')) {
+        return true;
+    }
+
+    if (!cursor.consume('/')) {
+        if (!parseIndex(cursor, chunk.textureCoordinates.size(), corner.textureCoordinate, corner.relatives, 1 << 1)) {
+            return false;
+        }
+
+        if (!cursor.consume('/')) {
+            return true;
+        }
+    }
+
+    return parseIndex(cursor, chunk.normals.size(), corner.normal, corner.relatives, 1 << 2);
+}
+
+void parse(Chunk& chunk)
+{
+    auto face = std::vector<Corner>();
+
+    forEachLine(chunk.text, [&](const std::string_view keyword, Cursor& cursor) {
+        if (!chunk.error.empty()) {
+            return;
+        }
+
+        if (keyword == "v") {
+            auto x = 0.f, y = 0.f, z = 0.f;
+            if (!cursor.parse(x) || !cursor.parse(y) || !cursor.parse(z)) {
+                chunk.error = "broken position";
+                return;
+            }
+
+            chunk.positions.push_back(packed_float3(x, y, z));
+            return;
+        }
+
+        if (keyword == "vt") {
+            auto u = 0.f, v = 0.f;
+            if (!cursor.parse(u)) {
+                chunk.error = "broken texture coordinate";
+                return;
+            }
+            cursor.parse(v);
+
+            chunk.textureCoordinates.push_back(float2(u, v));
+            return;
+        }
+
+        if (keyword == "vn") {
+            auto x = 0.f, y = 0.f, z = 0.f;
+            if (!cursor.parse(x) || !cursor.parse(y) || !cursor.parse(z)) {
+                chunk.error = "broken normal";
+                return;
+            }
+
+            chunk.normals.push_back(packed_float3(x, y, z));
+            return;
+        }
+
+        if (keyword == "f") {
+            face.clear();
+
+            while (!cursor.isAtEnd()) {
+                auto corner = Corner();
+                if (!parseCorner(cursor, chunk, corner)) {
+                    chunk.error = "broken face";
+                    return;
+                }
+
+                face.push_back(corner);
+            }
+
+            if (face.size() < 3) {
+                chunk.error = "face with less than 3 corners";
+                return;
+            }
+
+            for (std::size_t i = 1; i + 1 < face.size(); i++) {
+                chunk.corners.insert(chunk.corners.end(), { face[0], face[i], face[i + 1] });
+            }
+
+            return;
+        }
+
+        if (keyword == "usemtl") {
+            chunk.uses.push_back({
+                .triangleI = chunk.corners.size() / 3,
+                .name = std::string(cursor.rest()),
+            });
+            return;
+        }
+
+        if (keyword == "mtllib") {
+            while (!cursor.isAtEnd()) {
+                chunk.libraries.push_back(std::string(cursor.word()));
+            }
+            return;
+        }
+    });
+}
+
+// Splits the text into chunks of about the size, each of which ends at the end of a line.
+std::vector<Chunk> split(const std::string_view text, const std::size_t size)
+{
+    auto chunks = std::vector<Chunk>();
+
+    std::size_t start = 0;
+    while (start < text.size()) {
+        auto end = std::min(start + std::max(size, std::size_t(1)), text.size());
+
+        end = text.find('\n', end - 1);
+        end = end == std::string_view::npos ? text.size() : end + 1;
+
+        auto& chunk = chunks.emplace_back();
+        chunk.text = text.substr(start, end - start);
+
+        start = end;
+    }
+
+    return chunks;
+}
+}
+
+namespace {
+// The part of a material of MTL that Material takes.
+struct Surface {
+public:
+    float3 diffuse = float3(0.8);
+    std::string diffuseMap;
+
+    float metalness = 0;
+    float roughness = 1;
+};
+
+void parseLibrary(const std::string& path, std::unordered_map<std::string, Surface>& surfaces)
+{
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to open: " + path);
+    }
+
+    auto stream = std::ostringstream();
+    stream << file.rdbuf();
+    const auto text = stream.str();
+
+    Surface* surface = nullptr;
+
+    forEachLine(text, [&](const std::string_view keyword, Cursor& cursor) {
+        if (keyword == "newmtl") {
+            surface = &surfaces[std::string(cursor.rest())];
+            return;
+        }
+
+        if (!surface) {
+            return;
+        }
+
+        if (keyword == "Kd") {
+            auto r = 0.f, g = 0.f, b = 0.f;
+            if (cursor.parse(r) && cursor.parse(g) && cursor.parse(b)) {
+                surface->diffuse = float3(r, g, b);
+            }
+            return;
+        }
+
+        // Options such as -s come before the path, which ends the line.
+        if (keyword == "map_Kd") {
+            auto word = cursor.word();
+            while (!cursor.isAtEnd()) {
+                word = cursor.word();
+            }
+
+            surface->diffuseMap = std::string(word);
+            return;
+        }
+
+        // The specular exponent maps to roughness as Blinn-Phong does to Beckmann, unless Pr of the PBR extension is given.
+        if (keyword == "Ns") {
+            auto exponent = 0.f;
+            if (cursor.parse(exponent)) {
+                surface->roughness = metal::sqrt(2 / (metal::max(exponent, 0.f) + 2));
+            }
+            return;
+        }
+
+        if (keyword == "Pr") {
+            cursor.parse(surface->roughness);
+            return;
+        }
+
+        if (keyword == "Pm") {
+            cursor.parse(surface->metalness);
+            return;
+        }
+    });
+}
+
+// Host decodes no PNG, so a diffuse map other than a binary PPM is left to the diffuse color.
+Material materialOf(const Surface& surface, const std::string& directory)
+{
+    auto material = Material {
+        .albedo = Texture<float>::fill(float4(surface.diffuse, 1)),
+        .metalRoughness = Texture<float>::fill(float4(surface.metalness, surface.roughness, 0, 0)),
+    };
+
+    const auto& map = surface.diffuseMap;
+    if (map.size() > 4 && map.compare(map.size() - 4, 4, ".ppm") == 0) {
+        material.albedo = Image::load(map[0] == '/' ? map : directory + map);
+    }
+
+    return material;
+}
+}
+
+OBJ OBJ::load(Pool& pool, const std::string& path, const Options& options)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto mapping = Mapping(path);
+    const auto directory = path.substr(0, path.find_last_of('/') + 1);
+
+    auto chunks = split(mapping.view(), options.chunkSize);
+
+    pool.dispatch(chunks.size(), [&](const std::size_t i) {
+        parse(chunks[i]);
+    });
+
+    for (const auto& chunk : chunks) {
+        if (!chunk.error.empty()) {
+            throw std::runtime_error(chunk.error + ": " + path);
+        }
+    }
+
+    // Where each chunk starts in the whole, which its relative indices are resolved against.
+    struct Base {
+    public:
+        std::size_t position = 0;
+        std::size_t textureCoordinate = 0;
+        std::size_t normal = 0;
+    };
+
+    auto bases = std::vector<Base>(chunks.size() + 1);
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        bases[i + 1] = {
+            .position = bases[i].position + chunks[i].positions.size(),
+            .textureCoordinate = bases[i].textureCoordinate + chunks[i].textureCoordinates.size(),
+            .normal = bases[i].normal + chunks[i].normals.size(),
+        };
+    }
+
+    auto obj = OBJ();
+    obj.stats.chunkCount = chunks.size();
+
+    auto& positions = obj.mesh.positions;
+    auto textureCoordinates = std::vector<float2>(bases.back().textureCoordinate);
+    auto normals = std::vector<packed_float3>(bases.back().normal);
+    positions.resize(bases.back().position);
+
+    pool.dispatch(chunks.size(), [&](const std::size_t i) {
+        std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), positions.begin() + bases[i].position);
+        std::copy(chunks[i].textureCoordinates.begin(), chunks[i].textureCoordinates.end(), textureCoordinates.begin() + bases[i].textureCoordinate);
+        std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), normals.begin() + bases[i].normal);
+    });
+
+    // A piece for each material in the order that they are first used,
+    // where the triangles before any usemtl take a piece of their own.
+    auto surfaces = std::unordered_map<std::string, Surface>();
+    for (const auto& chunk : chunks) {
+        for (const auto& library : chunk.libraries) {
+            parseLibrary(library[0] == '/' ? library : directory + library, surfaces);
+        }
+    }
+
+    auto pieceNames = std::vector<std::string>();
+    auto pieceIs = std::unordered_map<std::string, std::size_t>();
+    const auto pieceIOf = [&](const std::string& name) {
+        const auto [it, isNew] = pieceIs.try_emplace(name, pieceNames.size());
+        if (isNew) {
+            pieceNames.push_back(name);
+        }
+
+        return it->second;
+    };
+
+    // The runs of triangles of each chunk that use the same piece, and where each run starts in its piece.
+    struct Run {
+    public:
+        std::size_t pieceI;
+        std::size_t triangleI;
+        std::size_t triangleCount;
+        std::size_t offset;
+    };
+
+    auto runs = std::vector<std::vector<Run>>(chunks.size());
+    auto pieceTriangleCounts = std::vector<std::size_t>();
+    {
+        // The material in use, which only takes a piece once a triangle uses it,
+        // so that a usemtl without faces, or one that the next usemtl overrides, leaves no empty piece.
+        auto name = std::string();
+
+        for (std::size_t i = 0; i < chunks.size(); i++) {
+            const auto& chunk = chunks[i];
+            const auto triangleCount = chunk.corners.size() / 3;
+
+            for (std::size_t u = 0; u <= chunk.uses.size(); u++) {
+                const auto from = u == 0 ? 0 : chunk.uses[u - 1].triangleI;
+                const auto to = u == chunk.uses.size() ? triangleCount : chunk.uses[u].triangleI;
+
+                if (u > 0) {
+                    name = chunk.uses[u - 1].name;
+                }
+
+                if (from == to) {
+                    continue;
+                }
+
+                const auto pieceI = pieceIOf(name);
+
+                pieceTriangleCounts.resize(pieceNames.size(), 0);
+
+                runs[i].push_back({
+                    .pieceI = pieceI,
+                    .triangleI = from,
+                    .triangleCount = to - from,
+                    .offset = pieceTriangleCounts[pieceI],
+                });
+
+                pieceTriangleCounts[pieceI] += to - from;
+            }
+        }
+    }
+
+    obj.mesh.pieces.resize(pieceNames.size());
+    for (std::size_t i = 0; i < pieceNames.size(); i++) {
+        auto& piece = obj.mesh.pieces[i];
+
+        piece.indices.resize(pieceTriangleCounts[i] * 3);
+        piece.data.resize(pieceTriangleCounts[i]);
+
+        const auto surface = surfaces.find(pieceNames[i]);
+        piece.material = materialOf(surface != surfaces.end() ? surface->second : Surface(), directory);
+
+        obj.stats.triangleCount += pieceTriangleCounts[i];
+    }
+
+    // Each chunk writes its runs of triangles into their pieces, where no two runs overlap.
+    auto errors = std::vector<std::string>(chunks.size());
+
+    pool.dispatch(chunks.size(), [&](const std::size_t i) {
+        const auto& chunk = chunks[i];
+        const auto& base = bases[i];
+
+        const auto resolve = [&](const int64_t index, const bool isRelative, const std::size_t base, const std::size_t count) {
+            const auto resolved = isRelative ? int64_t(base) + index : index;
+            return resolved >= 0 && resolved < int64_t(count) ? resolved : missing;
+        };
+
+        for (const auto& run : runs[i]) {
+            auto& piece = obj.mesh.pieces[run.pieceI];
+
+            for (std::size_t t = 0; t < run.triangleCount; t++) {
+                const auto* corners = chunk.corners.data() + (run.triangleI + t) * 3;
+                const auto pieceTriangleI = run.offset + t;
+
+                auto& triangle = piece.data[pieceTriangleI];
+                auto hasNormals = true;
+
+                for (std::size_t v = 0; v < 3; v++) {
+                    const auto& corner = corners[v];
+
+                    const auto position = resolve(corner.position, corner.relatives & (1 << 0), base.position, positions.size());
+                    if (position == missing) {
+                        errors[i] = "position out of range";
+                        return;
+                    }
+                    piece.indices[pieceTriangleI * 3 + v] = uint32_t(position);
+
+                    const auto textureCoordinate = corner.textureCoordinate == missing
+                        ? missing
+                        : resolve(corner.textureCoordinate, corner.relatives & (1 << 1), base.textureCoordinate, textureCoordinates.size());
+                    triangle.textureCoordinates[v] = textureCoordinate == missing ? float2(0) : textureCoordinates[textureCoordinate];
+
+                    const auto normal = corner.normal == missing
+                        ? missing
+                        : resolve(corner.normal, corner.relatives & (1 << 2), base.normal, normals.size());
+                    if (normal == missing) {
+                        hasNormals = false;
+                    } else {
+                        triangle.normals[v] = normals[normal];
+                    }
+                }
+
+                // A face without normals is shaded flat.
+                if (!hasNormals) {
+                    const auto* indices = piece.indices.data() + pieceTriangleI * 3;
+                    const auto a = float3(positions[indices[0]]);
+                    const auto b = float3(positions[indices[1]]);
+                    const auto c = float3(positions[indices[2]]);
+
+                    const auto cross = metal::cross(b - a, c - a);
+                    const auto normal = metal::length(cross) > 0 ? metal::normalize(cross) : float3(0, 1, 0);
+
+                    triangle.normals[0] = normal;
+                    triangle.normals[1] = normal;
+                    triangle.normals[2] = normal;
+                }
+            }
+        }
+    });
+
+    for (const auto& error : errors) {
+        if (!error.empty()) {
+            throw std::runtime_error(error + ": " + path);
+        }
+    }
+
+    pool.dispatch(obj.mesh.pieces.size(), [&](const std::size_t i) {
+        auto& piece = obj.mesh.pieces[i];
+        piece.textureScale = textureScaleOf(positions, piece.indices, piece.data);
+    });
+
+    obj.stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return obj;
+}
+}
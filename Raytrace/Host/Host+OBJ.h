@@ -0,0 +1,37 @@
+// tomocy
+
+#pragma once
+
+#include "Host+Mesh.h"
+#include "Host+Pool.h"
+#include <cstddef>
+#include <string>
+
+namespace Host {
+// OBJ imports a Wavefront OBJ, with the materials of its MTL libraries, as a mesh with a piece for each material.
+// The file is mapped and split into chunks of whole lines, which are parsed in parallel and then stitched together
+// straight into the positions, the indices and the data of each triangle as Mesh lays them out.
+struct OBJ {
+public:
+    struct Options {
+    public:
+        // About how many bytes each chunk takes, which ends at the end of a line.
+        std::size_t chunkSize = std::size_t(1) << 20;
+    };
+
+    struct Stats {
+    public:
+        std::size_t chunkCount = 0;
+        std::size_t triangleCount = 0;
+        double seconds = 0;
+    };
+
+public:
+    // The mesh has no instances, which the caller places.
+    static OBJ load(Pool& pool, const std::string& path, const Options& options);
+
+public:
+    Mesh mesh;
+    Stats stats;
+};
+}
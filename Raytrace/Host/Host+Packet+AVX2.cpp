@@ -0,0 +1,16 @@
+// tomocy
+
+#include "Host+Packet+Traversal.h"
+
+// This file is compiled with AVX2 enabled, and only runs when the CPU supports it.
+
+namespace Host {
+namespace Packet {
+void intersect8(const Scene& scene, const RayPacket& packet, const uint32_t mask, Hits& hits)
+{
+    auto traversal = Traversal<8>(scene, packet);
+    traversal.run(mask);
+    traversal.write(hits);
+}
+}
+}
@@ -0,0 +1,293 @@
+// tomocy
+
+#pragma once
+
+#include "Host+Packet.h"
+#include "Host+SIMD.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// This header is included by the translation units of each instruction set.
+// Everything in it has internal linkage, so that code compiled for AVX2 never leaks into the others.
+
+namespace Host {
+namespace Packet {
+namespace {
+using SIMD::Lanes;
+
+template <int N>
+struct Rays {
+public:
+    using Float = typename Lanes<N>::Float;
+
+public:
+    Float origin[3];
+    Float direction[3];
+    Float invDirection[3];
+};
+
+template <int N>
+class Traversal {
+public:
+    using L = Lanes<N>;
+    using Float = typename L::Float;
+    using Int = typename L::Int;
+
+public:
+    Traversal(const Scene& scene, const RayPacket& packet)
+        : scene_(scene)
+    {
+        Int lane;
+        for (int i = 0; i < N; i++) {
+            lane[i] = i;
+        }
+        active_ = lane < L::splat(int32_t(packet.size));
+
+        for (int i = 0; i < 3; i++) {
+            world_.origin[i] = L::load(packet.origin[i]);
+            world_.direction[i] = L::load(packet.direction[i]);
+        }
+        invert(world_);
+
+        minDistance_ = L::load(packet.minDistance);
+
+        // Lanes out of the packet never hit as their ranges are empty.
+        maxDistance_ = active_ ? L::load(packet.maxDistance) : L::splat(-INFINITY);
+
+        u_ = L::splat(0.0f);
+        v_ = L::splat(0.0f);
+        instance_ = L::splat(int32_t(-1));
+        geometry_ = L::splat(int32_t(-1));
+        primitive_ = L::splat(int32_t(-1));
+    }
+
+public:
+    void run(const uint32_t mask)
+    {
+        traverse(scene_.nodes, scene_.indices, scene_.bounds, world_, [&](const uint32_t index) {
+            const auto& instance = scene_.instances[index];
+            if ((instance.mask & mask) == 0) {
+                return;
+            }
+
+            // Keep the directions unnormalized so that distances in both spaces agree.
+            auto local = Rays<N>();
+            for (int i = 0; i < 3; i++) {
+                local.origin[i] = instance.inverse[0][i] * world_.origin[0]
+                    + instance.inverse[1][i] * world_.origin[1]
+                    + instance.inverse[2][i] * world_.origin[2]
+                    + instance.inverse[3][i];
+                local.direction[i] = instance.inverse[0][i] * world_.direction[0]
+                    + instance.inverse[1][i] * world_.direction[1]
+                    + instance.inverse[2][i] * world_.direction[2];
+            }
+            invert(local);
+
+            const auto& structure = *instance.structure;
+            traverse(structure.nodes, structure.indices, structure.bounds, local, [&](const uint32_t index) {
+                intersect(structure, index, local, int32_t(&instance - scene_.instances));
+            });
+        });
+    }
+
+    void write(Hits& hits) const
+    {
+        L::store(maxDistance_, hits.distance);
+        L::store(u_, hits.u);
+        L::store(v_, hits.v);
+        L::store(instance_, hits.instance);
+        L::store(geometry_, hits.geometry);
+        L::store(primitive_, hits.primitive);
+    }
+
+private:
+    static void invert(Rays<N>& rays)
+    {
+        // Nudge zero components, so that the slab test never multiplies 0 by infinity.
+        for (int i = 0; i < 3; i++) {
+            const auto d = rays.direction[i];
+            const auto tiny = d < 0 ? L::splat(-1e-20f) : L::splat(1e-20f);
+            rays.invDirection[i] = 1 / (((d < 1e-20f) & (d > -1e-20f)) ? tiny : d);
+        }
+    }
+
+    // Visits the leaves of the BVH that any active lane reaches, nearer ones first in the view of the first lane.
+    template <typename Visit>
+    void traverse(const WideBVH::Node* nodes, const uint32_t* indices, const float (&bounds)[2][3], const Rays<N>& rays, Visit visit)
+    {
+        // Entry is a node when count is 0 and a leaf otherwise, as in WideBVH::Node,
+        // with the distance of each lane to its box, or infinity for the lanes which miss it.
+        struct Entry {
+        public:
+            Float distance;
+            uint32_t first;
+            uint32_t count;
+        };
+
+        Entry stack[WideBVH::maxStackSize];
+        std::size_t stackCount = 0;
+
+        stack[stackCount++] = { distanceTo(bounds[0], bounds[1], rays), 0, 0 };
+
+        auto lead = 0;
+        while (lead < N - 1 && !active_[lead]) {
+            lead++;
+        }
+
+        while (stackCount != 0) {
+            const auto entry = stack[--stackCount];
+
+            // The closest hits may have come nearer since the entry was pushed.
+            if (!L::any(reaches(entry.distance))) {
+                continue;
+            }
+
+            if (entry.count != 0) {
+                for (uint32_t i = 0; i < entry.count; i++) {
+                    visit(indices[entry.first + i]);
+                }
+                continue;
+            }
+
+            const auto& node = nodes[entry.first];
+
+            // Decode the boxes here rather than with WideBVH::Node, whose inline code may be shared with the other instruction sets.
+            const float origin[] = { node.origin.x, node.origin.y, node.origin.z };
+
+            float scale[3];
+            for (int axis = 0; axis < 3; axis++) {
+                const auto bits = uint32_t(int32_t(node.exponents[axis]) + 127) << 23;
+                __builtin_memcpy(&scale[axis], &bits, sizeof(float));
+            }
+
+            // Keep the children that any lane reaches from the farthest to the nearest along the lead lane.
+            Entry children[WideBVH::width];
+            std::size_t childCount = 0;
+
+            for (std::size_t i = 0; i < node.childCount; i++) {
+                float mins[3];
+                float maxs[3];
+                for (int axis = 0; axis < 3; axis++) {
+                    mins[axis] = origin[axis] + float(node.mins[axis][i]) * scale[axis];
+                    maxs[axis] = origin[axis] + float(node.maxs[axis][i]) * scale[axis];
+                }
+
+                const auto distance = distanceTo(mins, maxs, rays);
+                if (!L::any(reaches(distance))) {
+                    continue;
+                }
+
+                auto at = childCount++;
+                while (at > 0 && children[at - 1].distance[lead] < distance[lead]) {
+                    children[at] = children[at - 1];
+                    at--;
+                }
+
+                children[at] = { distance, node.firsts[i], node.counts[i] };
+            }
+
+            for (std::size_t i = 0; i < childCount; i++) {
+                stack[stackCount++] = children[i];
+            }
+        }
+    }
+
+    Float distanceTo(const float* mins, const float* maxs, const Rays<N>& rays) const
+    {
+        auto enter = minDistance_;
+        auto exit = maxDistance_;
+
+        for (int i = 0; i < 3; i++) {
+            const auto t0 = (mins[i] - rays.origin[i]) * rays.invDirection[i];
+            const auto t1 = (maxs[i] - rays.origin[i]) * rays.invDirection[i];
+
+            enter = L::max(enter, L::min(t0, t1));
+            exit = L::min(exit, L::max(t0, t1));
+        }
+
+        return (active_ & (enter <= exit)) ? enter : L::splat(INFINITY);
+    }
+
+    // The lanes which miss have an infinite distance, which the maximum distance of a ray may also be.
+    Int reaches(const Float distance) const { return (distance != INFINITY) & (distance <= maxDistance_); }
+
+    // Möller-Trumbore of a triangle against every lane,
+    // reporting the barycentric coordinate as Metal does: position = (1 - u - v) * p0 + u * p1 + v * p2.
+    void intersect(const Scene::Structure& structure, const uint32_t index, const Rays<N>& rays, const int32_t instance)
+    {
+        const auto& reference = structure.references[index];
+        const auto& geometry = structure.geometries[reference.geometry];
+
+        const auto* triangle = geometry.indices + std::size_t(reference.primitive) * 3;
+        const auto& p0 = geometry.positions[triangle[0]];
+        const auto& p1 = geometry.positions[triangle[1]];
+        const auto& p2 = geometry.positions[triangle[2]];
+
+        const float e1[] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+        const float e2[] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+
+        const auto& d = rays.direction;
+
+        const Float p[] = {
+            d[1] * e2[2] - d[2] * e2[1],
+            d[2] * e2[0] - d[0] * e2[2],
+            d[0] * e2[1] - d[1] * e2[0],
+        };
+
+        const auto det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        const auto invDet = 1 / det;
+
+        const Float t[] = {
+            rays.origin[0] - p0.x,
+            rays.origin[1] - p0.y,
+            rays.origin[2] - p0.z,
+        };
+
+        const auto u = (t[0] * p[0] + t[1] * p[1] + t[2] * p[2]) * invDet;
+
+        const Float q[] = {
+            t[1] * e1[2] - t[2] * e1[1],
+            t[2] * e1[0] - t[0] * e1[2],
+            t[0] * e1[1] - t[1] * e1[0],
+        };
+
+        const auto v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+        const auto distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+
+        const auto hits = active_
+            & ((det > 1e-12f) | (det < -1e-12f))
+            & (u >= 0) & (u <= 1)
+            & (v >= 0) & (u + v <= 1)
+            & (distance >= minDistance_) & (distance <= maxDistance_);
+
+        if (!L::any(hits)) {
+            return;
+        }
+
+        maxDistance_ = hits ? distance : maxDistance_;
+        u_ = hits ? u : u_;
+        v_ = hits ? v : v_;
+        instance_ = hits ? L::splat(instance) : instance_;
+        geometry_ = hits ? L::splat(int32_t(reference.geometry)) : geometry_;
+        primitive_ = hits ? L::splat(int32_t(reference.primitive)) : primitive_;
+    }
+
+private:
+    const Scene& scene_;
+
+    Rays<N> world_;
+    Int active_;
+
+    Float minDistance_;
+    Float maxDistance_;
+
+    Float u_;
+    Float v_;
+    Int instance_;
+    Int geometry_;
+    Int primitive_;
+};
+}
+}
+}
@@ -0,0 +1,175 @@
+// tomocy
+
+#include "Host+Packet.h"
+#include "Host+Packet+Traversal.h"
+#include <algorithm>
+
+namespace Host {
+namespace Packet {
+namespace {
+void flatten(const BVH::Box& box, float (&bounds)[2][3])
+{
+    for (int i = 0; i < 3; i++) {
+        bounds[0][i] = box.min[i];
+        bounds[1][i] = box.max[i];
+    }
+}
+}
+
+void intersect4(const Scene& scene, const RayPacket& packet, const uint32_t mask, Hits& hits)
+{
+    auto traversal = Traversal<4>(scene, packet);
+    traversal.run(mask);
+    traversal.write(hits);
+}
+
+#if !defined(HOST_HAS_AVX2)
+// PacketIntersector never asks for 8 lanes without AVX2, though keep them working.
+void intersect8(const Scene& scene, const RayPacket& packet, const uint32_t mask, Hits& hits)
+{
+    auto traversal = Traversal<8>(scene, packet);
+    traversal.run(mask);
+    traversal.write(hits);
+}
+#endif
+}
+}
+
+namespace Host {
+std::size_t PacketIntersector::width()
+{
+#if defined(HOST_HAS_AVX2)
+    static const auto supportsAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supportsAVX2 ? 8 : 4;
+#else
+    return 4;
+#endif
+}
+
+PacketIntersector::PacketIntersector(const InstanceAccelerationStructure& structure)
+    : structure_(structure)
+{
+    const auto& instances = structure.instances();
+
+    // Instances share their primitive structures, so flatten each of them once.
+    structures_.reserve(instances.size());
+    instances_.reserve(instances.size());
+
+    for (const auto& instance : instances) {
+        const auto* primitive = instance.structure;
+
+        auto it = std::find_if(instances.begin(), instances.end(), [&](const auto& other) {
+            return other.structure == primitive;
+        });
+        const auto first = std::size_t(it - instances.begin());
+
+        // The instance is the first one with the structure.
+        if (first == instances_.size()) {
+            structures_.push_back({
+                .nodes = primitive->bvh().nodes.data(),
+                .indices = primitive->bvh().indices.data(),
+                .bounds = {},
+                .geometries = primitive->geometries().data(),
+                .references = primitive->references().data(),
+            });
+            Packet::flatten(primitive->bvh().bounds, structures_.back().bounds);
+        }
+
+        auto flat = Packet::Scene::Instance {
+            .structure = nullptr,
+            .inverse = {},
+            .mask = instance.mask,
+        };
+
+        flat.structure = first == instances_.size()
+            ? &structures_.back()
+            : instances_[first].structure;
+
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 3; row++) {
+                flat.inverse[column][row] = instance.inverse.columns[column][row];
+            }
+        }
+
+        instances_.push_back(flat);
+    }
+
+    scene_ = {
+        .nodes = structure.bvh().nodes.data(),
+        .indices = structure.bvh().indices.data(),
+        .bounds = {},
+        .instances = instances_.data(),
+    };
+    Packet::flatten(structure.bvh().bounds, scene_.bounds);
+}
+
+void PacketIntersector::intersect(
+    const RayPacket& packet,
+    const uint mask,
+    metal::raytracing::intersection_result* const results
+) const
+{
+    auto hits = Packet::Hits();
+
+    if (packet.size > 4 && width() == 8) {
+        Packet::intersect8(scene_, packet, mask, hits);
+    } else if (packet.size <= 4) {
+        Packet::intersect4(scene_, packet, mask, hits);
+    } else {
+        // Trace the packet in two halves, sharing no traversal between them.
+        auto halves = RayPacket();
+        for (std::size_t half = 0; half < 2; half++) {
+            halves.size = std::min<std::size_t>(packet.size - half * 4, 4);
+
+            for (std::size_t lane = 0; lane < halves.size; lane++) {
+                const auto from = half * 4 + lane;
+
+                for (int i = 0; i < 3; i++) {
+                    halves.origin[i][lane] = packet.origin[i][from];
+                    halves.direction[i][lane] = packet.direction[i][from];
+                }
+                halves.minDistance[lane] = packet.minDistance[from];
+                halves.maxDistance[lane] = packet.maxDistance[from];
+            }
+
+            auto halfHits = Packet::Hits();
+            Packet::intersect4(scene_, halves, mask, halfHits);
+
+            for (std::size_t lane = 0; lane < halves.size; lane++) {
+                const auto to = half * 4 + lane;
+
+                hits.distance[to] = halfHits.distance[lane];
+                hits.u[to] = halfHits.u[lane];
+                hits.v[to] = halfHits.v[lane];
+                hits.instance[to] = halfHits.instance[lane];
+                hits.geometry[to] = halfHits.geometry[lane];
+                hits.primitive[to] = halfHits.primitive[lane];
+            }
+        }
+    }
+
+    const auto& instances = structure_.instances();
+
+    for (std::size_t lane = 0; lane < packet.size; lane++) {
+        auto& result = results[lane];
+        result = {};
+
+        if (hits.instance[lane] < 0) {
+            continue;
+        }
+
+        const auto& instance = instances[hits.instance[lane]];
+        const auto& geometry = instance.structure->geometries()[hits.geometry[lane]];
+
+        result.type = metal::raytracing::intersection_type::triangle;
+        result.distance = hits.distance[lane];
+        result.instance_id = uint(hits.instance[lane]);
+        result.user_instance_id = instance.userID;
+        result.geometry_id = uint(hits.geometry[lane]);
+        result.primitive_id = uint(hits.primitive[lane]);
+        result.triangle_barycentric_coord = float2(hits.u[lane], hits.v[lane]);
+        result.primitive_data = static_cast<const uint8_t*>(geometry.primitiveData)
+            + std::size_t(hits.primitive[lane]) * geometry.primitiveDataStride;
+    }
+}
+}
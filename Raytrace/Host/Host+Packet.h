@@ -0,0 +1,120 @@
+// tomocy
+
+#pragma once
+
+#include "Host+AccelerationStructure.h"
+#include "Host+BVH.h"
+#include "Host+WideBVH.h"
+#include <cstddef>
+#include <cstdint>
+#include <metal_stdlib>
+#include <vector>
+
+namespace Host {
+// RayPacket is a bundle of rays that are traced together, one in each lane.
+struct RayPacket {
+public:
+    static constexpr std::size_t maxSize = 8;
+
+public:
+    void set(const std::size_t lane, const metal::raytracing::ray& ray)
+    {
+        for (int i = 0; i < 3; i++) {
+            origin[i][lane] = ray.origin[i];
+            direction[i][lane] = ray.direction[i];
+        }
+
+        minDistance[lane] = ray.min_distance;
+        maxDistance[lane] = ray.max_distance;
+    }
+
+public:
+    std::size_t size = 0;
+
+    float origin[3][maxSize];
+    float direction[3][maxSize];
+    float minDistance[maxSize];
+    float maxDistance[maxSize];
+};
+}
+
+namespace Host {
+namespace Packet {
+// Scene is a flat view of an instance acceleration structure for the packet traversal,
+// which only reads plain data so that it can be compiled for other instruction sets.
+struct Scene {
+public:
+    struct Structure {
+    public:
+        const WideBVH::Node* nodes;
+        const uint32_t* indices;
+
+        // The box of the root as its min and max.
+        float bounds[2][3];
+
+        const PrimitiveAccelerationStructure::Geometry* geometries;
+        const PrimitiveAccelerationStructure::Reference* references;
+    };
+
+    struct Instance {
+    public:
+        const Structure* structure;
+
+        // The inverse transform in 4 columns of 3 rows.
+        float inverse[4][3];
+
+        uint32_t mask;
+    };
+
+public:
+    const WideBVH::Node* nodes;
+    const uint32_t* indices;
+    float bounds[2][3];
+
+    const Instance* instances;
+};
+
+// Hits holds the closest hit of each lane, where instance is -1 for the lanes that hit nothing.
+struct Hits {
+public:
+    float distance[RayPacket::maxSize];
+    float u[RayPacket::maxSize];
+    float v[RayPacket::maxSize];
+
+    int32_t instance[RayPacket::maxSize];
+    int32_t geometry[RayPacket::maxSize];
+    int32_t primitive[RayPacket::maxSize];
+};
+
+void intersect4(const Scene& scene, const RayPacket& packet, uint32_t mask, Hits& hits);
+void intersect8(const Scene& scene, const RayPacket& packet, uint32_t mask, Hits& hits);
+}
+}
+
+namespace Host {
+// PacketIntersector intersects packets of coherent rays, such as primary ones, with an instance acceleration structure,
+// sharing a traversal between the lanes of the packet.
+class PacketIntersector {
+public:
+    // The lanes that the CPU runs at once, which is 8 with AVX2 and 4 otherwise.
+    static std::size_t width();
+
+public:
+    explicit PacketIntersector(const InstanceAccelerationStructure& structure);
+
+public:
+    // Writes the closest hit of each lane of the packet to results.
+    void intersect(
+        const RayPacket& packet,
+        uint mask,
+        metal::raytracing::intersection_result* results
+    ) const;
+
+private:
+    const InstanceAccelerationStructure& structure_;
+
+    std::vector<Packet::Scene::Structure> structures_;
+    std::vector<Packet::Scene::Instance> instances_;
+    Packet::Scene scene_;
+};
+}
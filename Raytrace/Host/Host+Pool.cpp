@@ -0,0 +1,158 @@
+// tomocy
+
+#include "Host+Pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Host {
+struct Pool::Job {
+public:
+    Job(const std::size_t count, const std::function<void(std::size_t)>& code)
+        : count(count)
+        , code(code)
+    {
+    }
+
+public:
+    // Returns false when there is no index left to take.
+    bool runNext()
+    {
+        const auto i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= count) {
+            return false;
+        }
+
+        code(i);
+
+        done.fetch_add(1, std::memory_order_acq_rel);
+
+        return true;
+    }
+
+    bool isDone() const { return done.load(std::memory_order_acquire) == count; }
+
+public:
+    const std::size_t count;
+    const std::function<void(std::size_t)>& code;
+
+    std::atomic<std::size_t> next = 0;
+    std::atomic<std::size_t> done = 0;
+};
+
+struct Pool::State {
+public:
+    void work()
+    {
+        while (true) {
+            std::shared_ptr<Job> job;
+
+            {
+                auto lock = std::unique_lock(mutex);
+                wakes.wait(lock, [&] { return stops || !jobs.empty(); });
+
+                if (stops) {
+                    return;
+                }
+
+                job = jobs.front();
+            }
+
+            run(job);
+        }
+    }
+
+    void run(const std::shared_ptr<Job>& job)
+    {
+        while (job->runNext()) { }
+
+        {
+            auto lock = std::unique_lock(mutex);
+
+            const auto it = std::find(jobs.begin(), jobs.end(), job);
+            if (it != jobs.end()) {
+                jobs.erase(it);
+            }
+        }
+
+        if (job->isDone()) {
+            auto lock = std::unique_lock(mutex);
+            finishes.notify_all();
+        }
+    }
+
+public:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wakes;
+    std::condition_variable finishes;
+
+    std::deque<std::shared_ptr<Job>> jobs;
+    bool stops = false;
+};
+}
+
+namespace Host {
+std::size_t Pool::concurrency()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+Pool::Pool(const std::size_t size)
+    : state_(std::make_unique<State>())
+{
+    for (std::size_t i = 1; i < std::max<std::size_t>(size, 1); i++) {
+        state_->workers.emplace_back([state = state_.get()] { state->work(); });
+    }
+}
+
+Pool::~Pool()
+{
+    {
+        auto lock = std::unique_lock(state_->mutex);
+        state_->stops = true;
+    }
+
+    state_->wakes.notify_all();
+
+    for (auto& worker : state_->workers) {
+        worker.join();
+    }
+}
+
+std::size_t Pool::size() const { return state_->workers.size() + 1; }
+
+void Pool::dispatch(const std::size_t count, const std::function<void(std::size_t)>& code)
+{
+    if (count == 0) {
+        return;
+    }
+
+    if (count == 1 || state_->workers.empty()) {
+        for (std::size_t i = 0; i < count; i++) {
+            code(i);
+        }
+
+        return;
+    }
+
+    const auto job = std::make_shared<Job>(count, code);
+
+    {
+        auto lock = std::unique_lock(state_->mutex);
+        state_->jobs.push_back(job);
+    }
+
+    state_->wakes.notify_all();
+
+    state_->run(job);
+
+    auto lock = std::unique_lock(state_->mutex);
+    state_->finishes.wait(lock, [&] { return job->isDone(); });
+}
+}
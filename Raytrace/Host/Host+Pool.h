@@ -0,0 +1,38 @@
+// tomocy
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace Host {
+// Pool runs work on a fixed set of workers.
+// It never mentions std::thread in this header as the Metal shim defines `thread` away.
+class Pool {
+public:
+    static std::size_t concurrency();
+
+public:
+    explicit Pool(std::size_t size = concurrency());
+    ~Pool();
+
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+public:
+    // The size counts the calling thread, which also takes work while it waits.
+    std::size_t size() const;
+
+public:
+    // Runs code for each index in 0..<count and returns when all of them are done.
+    // It can be nested, e.g. dispatching from inside code.
+    void dispatch(std::size_t count, const std::function<void(std::size_t)>& code);
+
+private:
+    struct Job;
+    struct State;
+
+    std::unique_ptr<State> state_;
+};
+}
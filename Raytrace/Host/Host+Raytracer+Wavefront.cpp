@@ -0,0 +1,460 @@
+// tomocy
+
+#include "Host+Raytracer.h"
+#include "../App/Raytrace/Raytrace+Tracer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// The kernels of Raytrace+Raytrace.metal are defined in Host+Raytracer.cpp,
+// so this only shares Raytrace::Tracer with it and runs its stages in its own loop.
+
+namespace Host {
+namespace {
+// A batch takes the paths of whole tiles until it has this many, which bounds the memory of its queues.
+constexpr std::size_t maxPathCountPerBatch = std::size_t(1) << 18;
+
+// Rays are intersected and shaded this many at a time on each worker.
+constexpr std::size_t chunkSize = 1024;
+
+// Paths holds the state of each path of a batch, laid out pixel by pixel with the samples of each pixel in order.
+struct Paths {
+public:
+    void resize(const std::size_t size)
+    {
+        pixels.resize(size);
+        sampleIndices.resize(size);
+        colors.resize(size);
+    }
+
+public:
+    std::vector<uint2> pixels;
+    std::vector<uint32_t> sampleIndices;
+
+    // The throughput while the path goes on, and its sample once it ends.
+    std::vector<float3> colors;
+};
+
+// Queue holds the rays of a bounce in SoA, each of which continues a path.
+struct Queue {
+public:
+    std::size_t size() const { return paths.size(); }
+
+    void resize(const std::size_t size)
+    {
+        paths.resize(size);
+        origins.resize(size);
+        directions.resize(size);
+        minDistances.resize(size);
+        coneWidths.resize(size);
+        coneSpreadAngles.resize(size);
+    }
+
+public:
+    metal::raytracing::ray rayAt(const std::size_t i) const
+    {
+        return metal::raytracing::ray(origins[i], directions[i], minDistances[i]);
+    }
+
+    Raytrace::Cone coneAt(const std::size_t i) const
+    {
+        return {
+            .width = coneWidths[i],
+            .spreadAngle = coneSpreadAngles[i],
+        };
+    }
+
+    void set(const std::size_t i, const uint32_t path, const metal::raytracing::ray& ray, const Raytrace::Cone& cone)
+    {
+        paths[i] = path;
+        origins[i] = ray.origin;
+        directions[i] = ray.direction;
+        minDistances[i] = ray.min_distance;
+        coneWidths[i] = cone.width;
+        coneSpreadAngles[i] = cone.spreadAngle;
+    }
+
+public:
+    std::vector<uint32_t> paths;
+
+    std::vector<float3> origins;
+    std::vector<float3> directions;
+    std::vector<float> minDistances;
+
+    std::vector<float> coneWidths;
+    std::vector<float> coneSpreadAngles;
+};
+
+// Orders the indices of the keys by their keys with a counting sort, keeping the order of the indices with the same key.
+void sortByKeys(const std::vector<uint32_t>& keys, std::vector<uint32_t>& bins, std::vector<uint32_t>& order)
+{
+    bins.assign(*std::max_element(keys.begin(), keys.end()) + 1, 0);
+    for (const auto key : keys) {
+        bins[key]++;
+    }
+
+    uint32_t offset = 0;
+    for (auto& bin : bins) {
+        offset += std::exchange(bin, offset);
+    }
+
+    order.resize(keys.size());
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        order[bins[keys[i]]++] = uint32_t(i);
+    }
+}
+
+// The levels of the Morton code of a ray, each of which halves the cells of its origin and its direction on each axis.
+// 3 levels make as many buckets as a batch has paths, which is as fine as a counting sort of them gets.
+constexpr int mortonLevelCount = 3;
+
+// Interleaves the bits of the origin and the direction of the ray, quantized in the bounds and on the unit cube,
+// so that rays which are close in both of them get close codes, with the origin taking the higher bit of each level.
+uint32_t mortonCodeOf(const metal::raytracing::ray& ray, const BVH::Box& bounds)
+{
+    constexpr auto cellCount = float(1 << mortonLevelCount);
+
+    const auto cellOf = [](const float value) {
+        return uint32_t(std::fmin(std::fmax(value * cellCount, 0.0f), cellCount - 1));
+    };
+
+    uint32_t values[6];
+    for (int axis = 0; axis < 3; axis++) {
+        const auto extent = std::fmax(bounds.max[axis] - bounds.min[axis], 1e-6f);
+
+        values[axis] = cellOf((ray.origin[axis] - bounds.min[axis]) / extent);
+        values[3 + axis] = cellOf(ray.direction[axis] * 0.5f + 0.5f);
+    }
+
+    uint32_t code = 0;
+    for (int bit = mortonLevelCount - 1; bit >= 0; bit--) {
+        for (const auto value : values) {
+            code = code << 1 | ((value >> bit) & 1);
+        }
+    }
+
+    return code;
+}
+}
+
+Raytracer::Stats Raytracer::encodeInWavefronts(
+    Pool& pool,
+    const Raytrace::Frame& frame,
+    const Schedule& schedule,
+    const Background& background,
+    const Env& env,
+    Acceleration& acceleration
+)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto tracer = Raytrace::Tracer::make(
+        Raytrace::Camera::make(),
+        target.resolution,
+        background.forShader(),
+        env.forShader(),
+        acceleration.forShader(),
+        maxTraceCount,
+        Raytrace::Sampler::make(uint2(0), frame.id, 0)
+    );
+
+    const auto threadsSizePerGroup = uint2(Raytrace::Accumulation::tileSize);
+    const auto tiles = schedule.activeTiles();
+    const auto tileCount = schedule.tileCount();
+    const auto& budgets = schedule.texture().texels().levels[0].texels;
+
+    const auto tileAt = [&](const std::size_t i) {
+        const auto group = uint2(uint(tiles[i] % tileCount.x), uint(tiles[i] / tileCount.x));
+        const auto origin = group * threadsSizePerGroup;
+
+        struct {
+            uint2 origin;
+            uint2 end;
+            uint32_t accumulatedCount;
+            uint32_t sampleCount;
+        } tile = {
+            .origin = origin,
+            .end = metal::min(origin + threadsSizePerGroup, target.resolution),
+            .accumulatedCount = budgets[tiles[i]].r,
+            .sampleCount = budgets[tiles[i]].g,
+        };
+
+        return tile;
+    };
+
+    const auto dispatchChunks = [&](const std::size_t count, const auto& code) {
+        pool.dispatch((count + chunkSize - 1) / chunkSize, [&](const std::size_t chunk) {
+            code(chunk * chunkSize, std::min((chunk + 1) * chunkSize, count));
+        });
+    };
+
+    std::atomic<uint64_t> rayCount = 0;
+    std::atomic<uint64_t> primaryRayCount = 0;
+    std::atomic<uint64_t> nodeVisitCount = 0;
+    std::atomic<uint64_t> nodeMissCount = 0;
+    std::atomic<uint64_t> shadowRayCount = 0;
+    std::atomic<uint64_t> shadowNodeVisitCount = 0;
+
+    auto paths = Paths();
+    auto queue = Queue();
+    auto nextQueue = Queue();
+
+    std::vector<Raytrace::Intersection::Raw> hits;
+
+    // The Morton code of each ray to intersect the queue in the order of them, see reordersRays,
+    // and then the piece that it has hit, with the misses first, to shade the queue in the order of them.
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> bins;
+    std::vector<uint32_t> order;
+
+    // What each ray in the order has shaded, and whether its shadow ray is occluded.
+    std::vector<Raytrace::Tracer::TraceResult> results;
+    std::vector<uint8_t> isOccluded;
+
+    // Whether each ray in the order goes on, and where the survivors of each chunk start in the next queue.
+    std::vector<uint8_t> goesOn;
+    std::vector<std::size_t> offsets;
+
+    const auto targetTexture = target.texture.as2D<metal::access::write>();
+    const auto accumulationTexture = accumulation.as2D<metal::access::read_write>();
+    const auto albedoTexture = albedo.as2D<metal::access::write>();
+    const auto normalDepthTexture = normalDepth.as2D<metal::access::write>();
+
+    for (std::size_t firstTile = 0; firstTile < tiles.size();) {
+        std::vector<std::size_t> pathOffsets = { 0 };
+
+        auto lastTile = firstTile;
+        while (lastTile < tiles.size()) {
+            const auto tile = tileAt(lastTile);
+            const auto count = std::size_t(tile.end.x - tile.origin.x) * (tile.end.y - tile.origin.y) * tile.sampleCount;
+
+            // A batch takes at least a tile, however many paths it has.
+            if (lastTile != firstTile && pathOffsets.back() + count > maxPathCountPerBatch) {
+                break;
+            }
+
+            pathOffsets.push_back(pathOffsets.back() + count);
+            lastTile++;
+        }
+
+        const auto pathCount = pathOffsets.back();
+
+        paths.resize(pathCount);
+        queue.resize(pathCount);
+
+        // Generate the camera rays, a path for each sample of each pixel.
+        pool.dispatch(lastTile - firstTile, [&](const std::size_t i) {
+            const auto tile = tileAt(firstTile + i);
+            const auto camera = Raytrace::Camera::make();
+            const auto cone = Raytrace::Cone::primary(tracer.pixelSpreadAngle);
+
+            auto path = uint32_t(pathOffsets[i]);
+            for (uint y = tile.origin.y; y < tile.end.y; y++) {
+                for (uint x = tile.origin.x; x < tile.end.x; x++) {
+                    const auto ray = camera.rayAt(Shader::Coordinate::InScreen(uint2(x, y)), target.resolution);
+
+                    for (uint32_t s = 0; s < tile.sampleCount; s++, path++) {
+                        paths.pixels[path] = uint2(x, y);
+                        paths.sampleIndices[path] = tile.accumulatedCount + s;
+                        paths.colors[path] = maxTraceCount > 0 ? float3(1) : float3(0);
+
+                        queue.set(path, path, ray, cone);
+                    }
+                }
+            }
+        });
+
+        if (maxTraceCount == 0) {
+            queue.resize(0);
+        }
+
+        for (uint32_t bounceCount = 0; queue.size() != 0; bounceCount++) {
+            // The camera rays are already in the order of the pixels, while the bounces scatter them,
+            // so intersect the rays of the later bounces in the order of their Morton codes,
+            // and scatter the hits back to the rays so that the rest of the stages see the queue as it is.
+            const auto reorders = reordersRays && bounceCount != 0;
+            if (reorders) {
+                const auto bounds = acceleration.structure->bvh().bounds;
+
+                keys.resize(queue.size());
+                dispatchChunks(queue.size(), [&](const std::size_t from, const std::size_t to) {
+                    for (auto i = from; i < to; i++) {
+                        keys[i] = mortonCodeOf(queue.rayAt(i), bounds);
+                    }
+                });
+
+                sortByKeys(keys, bins, order);
+            }
+
+            hits.resize(queue.size());
+            keys.resize(queue.size());
+
+            dispatchChunks(queue.size(), [&](const std::size_t from, const std::size_t to) {
+                const auto countBefore = InstanceAccelerationStructure::intersectionCount();
+                const auto visitCountBefore = NodeVisits::onThread.count;
+                const auto missCountBefore = NodeVisits::onThread.missCount;
+
+                for (auto j = from; j < to; j++) {
+                    const auto i = reorders ? order[j] : j;
+
+                    const auto intersection = tracer.intersector.intersectAlong(queue.rayAt(i), 0xff);
+
+                    hits[i] = intersection.raw();
+                    keys[i] = intersection.has() ? intersection.pieceIndex() + 1 : 0;
+                }
+
+                rayCount += InstanceAccelerationStructure::intersectionCount() - countBefore;
+                nodeVisitCount += NodeVisits::onThread.count - visitCountBefore;
+                nodeMissCount += NodeVisits::onThread.missCount - missCountBefore;
+            });
+
+            if (bounceCount == 0) {
+                primaryRayCount += queue.size();
+            }
+
+            // Bin the rays by the piece that they have hit, so that each chunk shades a few materials in a row.
+            sortByKeys(keys, bins, order);
+
+            results.resize(queue.size());
+
+            dispatchChunks(queue.size(), [&](const std::size_t from, const std::size_t to) {
+                auto chunkTracer = tracer;
+
+                for (auto j = from; j < to; j++) {
+                    const auto i = order[j];
+                    const auto path = queue.paths[i];
+                    const auto pixel = paths.pixels[path];
+
+                    chunkTracer.sampler = Raytrace::Sampler::make(pixel, frame.id, paths.sampleIndices[path]);
+
+                    const auto intersection = Raytrace::Intersection(queue.rayAt(i), hits[i]);
+                    results[j] = chunkTracer.shade(intersection.ray(), queue.coneAt(i), intersection, bounceCount);
+
+                    // The primary ray never changes, so neither does what it hits first.
+                    if (bounceCount == 0 && chunkTracer.sampler.sampleIndex == 0) {
+                        albedoTexture.write(results[j].guide.albedoTexel(), pixel);
+                        normalDepthTexture.write(results[j].guide.normalDepthTexel(), pixel);
+                    }
+                }
+            });
+
+            // Trace the shadow rays of the bounce together, which only ask whether anything is in the way.
+            isOccluded.resize(queue.size());
+
+            dispatchChunks(queue.size(), [&](const std::size_t from, const std::size_t to) {
+                const auto countBefore = InstanceAccelerationStructure::occlusionCount();
+                const auto visitCountBefore = NodeVisits::onThread.shadowCount;
+
+                for (auto j = from; j < to; j++) {
+                    isOccluded[j] = results[j].hasShadowRay && tracer.intersector.occluded(results[j].shadowRay);
+                }
+
+                shadowRayCount += InstanceAccelerationStructure::occlusionCount() - countBefore;
+                shadowNodeVisitCount += NodeVisits::onThread.shadowCount - visitCountBefore;
+            });
+
+            goesOn.resize(queue.size());
+            nextQueue.resize(queue.size());
+
+            dispatchChunks(queue.size(), [&](const std::size_t from, const std::size_t to) {
+                auto chunkTracer = tracer;
+
+                for (auto j = from; j < to; j++) {
+                    const auto& result = results[j];
+                    const auto path = queue.paths[order[j]];
+
+                    chunkTracer.sampler = Raytrace::Sampler::make(paths.pixels[path], frame.id, paths.sampleIndices[path]);
+
+                    auto& color = paths.colors[path];
+                    color *= result.colorWith(isOccluded[j]);
+
+                    goesOn[j] = false;
+
+                    if (!result.hasIncident) {
+                        continue;
+                    }
+
+                    if (!chunkTracer.survives(color, bounceCount)) {
+                        color = 0;
+                        continue;
+                    }
+
+                    // The path has reached the hard cap, beyond which the tracer counts the rest of it as 1.
+                    if (bounceCount + 1 >= maxTraceCount) {
+                        continue;
+                    }
+
+                    goesOn[j] = true;
+                    nextQueue.set(j, path, result.incidentRay, result.incidentCone);
+                }
+            });
+
+            // Compact the survivors into the next queue, keeping the order that they have been shaded in.
+            {
+                const auto chunkCount = (queue.size() + chunkSize - 1) / chunkSize;
+
+                offsets.assign(chunkCount + 1, 0);
+                pool.dispatch(chunkCount, [&](const std::size_t chunk) {
+                    const auto from = chunk * chunkSize;
+                    const auto to = std::min(from + chunkSize, queue.size());
+
+                    offsets[chunk + 1] = std::size_t(std::count(goesOn.begin() + from, goesOn.begin() + to, uint8_t(true)));
+                });
+
+                for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+                    offsets[chunk + 1] += offsets[chunk];
+                }
+
+                queue.resize(offsets.back());
+                pool.dispatch(chunkCount, [&](const std::size_t chunk) {
+                    auto k = offsets[chunk];
+
+                    const auto from = chunk * chunkSize;
+                    const auto to = std::min(from + chunkSize, goesOn.size());
+                    for (auto j = from; j < to; j++) {
+                        if (goesOn[j]) {
+                            queue.set(k++, nextQueue.paths[j], nextQueue.rayAt(j), nextQueue.coneAt(j));
+                        }
+                    }
+                });
+            }
+        }
+
+        // Add the samples of each pixel in order, as the kernel does.
+        pool.dispatch(lastTile - firstTile, [&](const std::size_t i) {
+            const auto tile = tileAt(firstTile + i);
+
+            auto path = pathOffsets[i];
+            for (uint y = tile.origin.y; y < tile.end.y; y++) {
+                for (uint x = tile.origin.x; x < tile.end.x; x++) {
+                    auto sum = Raytrace::Accumulation::from(accumulationTexture.read(uint2(x, y)), tile.accumulatedCount);
+                    for (uint32_t s = 0; s < tile.sampleCount; s++, path++) {
+                        sum = sum.adding(paths.colors[path]);
+                    }
+
+                    accumulationTexture.write(sum.toTexel(), uint2(x, y));
+                    targetTexture.write(float4(sum.mean, 1), uint2(x, y));
+                }
+            }
+        });
+
+        firstTile = lastTile;
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+
+    return {
+        .rayCount = rayCount,
+        .seconds = std::chrono::duration<double>(end - start).count(),
+        .primaryRayCount = primaryRayCount,
+        .nodeVisitCount = nodeVisitCount,
+        .nodeMissCount = nodeMissCount,
+        .shadowRayCount = shadowRayCount,
+        .shadowNodeVisitCount = shadowNodeVisitCount,
+    };
+}
+}
@@ -0,0 +1,201 @@
+// tomocy
+
+#include "Host+Raytracer.h"
+#include "../App/Raytrace/Raytrace+Raytrace.metal"
+#include "Host+Packet.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace Host {
+Raytracer::Raytracer(const uint2 resolution)
+    : target({
+        .resolution = resolution,
+        .texture = Texture<float>::make2D(resolution, false),
+    })
+    , accumulation(Texture<float>::make2D(resolution, false))
+    , albedo(Texture<float>::make2D(resolution, false))
+    , normalDepth(Texture<float>::make2D(resolution, false))
+{
+}
+
+Raytracer::Stats Raytracer::encode(
+    Pool& pool,
+    const Raytrace::Frame& frame,
+    const Schedule& schedule,
+    const Background& background,
+    const Env& env,
+    Acceleration& acceleration
+)
+{
+    if (tracesInWavefronts) {
+        return encodeInWavefronts(pool, frame, schedule, background, env, acceleration);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    auto args = Raytrace::Args {
+        .target = target.texture.as2D<metal::access::write>(),
+        .accumulation = accumulation.as2D<metal::access::read_write>(),
+        .schedule = schedule.texture().as2D(),
+        .albedo = albedo.as2D<metal::access::write>(),
+        .normalDepth = normalDepth.as2D<metal::access::write>(),
+        .frame = frame,
+        .maxTraceCount = maxTraceCount,
+        .background = background.forShader(),
+        .env = env.forShader(),
+        .acceleration = acceleration.forShader(),
+    };
+
+    // Dispatch a group for each tile that has samples in the schedule, so that converged tiles cost nothing.
+    const auto threadsSizePerGroup = uint2(Raytrace::Accumulation::tileSize);
+    const auto tiles = schedule.activeTiles();
+    const auto tileCount = schedule.tileCount();
+
+    // Each task takes the active tiles in a square of taskSize pixels, in the order of the schedule.
+    const auto tilesPerTask = std::max((taskSize + threadsSizePerGroup.x - 1) / threadsSizePerGroup.x, 1u);
+    const auto taskCount = (tileCount + tilesPerTask - 1) / tilesPerTask;
+
+    std::vector<std::vector<std::size_t>> tasks(std::size_t(taskCount.x) * taskCount.y);
+    for (const auto tile : tiles) {
+        const auto task = uint2(uint(tile % tileCount.x), uint(tile / tileCount.x)) / tilesPerTask;
+        tasks[std::size_t(task.y) * taskCount.x + task.x].push_back(tile);
+    }
+
+    std::erase_if(tasks, [](const auto& task) { return task.empty(); });
+
+    std::atomic<uint64_t> rayCount = 0;
+    std::atomic<uint64_t> primaryRayCount = 0;
+    std::atomic<uint64_t> nodeVisitCount = 0;
+    std::atomic<uint64_t> nodeMissCount = 0;
+    std::atomic<uint64_t> shadowRayCount = 0;
+    std::atomic<uint64_t> shadowNodeVisitCount = 0;
+
+    // Primary rays of neighboring pixels are coherent, so bundle them into a packet of 8x1 or 4x2 with 8 lanes,
+    // or 2x2 with 4 lanes, intersect them together, and hand the results to the kernel.
+    const auto packets = tracesPrimaryInPackets
+        ? std::make_optional<PacketIntersector>(*acceleration.structure)
+        : std::nullopt;
+    const auto bundleSize = PacketIntersector::width() == 8 ? uint2(4, 2) : uint2(2, 2);
+
+    // Returns how many rays the packet has intersected.
+    const auto computeBundle = [&](const uint2 from, const uint2 to) {
+        // The same camera as the kernel, so that the rays match exactly.
+        const auto camera = Raytrace::Camera::make();
+
+        auto packet = RayPacket();
+        uint2 ids[RayPacket::maxSize];
+        metal::raytracing::ray rays[RayPacket::maxSize];
+
+        for (uint y = from.y; y < to.y; y++) {
+            for (uint x = from.x; x < to.x; x++) {
+                const auto lane = packet.size++;
+
+                ids[lane] = uint2(x, y);
+                rays[lane] = camera.rayAt(Shader::Coordinate::InScreen(ids[lane]), target.resolution);
+                packet.set(lane, rays[lane]);
+            }
+        }
+
+        metal::raytracing::intersection_result results[RayPacket::maxSize];
+        packets->intersect(packet, 0xff, results);
+
+        for (std::size_t lane = 0; lane < packet.size; lane++) {
+            Raytrace::computeWith(ids[lane], args, Raytrace::Intersection(rays[lane], results[lane]));
+        }
+
+        return packet.size;
+    };
+
+    pool.dispatch(
+        tasks.size(),
+        [&](const std::size_t i) {
+            const auto countBefore = InstanceAccelerationStructure::intersectionCount();
+            const auto visitCountBefore = NodeVisits::onThread.count;
+            const auto missCountBefore = NodeVisits::onThread.missCount;
+            const auto occlusionCountBefore = InstanceAccelerationStructure::occlusionCount();
+            const auto shadowVisitCountBefore = NodeVisits::onThread.shadowCount;
+
+            // The rays of the packets, which are intersected without the single-ray counter.
+            auto packetRayCount = std::size_t(0);
+
+            // Every pixel of an active tile intersects its primary ray once, either way.
+            auto pixelCount = std::size_t(0);
+
+            for (const auto tile : tasks[i]) {
+                const auto group = uint2(uint(tile % tileCount.x), uint(tile / tileCount.x));
+                const auto origin = group * threadsSizePerGroup;
+
+                const auto end = metal::min(origin + threadsSizePerGroup, target.resolution);
+                pixelCount += std::size_t(end.x - origin.x) * (end.y - origin.y);
+
+                if (!packets) {
+                    for (uint y = origin.y; y < end.y; y++) {
+                        for (uint x = origin.x; x < end.x; x++) {
+                            Raytrace::compute(uint2(x, y), args);
+                        }
+                    }
+                } else {
+                    for (uint y = origin.y; y < end.y; y += bundleSize.y) {
+                        for (uint x = origin.x; x < end.x; x += bundleSize.x) {
+                            packetRayCount += computeBundle(uint2(x, y), metal::min(uint2(x, y) + bundleSize, end));
+                        }
+                    }
+                }
+            }
+
+            rayCount += InstanceAccelerationStructure::intersectionCount() - countBefore + packetRayCount;
+            primaryRayCount += pixelCount;
+            nodeVisitCount += NodeVisits::onThread.count - visitCountBefore;
+            nodeMissCount += NodeVisits::onThread.missCount - missCountBefore;
+            shadowRayCount += InstanceAccelerationStructure::occlusionCount() - occlusionCountBefore;
+            shadowNodeVisitCount += NodeVisits::onThread.shadowCount - shadowVisitCountBefore;
+        }
+    );
+
+    const auto end = std::chrono::steady_clock::now();
+
+    return {
+        .rayCount = rayCount,
+        .seconds = std::chrono::duration<double>(end - start).count(),
+        .primaryRayCount = primaryRayCount,
+        .nodeVisitCount = nodeVisitCount,
+        .nodeMissCount = nodeMissCount,
+        .shadowRayCount = shadowRayCount,
+        .shadowNodeVisitCount = shadowNodeVisitCount,
+    };
+}
+
+Convergence Raytracer::measure(Pool& pool, const Schedule& schedule) const
+{
+    const auto tileCount = schedule.tileCount();
+
+    const auto errors = Texture<float>::make2D(tileCount, false);
+
+    auto args = Raytrace::Measure::Args {
+        .accumulation = accumulation.as2D(),
+        .schedule = schedule.texture().as2D(),
+        .errors = errors.as2D<metal::access::write>(),
+    };
+
+    pool.dispatch(std::size_t(tileCount.x) * tileCount.y, [&](const std::size_t i) {
+        Raytrace::Measure::compute(uint2(uint(i % tileCount.x), uint(i / tileCount.x)), args);
+    });
+
+    auto convergence = Convergence {
+        .resolution = target.resolution,
+        .tileCount = tileCount,
+        .errors = {},
+    };
+
+    convergence.errors.reserve(errors.texels().levels[0].texels.size());
+    for (const auto& texel : errors.texels().levels[0].texels) {
+        convergence.errors.push_back(texel.r);
+    }
+
+    return convergence;
+}
+}
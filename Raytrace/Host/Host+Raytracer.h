@@ -0,0 +1,120 @@
+// tomocy
+
+#pragma once
+
+#include "../App/Raytrace/Raytrace+Accumulation.h"
+#include "../App/Raytrace/Raytrace+Frame.h"
+#include "Host+Acceleration.h"
+#include "Host+Background.h"
+#include "Host+Env.h"
+#include "Host+Pool.h"
+#include "Host+Schedule.h"
+#include "Host+Texture.h"
+#include <cstdint>
+#include <metal_stdlib>
+
+namespace Host {
+// Raytracer runs Raytrace::compute over the target on a pool, like Raytrace.Raytrace does on a GPU.
+class Raytracer {
+public:
+    struct Target {
+    public:
+        uint2 resolution;
+        Texture<float> texture;
+    };
+
+    struct Stats {
+    public:
+        double raysPerSecond() const { return seconds > 0 ? double(rayCount) / seconds : 0; }
+
+    public:
+        Stats& operator+=(const Stats& other)
+        {
+            rayCount += other.rayCount;
+            primaryRayCount += other.primaryRayCount;
+            seconds += other.seconds;
+            nodeVisitCount += other.nodeVisitCount;
+            nodeMissCount += other.nodeMissCount;
+            shadowRayCount += other.shadowRayCount;
+            shadowNodeVisitCount += other.shadowNodeVisitCount;
+            return *this;
+        }
+
+    public:
+        uint64_t rayCount = 0;
+        double seconds = 0;
+
+        // The camera rays among the rays above. The kernel intersects one for each pixel in a pass,
+        // which every sample of the pixel shares, while wavefronts trace one for each sample.
+        uint64_t primaryRayCount = 0;
+
+        // The nodes that the rays traced one at a time have visited, and missed in the cache of NodeVisits,
+        // which stay 0 unless NodeVisits is enabled.
+        uint64_t nodeVisitCount = 0;
+        uint64_t nodeMissCount = 0;
+
+        // The shadow rays, which the rays above do not count, and the nodes that they have visited,
+        // which the visits above do.
+        uint64_t shadowRayCount = 0;
+        uint64_t shadowNodeVisitCount = 0;
+    };
+
+public:
+    explicit Raytracer(const uint2 resolution);
+
+public:
+    // Adds the samples of the schedule to the tiles that it gives them to.
+    Stats encode(
+        Pool& pool,
+        const Raytrace::Frame& frame,
+        const Schedule& schedule,
+        const Background& background,
+        const Env& env,
+        Acceleration& acceleration
+    );
+
+    // Measures the noise of the accumulation, once the schedule has been encoded.
+    Convergence measure(Pool& pool, const Schedule& schedule) const;
+
+public:
+    Target target;
+
+    // The running mean and variance of the samples of each pixel over the passes, see Raytrace::Accumulation.
+    Texture<float> accumulation;
+
+    // What the primary ray of each pixel hits first, for Denoiser, see Raytrace::Denoise::Guide.
+    Texture<float> albedo;
+    Texture<float> normalDepth;
+
+    // The hard cap of the rays of a path, see Raytrace::Tracer.
+    uint32_t maxTraceCount = 3;
+
+    // The pixels on a side of the square that each task of the pool traces in the kernel,
+    // which covers whole tiles of the schedule, so it is rounded up to a multiple of Raytrace::Accumulation::tileSize.
+    uint32_t taskSize = Raytrace::Accumulation::tileSize;
+
+    // Whether to intersect primary rays in packets of PacketIntersector::width() pixels ahead of the kernel.
+    bool tracesPrimaryInPackets = true;
+
+    // Whether to trace the paths in wavefronts instead of the kernel, see encodeInWavefronts.
+    bool tracesInWavefronts = false;
+
+    // Whether the wavefronts sort the rays of the bounces after the first by a Morton code of their origins and directions,
+    // so that rays which start and go close to each other are intersected one after another.
+    bool reordersRays = false;
+
+private:
+    // Runs the stages of Raytrace::Tracer over queues of rays, so that each stage runs the same code for every ray:
+    // it generates the camera rays of all the samples of a batch of tiles, reorders them if reordersRays, intersects them,
+    // bins them by the piece that they have hit, shades them in that order and compacts the rays that go on into the next queue,
+    // bounce by bounce until no ray is left.
+    Stats encodeInWavefronts(
+        Pool& pool,
+        const Raytrace::Frame& frame,
+        const Schedule& schedule,
+        const Background& background,
+        const Env& env,
+        Acceleration& acceleration
+    );
+};
+}
@@ -0,0 +1,100 @@
+// tomocy
+
+#pragma once
+
+#include <cstdint>
+
+// This header is included by the translation units of each instruction set.
+// Everything in it has internal linkage, so that code compiled for AVX2 never leaks into the others.
+
+namespace Host {
+namespace SIMD {
+namespace {
+// The vector extensions of GCC and Clang compile to the lanes of the instruction set of each translation unit.
+template <int N>
+struct Vectors;
+
+template <>
+struct Vectors<4> {
+public:
+    typedef float Float __attribute__((vector_size(16)));
+    typedef int32_t Int __attribute__((vector_size(16)));
+};
+
+template <>
+struct Vectors<8> {
+public:
+    typedef float Float __attribute__((vector_size(32)));
+    typedef int32_t Int __attribute__((vector_size(32)));
+};
+
+template <int N>
+struct Lanes {
+public:
+    using Float = typename Vectors<N>::Float;
+    using Int = typename Vectors<N>::Int;
+
+public:
+    static Float splat(const float value)
+    {
+        Float v = {};
+        return v + value;
+    }
+
+    static Int splat(const int32_t value)
+    {
+        Int v = {};
+        return v + value;
+    }
+
+    static Float load(const float* values)
+    {
+        Float v;
+        __builtin_memcpy(&v, values, sizeof(v));
+        return v;
+    }
+
+    static void store(const Float v, float* values) { __builtin_memcpy(values, &v, sizeof(v)); }
+    static void store(const Int v, int32_t* values) { __builtin_memcpy(values, &v, sizeof(v)); }
+
+    static Float min(const Float a, const Float b) { return a < b ? a : b; }
+    static Float max(const Float a, const Float b) { return a > b ? a : b; }
+    static Float abs(const Float v) { return v < 0 ? -v : v; }
+
+    // e^x to about 6 digits for x <= 0, as the vector extensions have no exp.
+    static Float exp(const Float x)
+    {
+        // Split x / ln 2 into an integer n and f in -0.5...0.5, as e^x = 2^n * 2^f.
+        const auto t = max(x, splat(-87.0f)) * 1.44269504f + 0.5f;
+        auto n = __builtin_convertvector(t, Int);
+        n += __builtin_convertvector(n, Float) > t;
+
+        const auto f = t - 0.5f - __builtin_convertvector(n, Float);
+
+        // Taylor series of 2^f.
+        auto p = splat(1.33335581e-3f);
+        p = p * f + 9.61812911e-3f;
+        p = p * f + 5.55041087e-2f;
+        p = p * f + 2.40226507e-1f;
+        p = p * f + 6.93147181e-1f;
+        p = p * f + 1.0f;
+
+        const auto bits = (n + 127) << 23;
+
+        Float scale;
+        __builtin_memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+    static bool any(const Int mask)
+    {
+        auto result = 0;
+        for (int i = 0; i < N; i++) {
+            result |= mask[i];
+        }
+        return result != 0;
+    }
+};
+}
+}
+}
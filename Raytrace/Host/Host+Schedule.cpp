@@ -0,0 +1,165 @@
+// tomocy
+
+#include "Host+Schedule.h"
+#include "../App/Raytrace/Raytrace+Accumulation.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Host {
+namespace {
+// The end of the region within the resolution, where the size may be as large as UINT32_MAX to mean the rest of it.
+uint2 endOf(const uint2 origin, const uint2 size, const uint2 resolution)
+{
+    const auto from = metal::min(origin, resolution);
+    return from + metal::min(size, resolution - from);
+}
+}
+
+float Convergence::errorIn(const uint2 origin, const uint2 size) const
+{
+    const auto tileSize = uint2(Raytrace::Accumulation::tileSize);
+
+    const auto from = metal::min(origin / tileSize, tileCount);
+    const auto to = metal::min((endOf(origin, size, resolution) + tileSize - 1) / tileSize, tileCount);
+
+    auto error = 0.0f;
+    for (auto y = from.y; y < to.y; y++) {
+        for (auto x = from.x; x < to.x; x++) {
+            error = std::max(error, errors[std::size_t(y) * tileCount.x + x]);
+        }
+    }
+
+    return error;
+}
+}
+
+namespace Host {
+Schedule::Schedule(const uint2 resolution, const Options& options)
+    : resolution_(resolution)
+    , options_(options)
+    , tileCount_((resolution + Raytrace::Accumulation::tileSize - 1) / Raytrace::Accumulation::tileSize)
+    , counts_(std::size_t(tileCount_.x) * tileCount_.y, 0)
+    , budgets_(counts_.size(), 0)
+    , texture_(Texture<uint32_t>::make2D(tileCount_, false))
+{
+    // Every tile needs a few samples before its error means anything.
+    const auto first = options_.threshold > 0 ? Raytrace::Accumulation::minCount : 1;
+    std::fill(budgets_.begin(), budgets_.end(), std::min(first, options_.maxCount));
+
+    write();
+}
+
+bool Schedule::advance(const Convergence& convergence)
+{
+    const auto tileSize = Raytrace::Accumulation::tileSize;
+
+    const auto regionFrom = options_.regionOrigin / tileSize;
+    const auto regionTo = (endOf(options_.regionOrigin, options_.regionSize, resolution_) + tileSize - 1) / tileSize;
+
+    for (std::size_t i = 0; i < counts_.size(); i++) {
+        counts_[i] += budgets_[i];
+
+        const auto count = counts_[i];
+        auto& budget = budgets_[i];
+
+        if (count >= options_.maxCount) {
+            budget = 0;
+            continue;
+        }
+
+        if (options_.threshold <= 0) {
+            budget = 1;
+            continue;
+        }
+
+        const auto tile = uint2(uint(i % tileCount_.x), uint(i / tileCount_.x));
+        const auto isInRegion = tile.x >= regionFrom.x && tile.x < regionTo.x
+            && tile.y >= regionFrom.y && tile.y < regionTo.y;
+
+        const auto error = convergence.errors[i];
+        if (!isInRegion || error < options_.threshold) {
+            budget = 0;
+            continue;
+        }
+
+        // The error falls with the square root of the count, which tells how many samples the tile still needs.
+        // Cap them per pass, as the estimate of the error is noisy itself.
+        const auto ratio = double(error) / options_.threshold;
+        const auto needed = std::isfinite(ratio) ? std::ceil(double(count) * ratio * ratio) : double(UINT32_MAX);
+        const auto more = uint32_t(std::clamp(needed - double(count), 1.0, double(options_.maxCountPerPass)));
+
+        budget = std::min(more, options_.maxCount - count);
+    }
+
+    write();
+
+    return hasWork();
+}
+
+bool Schedule::hasWork() const
+{
+    return std::any_of(budgets_.begin(), budgets_.end(), [](const uint32_t budget) { return budget != 0; });
+}
+
+std::vector<std::size_t> Schedule::activeTiles() const
+{
+    auto tiles = std::vector<std::size_t>();
+
+    for (std::size_t i = 0; i < budgets_.size(); i++) {
+        if (budgets_[i] != 0) {
+            tiles.push_back(i);
+        }
+    }
+
+    return tiles;
+}
+
+Texture<float> Schedule::heatmap() const
+{
+    auto texture = Texture<float>::make2D(resolution_, false);
+
+    const auto maxCount = std::max<uint32_t>(*std::max_element(counts_.begin(), counts_.end()), 1);
+
+    for (uint y = 0; y < resolution_.y; y++) {
+        for (uint x = 0; x < resolution_.x; x++) {
+            const auto tile = uint2(x, y) / Raytrace::Accumulation::tileSize;
+            const auto t = float(counts_[std::size_t(tile.y) * tileCount_.x + tile.x]) / float(maxCount);
+
+            // Blue for the fewest samples through green to red for the most.
+            const auto color = float3(
+                metal::saturate(1.5f - std::fabs(4 * t - 3)),
+                metal::saturate(1.5f - std::fabs(4 * t - 2)),
+                metal::saturate(1.5f - std::fabs(4 * t - 1))
+            );
+
+            texture.texels().at(uint2(x, y), 0, 0) = float4(color, 1);
+        }
+    }
+
+    return texture;
+}
+
+uint64_t Schedule::sampleCount() const
+{
+    const auto tileSize = Raytrace::Accumulation::tileSize;
+
+    auto count = uint64_t(0);
+    for (std::size_t i = 0; i < counts_.size(); i++) {
+        const auto origin = uint2(uint(i % tileCount_.x), uint(i / tileCount_.x)) * tileSize;
+        const auto size = metal::min(origin + tileSize, resolution_) - origin;
+
+        count += uint64_t(counts_[i]) * size.x * size.y;
+    }
+
+    return count;
+}
+
+void Schedule::write()
+{
+    auto& texels = texture_.texels().levels[0].texels;
+
+    for (std::size_t i = 0; i < counts_.size(); i++) {
+        texels[i] = metal::vec<uint32_t, 4>(counts_[i], budgets_[i], 0, 0);
+    }
+}
+}
@@ -0,0 +1,85 @@
+// tomocy
+
+#pragma once
+
+#include "Host+Texture.h"
+#include <cstddef>
+#include <cstdint>
+#include <metal_stdlib>
+#include <vector>
+
+namespace Host {
+// Convergence is the noise of the accumulation by tiles of Raytrace::Accumulation::tileSize pixels,
+// as the relative standard error of the mean luminance of their pixels.
+struct Convergence {
+public:
+    // The error of the noisiest tile which overlaps the region, in pixels.
+    float errorIn(const uint2 origin, const uint2 size) const;
+
+    float error() const { return errorIn(0, resolution); }
+
+public:
+    uint2 resolution;
+    uint2 tileCount;
+    std::vector<float> errors;
+};
+}
+
+namespace Host {
+// Schedule gives each tile of Raytrace::Accumulation::tileSize pixels a budget of samples for the next pass,
+// only sending them to the tiles whose error is still above the threshold.
+class Schedule {
+public:
+    struct Options {
+    public:
+        // Tiles get samples until their error falls below this, or uniformly up to maxCount if it is not positive.
+        float threshold = 0;
+
+        uint32_t maxCount = 1;
+        uint32_t maxCountPerPass = 16;
+
+        // Only the tiles which overlap the region get more samples than it takes to measure them.
+        uint2 regionOrigin = 0;
+        uint2 regionSize = UINT32_MAX;
+    };
+
+public:
+    Schedule(const uint2 resolution, const Options& options);
+
+public:
+    // Adds the budgets of the pass that has just been encoded to the counts and plans the next pass from its convergence.
+    // It returns whether any tile gets samples in the next pass.
+    bool advance(const Convergence& convergence);
+
+public:
+    bool hasWork() const;
+
+    // The tiles with samples in the next pass, as indices of tiles in rows.
+    std::vector<std::size_t> activeTiles() const;
+
+    // The samples that each tile has accumulated so far, as a color ramp at the resolution, for debugging.
+    Texture<float> heatmap() const;
+
+public:
+    uint2 tileCount() const { return tileCount_; }
+
+    // The samples accumulated so far (r) and for the next pass (g) of each tile, for Raytrace::Args::schedule.
+    const Texture<uint32_t>& texture() const { return texture_; }
+
+    // The total samples that the tiles have accumulated so far, counting each pixel.
+    uint64_t sampleCount() const;
+
+private:
+    void write();
+
+private:
+    uint2 resolution_;
+    Options options_;
+
+    uint2 tileCount_;
+    std::vector<uint32_t> counts_;
+    std::vector<uint32_t> budgets_;
+
+    Texture<uint32_t> texture_;
+};
+}
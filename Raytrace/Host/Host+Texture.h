@@ -0,0 +1,151 @@
+// tomocy
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <metal_stdlib>
+
+namespace Host {
+// Texture owns texels on the host while shaders only see handles to them, like MTLTexture.
+template <typename T = float>
+class Texture {
+public:
+    using Texels = metal::detail::Texels<T>;
+
+public:
+    static Texture make2D(const uint2 size, const bool mipmapped)
+    {
+        return make(size, 1, mipmapped ? UINT32_MAX : 1);
+    }
+
+    // Up to maxLevelCount levels when mipmapped, instead of halving down to a texel.
+    static Texture makeCube(const uint size, const bool mipmapped, const uint maxLevelCount = UINT32_MAX)
+    {
+        return make(uint2(size, size), 6, mipmapped ? maxLevelCount : 1);
+    }
+
+    static Texture fill(const metal::vec<T, 4> color)
+    {
+        auto texture = make2D(uint2(1, 1), false);
+        texture.texels().levels[0].texels[0] = color;
+
+        return texture;
+    }
+
+private:
+    static Texture make(const uint2 size, const uint faceCount, const uint maxLevelCount)
+    {
+        auto raw = std::make_shared<Texels>();
+        raw->faceCount = faceCount;
+
+        auto levelSize = size;
+        while (true) {
+            raw->levels.push_back({
+                .width = levelSize.x,
+                .height = levelSize.y,
+                .texels = std::vector<metal::vec<T, 4>>(std::size_t(levelSize.x) * levelSize.y * faceCount, T(0)),
+            });
+
+            if (raw->levels.size() >= maxLevelCount || (levelSize.x == 1 && levelSize.y == 1)) {
+                break;
+            }
+
+            levelSize = uint2(std::max(levelSize.x / 2, 1u), std::max(levelSize.y / 2, 1u));
+        }
+
+        return Texture(raw);
+    }
+
+public:
+    Texture() = default;
+
+    explicit Texture(std::shared_ptr<Texels> raw)
+        : raw_(raw)
+    {
+    }
+
+public:
+    bool has() const { return raw_ != nullptr; }
+
+    Texels& texels() const { return *raw_; }
+
+    uint width(const uint lod = 0) const { return raw_->levels[lod].width; }
+    uint height(const uint lod = 0) const { return raw_->levels[lod].height; }
+    uint levelCount() const { return uint(raw_->levels.size()); }
+    uint faceCount() const { return raw_->faceCount; }
+
+public:
+    template <metal::access Access = metal::access::sample>
+    metal::texture2d<T, Access> as2D() const
+    {
+        return metal::texture2d<T, Access>(raw_.get());
+    }
+
+    template <metal::access Access = metal::access::sample>
+    metal::texturecube<T, Access> asCube() const
+    {
+        return metal::texturecube<T, Access>(raw_.get());
+    }
+
+public:
+    // Copies the base level into a full pyramid of mipmaps laid out in tiles (see Texels::tile),
+    // for textures that rays hit all over and sample by their footprint, such as those of materials.
+    Texture tiled() const
+    {
+        if (!has() || raw_->isTiled()) {
+            return *this;
+        }
+
+        auto texture = make(uint2(width(), height()), faceCount(), UINT32_MAX);
+
+        for (uint face = 0; face < faceCount(); face++) {
+            for (uint y = 0; y < height(); y++) {
+                for (uint x = 0; x < width(); x++) {
+                    texture.texels().at(uint2(x, y), face, 0) = raw_->at(uint2(x, y), face, 0);
+                }
+            }
+        }
+
+        texture.generateMipmaps();
+        texture.texels().tile();
+
+        return texture;
+    }
+
+public:
+    // Fills every level below the base one by averaging 2x2 texels of the level above.
+    void generateMipmaps()
+    {
+        for (uint lod = 1; lod < levelCount(); lod++) {
+            const auto& above = raw_->levels[lod - 1];
+            auto& level = raw_->levels[lod];
+
+            for (uint face = 0; face < faceCount(); face++) {
+                for (uint y = 0; y < level.height; y++) {
+                    for (uint x = 0; x < level.width; x++) {
+                        metal::vec<T, 4> sum = T(0);
+                        uint count = 0;
+
+                        for (uint dy = 0; dy < 2; dy++) {
+                            for (uint dx = 0; dx < 2; dx++) {
+                                const auto ax = std::min(x * 2 + dx, above.width - 1);
+                                const auto ay = std::min(y * 2 + dy, above.height - 1);
+
+                                sum += raw_->at(uint2(ax, ay), face, lod - 1);
+                                count++;
+                            }
+                        }
+
+                        raw_->at(uint2(x, y), face, lod) = sum / metal::vec<T, 4>(T(count));
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<Texels> raw_;
+};
+}
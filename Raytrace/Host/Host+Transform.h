@@ -0,0 +1,83 @@
+// tomocy
+
+#pragma once
+
+#include <metal_stdlib>
+
+namespace Host {
+struct Transform {
+public:
+    // Matrix is an affine transform in 4 columns of 3 rows, like MTLPackedFloat4x3.
+    struct Matrix {
+    public:
+        static Matrix identity()
+        {
+            return {
+                .columns = {
+                    float3(1, 0, 0),
+                    float3(0, 1, 0),
+                    float3(0, 0, 1),
+                    float3(0, 0, 0),
+                },
+            };
+        }
+
+    public:
+        float3 apply(const float3 point) const
+        {
+            return columns[0] * point.x + columns[1] * point.y + columns[2] * point.z + columns[3];
+        }
+
+        float3 applyToDirection(const float3 direction) const
+        {
+            return columns[0] * direction.x + columns[1] * direction.y + columns[2] * direction.z;
+        }
+
+    public:
+        Matrix inverse() const
+        {
+            const auto& a = columns[0];
+            const auto& b = columns[1];
+            const auto& c = columns[2];
+
+            const auto r0 = metal::cross(b, c);
+            const auto r1 = metal::cross(c, a);
+            const auto r2 = metal::cross(a, b);
+
+            const auto invDet = 1 / metal::dot(a, r0);
+
+            Matrix inverse = {
+                .columns = {
+                    float3(r0.x, r1.x, r2.x) * invDet,
+                    float3(r0.y, r1.y, r2.y) * invDet,
+                    float3(r0.z, r1.z, r2.z) * invDet,
+                    0,
+                },
+            };
+            inverse.columns[3] = -inverse.applyToDirection(columns[3]);
+
+            return inverse;
+        }
+
+    public:
+        float3 columns[4];
+    };
+
+public:
+    Matrix resolve() const
+    {
+        return {
+            .columns = {
+                float3(scale.x, 0, 0),
+                float3(0, scale.y, 0),
+                float3(0, 0, scale.z),
+                translate,
+            },
+        };
+    }
+
+public:
+    float3 translate = 0;
+    float3 scale = 1;
+};
+}
@@ -0,0 +1,439 @@
+// tomocy
+
+#include "Host+WideBVH.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace Host {
+namespace {
+// Bump this whenever the layout of the file or of WideBVH::Node changes.
+constexpr uint32_t fileVersion = 1;
+
+struct FileHeader {
+public:
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+
+    uint64_t nodeCount;
+    uint64_t indexCount;
+    float bounds[6];
+
+    uint64_t boxCount;
+    uint64_t leafCount;
+    uint64_t depth;
+};
+
+constexpr char fileMagic[4] = { 'W', 'B', 'V', 'H' };
+
+bool quantizeAxis(
+    WideBVH::Node& node,
+    const int axis,
+    const int8_t exponent,
+    const BVH::Box* boxes,
+    const std::size_t count
+)
+{
+    node.exponents[axis] = exponent;
+
+    const auto origin = node.origin[axis];
+    const auto scale = WideBVH::Node::scaleOf(exponent);
+
+    // q * scale is exact for a power of 2, so this is what Node::boxOf decodes whether it fuses or not.
+    const auto decode = [&](const int q) { return origin + float(q) * scale; };
+
+    for (std::size_t i = 0; i < count; i++) {
+        const auto& box = boxes[i];
+
+        auto low = int(std::clamp(std::floor((box.min[axis] - origin) / scale), 0.0f, 255.0f));
+        while (low > 0 && decode(low) > box.min[axis]) {
+            low--;
+        }
+
+        auto high = int(std::clamp(std::ceil((box.max[axis] - origin) / scale), 0.0f, 255.0f));
+        while (high < 255 && decode(high) < box.max[axis]) {
+            high++;
+        }
+
+        if (decode(low) > box.min[axis] || decode(high) < box.max[axis]) {
+            return false;
+        }
+
+        node.mins[axis][i] = uint8_t(low);
+        node.maxs[axis][i] = uint8_t(high);
+    }
+
+    return true;
+}
+
+// Quantizes the boxes of the children of the node into the bounds, leaving what they point at as it is.
+void quantize(WideBVH::Node& node, const BVH::Box& bounds, const BVH::Box* boxes, const std::size_t count)
+{
+    node.origin = bounds.min;
+    node.childCount = uint8_t(count);
+
+    for (int axis = 0; axis < 3; axis++) {
+        // Start from the smallest exponent that spans the extent in fewer than 255 steps,
+        // and give up precision until rounding lets every child fit.
+        auto exponent = -126;
+        const auto extent = bounds.max[axis] - bounds.min[axis];
+        if (extent > 0) {
+            std::frexp(extent / 254, &exponent);
+            exponent = std::clamp(exponent, -126, 127);
+        }
+
+        while (!quantizeAxis(node, axis, int8_t(exponent), boxes, count) && exponent < 127) {
+            exponent++;
+        }
+    }
+}
+
+class Collapser {
+public:
+    Collapser(const BVH& binary, WideBVH& wide)
+        : binary_(binary)
+        , wide_(wide)
+    {
+    }
+
+public:
+    void collapse()
+    {
+        if (binary_.nodes.empty()) {
+            return;
+        }
+
+        // Every binary node but the leaves disappears into a wide one, which takes up to 3 of them.
+        wide_.nodes.reserve(binary_.stats.nodeCount / 3 + 1);
+
+        collapseNode(0, 1);
+    }
+
+public:
+    std::size_t depth() const { return depth_; }
+
+private:
+    uint32_t collapseNode(const uint32_t binaryI, const std::size_t depth)
+    {
+        depth_ = std::max(depth_, depth);
+
+        std::array<uint32_t, WideBVH::width> children;
+        std::size_t childCount = 0;
+
+        const auto& node = binary_.nodes[binaryI];
+        if (node.isLeaf()) {
+            // Only the root can be a leaf, which becomes the only child of a node.
+            children[childCount++] = binaryI;
+        } else {
+            children[childCount++] = node.first;
+            children[childCount++] = node.first + 1;
+        }
+
+        // Open the largest inner child until the node is full, as the larger a box is, the more rays reach it.
+        while (childCount < WideBVH::width) {
+            auto largest = childCount;
+            auto largestArea = -1.0f;
+
+            for (std::size_t i = 0; i < childCount; i++) {
+                const auto& child = binary_.nodes[children[i]];
+                if (child.isLeaf()) {
+                    continue;
+                }
+
+                const auto area = boxOf(child).area();
+                if (area > largestArea) {
+                    largest = i;
+                    largestArea = area;
+                }
+            }
+
+            if (largest == childCount) {
+                break;
+            }
+
+            const auto opened = binary_.nodes[children[largest]].first;
+            children[largest] = opened;
+            children[childCount++] = opened + 1;
+        }
+
+        const auto wideI = uint32_t(wide_.nodes.size());
+        wide_.nodes.emplace_back();
+
+        {
+            std::array<BVH::Box, WideBVH::width> boxes;
+            for (std::size_t i = 0; i < childCount; i++) {
+                boxes[i] = boxOf(binary_.nodes[children[i]]);
+            }
+
+            quantize(wide_.nodes[wideI], boxOf(node), boxes.data(), childCount);
+        }
+
+        for (std::size_t i = 0; i < childCount; i++) {
+            const auto& child = binary_.nodes[children[i]];
+
+            if (child.isLeaf()) {
+                if (child.count > UINT16_MAX) {
+                    throw std::runtime_error("too many boxes in a leaf of a BVH: " + std::to_string(child.count));
+                }
+
+                wide_.nodes[wideI].firsts[i] = child.first;
+                wide_.nodes[wideI].counts[i] = uint16_t(child.count);
+                continue;
+            }
+
+            // Collapsing the child grows the nodes, so index the node again afterwards.
+            const auto childI = collapseNode(children[i], depth + 1);
+
+            wide_.nodes[wideI].firsts[i] = childI;
+            wide_.nodes[wideI].counts[i] = 0;
+        }
+
+        return wideI;
+    }
+
+    static BVH::Box boxOf(const BVH::Node& node)
+    {
+        return {
+            .min = float3(node.min),
+            .max = float3(node.max),
+        };
+    }
+
+private:
+    const BVH& binary_;
+    WideBVH& wide_;
+
+    std::size_t depth_ = 0;
+};
+
+// Fits the boxes of the children of the node to the boxes from the leaves up, returning its bounds.
+BVH::Box refitNode(WideBVH& bvh, const uint32_t nodeI, const std::vector<BVH::Box>& boxes)
+{
+    auto& node = bvh.nodes[nodeI];
+
+    std::array<BVH::Box, WideBVH::width> children;
+    auto bounds = BVH::Box();
+
+    for (std::size_t i = 0; i < node.childCount; i++) {
+        children[i] = BVH::Box();
+
+        if (node.isLeaf(i)) {
+            for (uint32_t j = 0; j < node.counts[i]; j++) {
+                children[i].grow(boxes[bvh.indices[node.firsts[i] + j]]);
+            }
+        } else {
+            children[i] = refitNode(bvh, node.firsts[i], boxes);
+        }
+
+        bounds.grow(children[i]);
+    }
+
+    quantize(node, bounds, children.data(), node.childCount);
+
+    return bounds;
+}
+
+// Tells whether the nodes only refer to nodes after themselves and to indices and boxes that exist,
+// and are no deeper than the stack of the traversal allows, so that a broken file can neither crash nor loop the traversal.
+bool isValid(const WideBVH& bvh, const std::size_t boxCount)
+{
+    // The depth of each node from the root, which the forward links let us find in a single pass.
+    std::vector<std::size_t> depths(bvh.nodes.size(), 0);
+    if (!depths.empty()) {
+        depths[0] = 1;
+    }
+
+    for (std::size_t nodeI = 0; nodeI < bvh.nodes.size(); nodeI++) {
+        const auto& node = bvh.nodes[nodeI];
+        if (node.childCount == 0 || node.childCount > WideBVH::width) {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < node.childCount; i++) {
+            const auto first = std::size_t(node.firsts[i]);
+            const auto count = std::size_t(node.counts[i]);
+
+            const auto isValid = node.isLeaf(i)
+                ? first + count <= bvh.indices.size()
+                : first > nodeI && first < bvh.nodes.size();
+            if (!isValid) {
+                return false;
+            }
+
+            if (!node.isLeaf(i)) {
+                depths[first] = std::max(depths[first], depths[nodeI] + 1);
+            }
+        }
+
+        // Each node on the way down leaves at most width - 1 of its children on the stack, see WideBVH::maxStackSize.
+        if (depths[nodeI] > BVH::maxDepth) {
+            return false;
+        }
+    }
+
+    return std::all_of(bvh.indices.begin(), bvh.indices.end(), [&](const uint32_t i) { return i < boxCount; });
+}
+}
+}
+
+namespace Host {
+WideBVH WideBVH::build(Pool& pool, const std::vector<BVH::Box>& boxes)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    auto wide = collapse(BVH::build(pool, boxes));
+
+    wide.stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return wide;
+}
+
+WideBVH WideBVH::collapse(BVH bvh)
+{
+    auto wide = WideBVH();
+
+    auto collapser = Collapser(bvh, wide);
+    collapser.collapse();
+
+    wide.indices = std::move(bvh.indices);
+    wide.bounds = bvh.bounds();
+
+    wide.stats = bvh.stats;
+    wide.stats.nodeCount = wide.nodes.size();
+    wide.stats.depth = collapser.depth();
+    wide.stats.bytes = wide.nodes.size() * sizeof(Node) + wide.indices.size() * sizeof(uint32_t);
+    wide.stats.bytesPerNode = sizeof(Node);
+
+    return wide;
+}
+}
+
+namespace Host {
+void WideBVH::refit(const std::vector<BVH::Box>& boxes)
+{
+    if (nodes.empty()) {
+        return;
+    }
+
+    bounds = refitNode(*this, 0, boxes);
+}
+
+float WideBVH::cost() const
+{
+    const auto rootArea = bounds.area();
+    if (nodes.empty() || rootArea <= 0) {
+        return 0;
+    }
+
+    // A ray that reaches a box tests the children of its node or the boxes of its leaf,
+    // and reaches it as often as the area of the box is to the one of the root.
+    auto cost = rootArea * nodes[0].childCount;
+
+    for (const auto& node : nodes) {
+        const auto scale = node.scale();
+
+        for (std::size_t i = 0; i < node.childCount; i++) {
+            const auto testCount = node.isLeaf(i) ? node.counts[i] : nodes[node.firsts[i]].childCount;
+            cost += node.boxOf(i, scale).area() * float(testCount);
+        }
+    }
+
+    return cost / rootArea;
+}
+}
+
+namespace Host {
+std::optional<WideBVH> WideBVH::load(const std::string& path, const uint64_t key, const std::size_t boxCount)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return std::nullopt;
+    }
+
+    auto header = FileHeader();
+    auto bvh = WideBVH();
+
+    auto isLoaded = std::fread(&header, sizeof(header), 1, file) == 1
+        && std::equal(std::begin(fileMagic), std::end(fileMagic), header.magic)
+        && header.version == fileVersion
+        && header.key == key
+        // Each box is in one leaf, and each node has at least one of them under itself,
+        // so the counts are bounded by the boxes before anything is allocated for them.
+        && header.boxCount == boxCount
+        && header.indexCount == boxCount
+        && header.nodeCount <= std::max<std::size_t>(boxCount, 1);
+
+    if (isLoaded) {
+        bvh.nodes.resize(header.nodeCount);
+        bvh.indices.resize(header.indexCount);
+
+        isLoaded = std::fread(bvh.nodes.data(), sizeof(Node), bvh.nodes.size(), file) == bvh.nodes.size()
+            && std::fread(bvh.indices.data(), sizeof(uint32_t), bvh.indices.size(), file) == bvh.indices.size()
+            && isValid(bvh, boxCount);
+    }
+
+    std::fclose(file);
+
+    if (!isLoaded) {
+        return std::nullopt;
+    }
+
+    bvh.bounds = {
+        .min = float3(header.bounds[0], header.bounds[1], header.bounds[2]),
+        .max = float3(header.bounds[3], header.bounds[4], header.bounds[5]),
+    };
+
+    bvh.stats.boxCount = header.boxCount;
+    bvh.stats.nodeCount = bvh.nodes.size();
+    bvh.stats.leafCount = header.leafCount;
+    bvh.stats.depth = header.depth;
+    bvh.stats.bytes = bvh.nodes.size() * sizeof(Node) + bvh.indices.size() * sizeof(uint32_t);
+    bvh.stats.bytesPerNode = sizeof(Node);
+    bvh.stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return bvh;
+}
+
+void WideBVH::save(const std::string& path, const uint64_t key) const
+{
+    auto header = FileHeader {
+        .magic = {},
+        .version = fileVersion,
+        .key = key,
+        .nodeCount = nodes.size(),
+        .indexCount = indices.size(),
+        .bounds = { bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z },
+        .boxCount = stats.boxCount,
+        .leafCount = stats.leafCount,
+        .depth = stats.depth,
+    };
+    std::copy(std::begin(fileMagic), std::end(fileMagic), header.magic);
+
+    // Name the temporary file after the process, so that renders sharing the cache never write into the same one.
+    const auto temporaryPath = path + "." + std::to_string(::getpid()) + ".tmp";
+
+    auto* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("failed to open: " + temporaryPath);
+    }
+
+    auto written = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(nodes.data(), sizeof(Node), nodes.size(), file) == nodes.size()
+        && std::fwrite(indices.data(), sizeof(uint32_t), indices.size(), file) == indices.size();
+
+    written = std::fclose(file) == 0 && written;
+
+    if (!written || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        throw std::runtime_error("failed to write: " + path);
+    }
+}
+}
@@ -0,0 +1,238 @@
+// tomocy
+
+#pragma once
+
+#include "Host+BVH.h"
+#include "Host+Pool.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <metal_stdlib>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Host {
+// WideBVH is a BVH collapsed to 4 children per node, where the boxes of the children are quantized to 8 bits
+// relative to their node, so that a node fits in a cache line.
+struct WideBVH {
+public:
+    static constexpr std::size_t width = 4;
+
+    // Node holds the boxes of its children, each of which is either another node at firsts[i],
+    // or a leaf with the indices of its boxes at indices[firsts[i]..<firsts[i] + counts[i]].
+    struct alignas(64) Node {
+    public:
+        bool isLeaf(const std::size_t i) const { return counts[i] != 0; }
+
+        // A child box is origin + q * 2^exponent on each axis, which always contains the box it was quantized from.
+        float3 scale() const { return float3(scaleOf(exponents[0]), scaleOf(exponents[1]), scaleOf(exponents[2])); }
+
+        BVH::Box boxOf(const std::size_t i, const float3 scale) const
+        {
+            return {
+                .min = float3(origin) + float3(mins[0][i], mins[1][i], mins[2][i]) * scale,
+                .max = float3(origin) + float3(maxs[0][i], maxs[1][i], maxs[2][i]) * scale,
+            };
+        }
+
+        static float scaleOf(const int8_t exponent)
+        {
+            // Build 2^exponent from its bits, as ldexp is too slow for the traversal.
+            const auto bits = uint32_t(int32_t(exponent) + 127) << 23;
+
+            float scale;
+            std::memcpy(&scale, &bits, sizeof(scale));
+            return scale;
+        }
+
+    public:
+        packed_float3 origin;
+        int8_t exponents[3];
+        uint8_t childCount;
+
+        // The same axis of all the children sits together.
+        uint8_t mins[3][width];
+        uint8_t maxs[3][width];
+
+        uint32_t firsts[width];
+        uint16_t counts[width];
+    };
+
+public:
+    // Each node pops one entry off the traversal stack and pushes up to width of them.
+    static constexpr std::size_t maxStackSize = (width - 1) * BVH::maxDepth + 1;
+
+public:
+    static WideBVH build(Pool& pool, const std::vector<BVH::Box>& boxes);
+
+    // Collapses a binary BVH, taking over its indices.
+    static WideBVH collapse(BVH bvh);
+
+public:
+    // Fits the nodes to the boxes, which have moved since the build, keeping the tree as it is.
+    void refit(const std::vector<BVH::Box>& boxes);
+
+    // How many boxes a ray tests on average by the surface area heuristic,
+    // which grows as refitting keeps a tree that suits the boxes worse than a build would.
+    float cost() const;
+
+public:
+    // Loads what save wrote with the same key over the boxCount boxes,
+    // or nothing if the file is missing, broken, for another key or for another count of boxes.
+    static std::optional<WideBVH> load(const std::string& path, uint64_t key, std::size_t boxCount);
+
+    // Writes a temporary file next to the path and renames it over the path, so that no reader sees a partial file.
+    void save(const std::string& path, uint64_t key) const;
+
+public:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> indices;
+
+    // The root has no parent to hold its box.
+    BVH::Box bounds;
+
+    BVH::Stats stats;
+};
+
+static_assert(sizeof(WideBVH::Node) == 64, "a node should fit in a cache line");
+}
+
+namespace Host {
+// NodeVisits counts the nodes that the traversals on the calling thread visit while it is enabled,
+// and how many of them miss a direct-mapped cache of the size of an L1 data cache,
+// which tells how much the rays traced one after another share their nodes.
+struct NodeVisits {
+public:
+    // 32 KiB of nodes.
+    static constexpr std::size_t lineCount = 512;
+
+public:
+    void visit(const WideBVH::Node& node)
+    {
+        count++;
+
+        auto& line = lines[reinterpret_cast<std::uintptr_t>(&node) / sizeof(WideBVH::Node) % lineCount];
+        if (line != &node) {
+            line = &node;
+            missCount++;
+        }
+    }
+
+public:
+    // It costs the traversal a lookup for each node, so it is off unless it is measured.
+    static inline bool isEnabled = false;
+
+    static thread_local NodeVisits onThread;
+
+public:
+    uint64_t count = 0;
+    uint64_t missCount = 0;
+
+    // Of the count, the visits of shadow rays, see InstanceAccelerationStructure::occluded.
+    uint64_t shadowCount = 0;
+
+    const WideBVH::Node* lines[lineCount] = {};
+};
+
+inline thread_local NodeVisits NodeVisits::onThread = {};
+}
+
+namespace Host {
+// Traverses the BVH front to back, calling visit(index, maxDistance) for each box in the leaves the ray reaches.
+// visit returns the distance to the closest hit so far, which prunes the rest of the traversal,
+// or -INFINITY to end it at once, as shadow rays do on any hit.
+template <typename Visit>
+void traverse(const WideBVH& bvh, const metal::raytracing::ray& ray, float maxDistance, Visit visit)
+{
+    if (bvh.nodes.empty()) {
+        return;
+    }
+
+    // Nudge zero components as packets do, so that the slab test never multiplies 0 by infinity,
+    // which would miss the boxes whose faces the origin lies on.
+    const auto nudge = [](const float d) { return d < 1e-20f && d > -1e-20f ? (d < 0 ? -1e-20f : 1e-20f) : d; };
+    const auto invDirection = 1 / float3(nudge(ray.direction.x), nudge(ray.direction.y), nudge(ray.direction.z));
+
+    const auto distanceTo = [&](const BVH::Box& box) {
+        const auto t0 = (box.min - ray.origin) * invDirection;
+        const auto t1 = (box.max - ray.origin) * invDirection;
+
+        const auto near = metal::min(t0, t1);
+        const auto far = metal::max(t0, t1);
+
+        const auto enter = std::fmax(std::fmax(near.x, near.y), std::fmax(near.z, ray.min_distance));
+        const auto exit = std::fmin(std::fmin(far.x, far.y), std::fmin(far.z, maxDistance));
+
+        return enter <= exit ? enter : INFINITY;
+    };
+
+    // Entry is a node when count is 0 and a leaf otherwise, as in WideBVH::Node.
+    struct Entry {
+    public:
+        float distance;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    Entry stack[WideBVH::maxStackSize];
+    std::size_t stackCount = 0;
+
+    const auto rootDistance = distanceTo(bvh.bounds);
+    if (rootDistance == INFINITY) {
+        return;
+    }
+
+    stack[stackCount++] = { rootDistance, 0, 0 };
+
+    while (stackCount != 0) {
+        const auto entry = stack[--stackCount];
+
+        // The closest hit may have come nearer since the entry was pushed.
+        if (entry.distance > maxDistance) {
+            continue;
+        }
+
+        if (entry.count != 0) {
+            for (uint32_t i = 0; i < entry.count; i++) {
+                maxDistance = std::fmin(maxDistance, visit(bvh.indices[entry.first + i], maxDistance));
+                if (maxDistance == -INFINITY) {
+                    return;
+                }
+            }
+            continue;
+        }
+
+        const auto& node = bvh.nodes[entry.first];
+        const auto scale = node.scale();
+
+        if (NodeVisits::isEnabled) {
+            NodeVisits::onThread.visit(node);
+        }
+
+        // Keep the children that the ray reaches from the farthest to the nearest, so that the nearest is popped first.
+        Entry children[WideBVH::width];
+        std::size_t childCount = 0;
+
+        for (std::size_t i = 0; i < node.childCount; i++) {
+            const auto distance = distanceTo(node.boxOf(i, scale));
+            if (distance == INFINITY) {
+                continue;
+            }
+
+            auto at = childCount++;
+            while (at > 0 && children[at - 1].distance < distance) {
+                children[at] = children[at - 1];
+                at--;
+            }
+
+            children[at] = { distance, node.firsts[i], node.counts[i] };
+        }
+
+        for (std::size_t i = 0; i < childCount; i++) {
+            stack[stackCount++] = children[i];
+        }
+    }
+}
+}
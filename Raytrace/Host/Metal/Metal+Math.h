@@ -0,0 +1,286 @@
+// tomocy
+
+#pragma once
+
+#include "Metal+Vector.h"
+#include <algorithm>
+#include <cmath>
+
+#define M_E_F 2.71828182845904523536028747135266250f
+#define M_PI_F 3.14159265358979323846264338327950288f
+#define M_PI_2_F 1.57079632679489661923132169163975144f
+#define M_PI_4_F 0.785398163397448309615660845819875721f
+#define M_1_PI_F 0.318309886183790671537767526745028724f
+#define M_2_PI_F 0.636619772367581343075535053490057448f
+#define M_SQRT2_F 1.41421356237309504880168872420969808f
+
+#ifndef MAXFLOAT
+#define MAXFLOAT 0x1.fffffep+127f
+#endif
+
+namespace metal {
+namespace detail {
+template <typename T, int N, typename Fn>
+vec<T, N> map(const vec<T, N>& v, Fn fn)
+{
+    vec<T, N> result;
+    for (int i = 0; i < N; i++) {
+        result[i] = fn(v[i]);
+    }
+    return result;
+}
+
+template <typename T, int N, typename Fn>
+vec<T, N> map(const vec<T, N>& a, const vec<T, N>& b, Fn fn)
+{
+    vec<T, N> result;
+    for (int i = 0; i < N; i++) {
+        result[i] = fn(a[i], b[i]);
+    }
+    return result;
+}
+
+template <typename T, int N, typename Fn>
+vec<T, N> map(const vec<T, N>& a, const vec<T, N>& b, const vec<T, N>& c, Fn fn)
+{
+    vec<T, N> result;
+    for (int i = 0; i < N; i++) {
+        result[i] = fn(a[i], b[i], c[i]);
+    }
+    return result;
+}
+}
+}
+
+namespace metal {
+#define METAL_UNARY(name, expr)                                          \
+    inline float name(const float x) { return expr; }                    \
+                                                                         \
+    template <int N>                                                     \
+    vec<float, N> name(const vec<float, N>& v)                           \
+    {                                                                    \
+        return detail::map(v, [](const float x) { return float(expr); }); \
+    }
+
+METAL_UNARY(abs, std::fabs(x))
+METAL_UNARY(sqrt, std::sqrt(x))
+METAL_UNARY(rsqrt, 1 / std::sqrt(x))
+METAL_UNARY(sin, std::sin(x))
+METAL_UNARY(cos, std::cos(x))
+METAL_UNARY(tan, std::tan(x))
+METAL_UNARY(asin, std::asin(x))
+METAL_UNARY(acos, std::acos(x))
+METAL_UNARY(atan, std::atan(x))
+METAL_UNARY(exp, std::exp(x))
+METAL_UNARY(exp2, std::exp2(x))
+METAL_UNARY(log, std::log(x))
+METAL_UNARY(log2, std::log2(x))
+METAL_UNARY(floor, std::floor(x))
+METAL_UNARY(ceil, std::ceil(x))
+METAL_UNARY(round, std::round(x))
+METAL_UNARY(trunc, std::trunc(x))
+METAL_UNARY(fract, x - std::floor(x))
+METAL_UNARY(saturate, std::min(std::max(x, 0.0f), 1.0f))
+METAL_UNARY(sign, x > 0 ? 1.0f : (x < 0 ? -1.0f : 0.0f))
+
+#undef METAL_UNARY
+
+#define METAL_BINARY(name, expr)                                                       \
+    inline float name(const float x, const float y) { return expr; }                   \
+                                                                                       \
+    template <int N>                                                                   \
+    vec<float, N> name(const vec<float, N>& a, const vec<float, N>& b)                 \
+    {                                                                                  \
+        return detail::map(a, b, [](const float x, const float y) { return float(expr); }); \
+    }
+
+METAL_BINARY(pow, std::pow(x, y))
+METAL_BINARY(powr, std::pow(x, y))
+METAL_BINARY(atan2, std::atan2(x, y))
+METAL_BINARY(fmod, std::fmod(x, y))
+METAL_BINARY(min, std::fmin(x, y))
+METAL_BINARY(max, std::fmax(x, y))
+METAL_BINARY(step, x > y ? 0.0f : 1.0f)
+
+#undef METAL_BINARY
+
+template <typename T, int N, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec<T, N> min(const vec<T, N>& a, const vec<T, N>& b)
+{
+    return detail::map(a, b, [](const T x, const T y) { return std::min(x, y); });
+}
+
+template <typename T, int N, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec<T, N> max(const vec<T, N>& a, const vec<T, N>& b)
+{
+    return detail::map(a, b, [](const T x, const T y) { return std::max(x, y); });
+}
+
+inline float clamp(const float x, const float low, const float high) { return min(max(x, low), high); }
+
+template <int N>
+vec<float, N> clamp(const vec<float, N>& x, const vec<float, N>& low, const vec<float, N>& high)
+{
+    return min(max(x, low), high);
+}
+
+template <int N>
+vec<float, N> clamp(const vec<float, N>& x, const float low, const float high)
+{
+    return min(max(x, vec<float, N>(low)), vec<float, N>(high));
+}
+
+inline float mix(const float x, const float y, const float a) { return x + (y - x) * a; }
+
+template <int N>
+vec<float, N> mix(const vec<float, N>& x, const vec<float, N>& y, const vec<float, N>& a)
+{
+    return x + (y - x) * a;
+}
+
+template <int N>
+vec<float, N> mix(const vec<float, N>& x, const vec<float, N>& y, const float a)
+{
+    return x + (y - x) * a;
+}
+
+inline float fma(const float a, const float b, const float c) { return std::fma(a, b, c); }
+
+inline float smoothstep(const float edge0, const float edge1, const float x)
+{
+    const auto t = clamp((x - edge0) / (edge1 - edge0), 0, 1);
+    return t * t * (3 - 2 * t);
+}
+
+inline bool isnan(const float x) { return std::isnan(x); }
+inline bool isinf(const float x) { return std::isinf(x); }
+inline bool isfinite(const float x) { return std::isfinite(x); }
+}
+
+namespace metal {
+template <int N>
+float dot(const vec<float, N>& a, const vec<float, N>& b)
+{
+    float result = 0;
+    for (int i = 0; i < N; i++) {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+inline float3 cross(const float3& a, const float3& b)
+{
+    return {
+        a.y * b.z - a.z * b.y,
+        a.z * b.x - a.x * b.z,
+        a.x * b.y - a.y * b.x,
+    };
+}
+
+template <int N>
+float length_squared(const vec<float, N>& v) { return dot(v, v); }
+
+template <int N>
+float length(const vec<float, N>& v) { return std::sqrt(dot(v, v)); }
+
+template <int N>
+float distance(const vec<float, N>& a, const vec<float, N>& b) { return length(a - b); }
+
+template <int N>
+vec<float, N> normalize(const vec<float, N>& v) { return v * (1 / length(v)); }
+
+template <int N>
+vec<float, N> reflect(const vec<float, N>& i, const vec<float, N>& n) { return i - 2 * dot(n, i) * n; }
+
+template <int N>
+vec<float, N> faceforward(const vec<float, N>& n, const vec<float, N>& i, const vec<float, N>& nref)
+{
+    return dot(nref, i) < 0 ? n : -n;
+}
+}
+
+namespace metal {
+template <int N>
+bool all(const vec<bool, N>& v)
+{
+    for (int i = 0; i < N; i++) {
+        if (!v[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <int N>
+bool any(const vec<bool, N>& v)
+{
+    for (int i = 0; i < N; i++) {
+        if (v[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+T select(const T a, const T b, const bool c) { return c ? b : a; }
+
+template <typename T, int N>
+vec<T, N> select(const vec<T, N>& a, const vec<T, N>& b, const vec<bool, N>& c)
+{
+    vec<T, N> result;
+    for (int i = 0; i < N; i++) {
+        result[i] = c[i] ? b[i] : a[i];
+    }
+    return result;
+}
+
+template <typename T>
+T as_type(const float value)
+{
+    static_assert(sizeof(T) == sizeof(float), "as_type needs types of the same size");
+
+    T result;
+    __builtin_memcpy(&result, &value, sizeof(T));
+    return result;
+}
+
+template <typename T>
+T as_type(const uint value)
+{
+    static_assert(sizeof(T) == sizeof(uint), "as_type needs types of the same size");
+
+    T result;
+    __builtin_memcpy(&result, &value, sizeof(T));
+    return result;
+}
+}
+
+namespace metal {
+inline uint pack_float_to_snorm2x16(const float2 v)
+{
+    const auto x = short(round(clamp(v.x, -1.0f, 1.0f) * 32767));
+    const auto y = short(round(clamp(v.y, -1.0f, 1.0f) * 32767));
+    return uint(ushort(x)) | (uint(ushort(y)) << 16);
+}
+
+inline float2 unpack_snorm2x16_to_float(const uint v)
+{
+    return float2(
+        max(float(short(ushort(v & 0xffff))) / 32767, -1.0f),
+        max(float(short(ushort(v >> 16))) / 32767, -1.0f)
+    );
+}
+}
+
+namespace metal {
+inline uint reverse_bits(uint x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+    x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+    x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+    return x;
+}
+}
@@ -0,0 +1,101 @@
+// tomocy
+
+#pragma once
+
+#include "Metal+Math.h"
+#include "Metal+Vector.h"
+#include <cmath>
+
+namespace Host {
+class InstanceAccelerationStructure;
+}
+
+namespace metal {
+namespace raytracing {
+struct ray {
+public:
+    ray(
+        const float3 origin = 0,
+        const float3 direction = 0,
+        const float min_distance = 0,
+        const float max_distance = INFINITY
+    )
+        : origin(origin)
+        , direction(direction)
+        , min_distance(min_distance)
+        , max_distance(max_distance)
+    {
+    }
+
+public:
+    float3 origin;
+    float3 direction;
+    float min_distance;
+    float max_distance;
+};
+
+struct instancing {};
+struct triangle_data {};
+
+enum class intersection_type {
+    none,
+    triangle,
+    bounding_box,
+};
+
+// On the host, an instance acceleration structure is a handle to Host::InstanceAccelerationStructure.
+struct instance_acceleration_structure {
+public:
+    instance_acceleration_structure() = default;
+
+    explicit instance_acceleration_structure(const Host::InstanceAccelerationStructure* raw)
+        : raw(raw)
+    {
+    }
+
+public:
+    const Host::InstanceAccelerationStructure* raw = nullptr;
+};
+
+struct intersection_result {
+public:
+    intersection_type type = intersection_type::none;
+    float distance = INFINITY;
+
+    uint instance_id = 0;
+    uint user_instance_id = 0;
+    uint geometry_id = 0;
+    uint primitive_id = 0;
+
+    float2 triangle_barycentric_coord = 0;
+
+    const void* primitive_data = nullptr;
+};
+
+namespace detail {
+// Any intersection ends the traversal when acceptsAny, for which the result only tells its type.
+intersection_result intersect(const ray& ray, const instance_acceleration_structure& structure, uint mask, bool acceptsAny);
+}
+
+template <typename... Tags>
+struct intersector {
+public:
+    using result_type = intersection_result;
+
+public:
+    result_type intersect(
+        const ray ray,
+        const instance_acceleration_structure structure,
+        const uint mask = 0xff
+    ) const
+    {
+        return detail::intersect(ray, structure, mask, acceptsAny_);
+    }
+
+    void accept_any_intersection(const bool value) { acceptsAny_ = value; }
+
+private:
+    bool acceptsAny_ = false;
+};
+}
+}
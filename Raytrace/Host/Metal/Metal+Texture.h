@@ -0,0 +1,413 @@
+// tomocy
+
+#pragma once
+
+#include "Metal+Math.h"
+#include "Metal+Vector.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace metal {
+enum class access {
+    sample,
+    read,
+    write,
+    read_write,
+};
+
+enum class filter {
+    nearest,
+    linear,
+};
+
+enum class min_filter {
+    nearest,
+    linear,
+};
+
+enum class mag_filter {
+    nearest,
+    linear,
+};
+
+enum class mip_filter {
+    none,
+    nearest,
+    linear,
+};
+
+enum class address {
+    clamp_to_edge,
+    repeat,
+    mirrored_repeat,
+};
+
+enum class coord {
+    normalized,
+    pixel,
+};
+
+struct sampler {
+public:
+    constexpr sampler() = default;
+
+    template <typename... Options>
+    constexpr explicit sampler(const Options... options)
+    {
+        (set(options), ...);
+    }
+
+public:
+    min_filter minFilter = min_filter::nearest;
+    mag_filter magFilter = mag_filter::nearest;
+    mip_filter mipFilter = mip_filter::none;
+    address addressMode = address::clamp_to_edge;
+    coord coordSpace = coord::normalized;
+
+private:
+    constexpr void set(const filter value)
+    {
+        minFilter = value == filter::linear ? min_filter::linear : min_filter::nearest;
+        magFilter = value == filter::linear ? mag_filter::linear : mag_filter::nearest;
+    }
+
+    constexpr void set(const min_filter value) { minFilter = value; }
+    constexpr void set(const mag_filter value) { magFilter = value; }
+    constexpr void set(const mip_filter value) { mipFilter = value; }
+    constexpr void set(const address value) { addressMode = value; }
+    constexpr void set(const coord value) { coordSpace = value; }
+};
+
+struct level {
+public:
+    constexpr explicit level(const float lod)
+        : lod(lod)
+    {
+    }
+
+public:
+    float lod;
+};
+}
+
+namespace metal {
+namespace detail {
+// Texels backs a texture handle on the host.
+// Faces of a cube are stored one after another in each level.
+// The texels of each level are in rows, or in tiles once tiled, see tile.
+template <typename T>
+struct Texels {
+public:
+    struct Level {
+    public:
+        uint width;
+        uint height;
+        std::vector<vec<T, 4>> texels;
+    };
+
+    // The texels on a side of a tile, whose 8x8 float4s take 1 KiB.
+    static constexpr uint tileSize = 8;
+
+public:
+    vec<T, 4>& at(const uint2 coordinate, const uint face, const uint lod)
+    {
+        auto& level = levels[lod];
+        return level.texels[indexIn(level, coordinate, face)];
+    }
+
+    const vec<T, 4>& at(const uint2 coordinate, const uint face, const uint lod) const
+    {
+        const auto& level = levels[lod];
+        return level.texels[indexIn(level, coordinate, face)];
+    }
+
+public:
+    bool isTiled() const { return isTiled_; }
+
+    // Lays the texels of each level out in tiles of tileSize x tileSize, a row of tiles after another,
+    // with the texels of each tile in Morton order, so that the texels that a bilinear fetch or a ray cone
+    // around a hit reads are a few cache lines apart instead of rows apart.
+    // Those who read the texels of a level as rows must do so before.
+    void tile()
+    {
+        if (isTiled_) {
+            return;
+        }
+
+        for (auto& level : levels) {
+            const auto tileCount = tileCountOf(level);
+
+            auto tiled = std::vector<vec<T, 4>>(std::size_t(tileCount.x) * tileCount.y * tileSize * tileSize * faceCount, vec<T, 4>(T(0)));
+
+            for (uint face = 0; face < faceCount; face++) {
+                for (uint y = 0; y < level.height; y++) {
+                    for (uint x = 0; x < level.width; x++) {
+                        tiled[tiledIndexIn(level, uint2(x, y), face)] = level.texels[(face * level.height + y) * level.width + x];
+                    }
+                }
+            }
+
+            level.texels = std::move(tiled);
+        }
+
+        isTiled_ = true;
+    }
+
+private:
+    std::size_t indexIn(const Level& level, const uint2 coordinate, const uint face) const
+    {
+        return isTiled_
+            ? tiledIndexIn(level, coordinate, face)
+            : (std::size_t(face) * level.height + coordinate.y) * level.width + coordinate.x;
+    }
+
+    static uint2 tileCountOf(const Level& level)
+    {
+        return uint2((level.width + tileSize - 1) / tileSize, (level.height + tileSize - 1) / tileSize);
+    }
+
+    static std::size_t tiledIndexIn(const Level& level, const uint2 coordinate, const uint face)
+    {
+        const auto tileCount = tileCountOf(level);
+        const auto tile = (std::size_t(face) * tileCount.y + coordinate.y / tileSize) * tileCount.x + coordinate.x / tileSize;
+
+        return tile * tileSize * tileSize + mortonOf(coordinate.x % tileSize, coordinate.y % tileSize);
+    }
+
+    // Interleaves the 3 bits of x and y, with x taking the lower bit of each pair.
+    static uint mortonOf(const uint x, const uint y)
+    {
+        const auto spread = [](uint v) {
+            v = (v | (v << 2)) & 0x33;
+            v = (v | (v << 1)) & 0x55;
+            return v;
+        };
+
+        return spread(x) | (spread(y) << 1);
+    }
+
+public:
+    vec<T, 4> sample(const sampler& s, const float2 coordinate, const uint face, const float lod) const
+    {
+        if (s.mipFilter == mip_filter::none || levels.size() == 1) {
+            return sampleIn(s, coordinate, face, 0, s.magFilter == mag_filter::linear);
+        }
+
+        const auto maxLOD = float(levels.size() - 1);
+        const auto clamped = clamp(lod, 0, maxLOD);
+
+        const auto isLinear = lod <= 0
+            ? s.magFilter == mag_filter::linear
+            : s.minFilter == min_filter::linear;
+
+        if (s.mipFilter == mip_filter::nearest) {
+            return sampleIn(s, coordinate, face, uint(clamped + 0.5f), isLinear);
+        }
+
+        const auto lower = uint(clamped);
+        const auto upper = std::min(lower + 1, uint(levels.size() - 1));
+        const auto t = clamped - float(lower);
+
+        const auto a = sampleIn(s, coordinate, face, lower, isLinear);
+        if (t == 0 || lower == upper) {
+            return a;
+        }
+
+        const auto b = sampleIn(s, coordinate, face, upper, isLinear);
+        return a + (b - a) * vec<T, 4>(t);
+    }
+
+private:
+    vec<T, 4> sampleIn(
+        const sampler& s,
+        float2 coordinate,
+        const uint face,
+        const uint lod,
+        const bool isLinear
+    ) const
+    {
+        const auto& level = levels[lod];
+
+        if (s.coordSpace == coord::normalized) {
+            coordinate *= float2(float(level.width), float(level.height));
+        }
+
+        if (!isLinear) {
+            const auto x = wrap(int(floor(coordinate.x)), level.width, s.addressMode);
+            const auto y = wrap(int(floor(coordinate.y)), level.height, s.addressMode);
+
+            return at(uint2(x, y), face, lod);
+        }
+
+        const auto shifted = coordinate - 0.5f;
+        const auto origin = floor(shifted);
+        const auto t = shifted - origin;
+
+        const auto x0 = wrap(int(origin.x), level.width, s.addressMode);
+        const auto x1 = wrap(int(origin.x) + 1, level.width, s.addressMode);
+        const auto y0 = wrap(int(origin.y), level.height, s.addressMode);
+        const auto y1 = wrap(int(origin.y) + 1, level.height, s.addressMode);
+
+        const auto top = mixOf(at(uint2(x0, y0), face, lod), at(uint2(x1, y0), face, lod), t.x);
+        const auto bottom = mixOf(at(uint2(x0, y1), face, lod), at(uint2(x1, y1), face, lod), t.x);
+
+        return mixOf(top, bottom, t.y);
+    }
+
+    static vec<T, 4> mixOf(const vec<T, 4>& a, const vec<T, 4>& b, const float t)
+    {
+        return a + (b - a) * vec<T, 4>(T(t));
+    }
+
+    static uint wrap(const int i, const uint size, const address mode)
+    {
+        const auto n = int(size);
+
+        switch (mode) {
+        case address::repeat:
+            return uint(((i % n) + n) % n);
+        case address::mirrored_repeat: {
+            const auto period = 2 * n;
+            const auto j = ((i % period) + period) % period;
+            return uint(j < n ? j : period - 1 - j);
+        }
+        case address::clamp_to_edge:
+        default:
+            return uint(std::min(std::max(i, 0), n - 1));
+        }
+    }
+
+public:
+    uint faceCount = 1;
+    std::vector<Level> levels;
+
+private:
+    bool isTiled_ = false;
+};
+
+// Maps a direction onto a face of a cube and a coordinate in the face (0...1, 0...1).
+inline uint faceOf(const float3 direction, float2& coordinate)
+{
+    const auto a = abs(direction);
+
+    uint face = 0;
+    float major = 0;
+    float2 onFace = 0;
+
+    if (a.x >= a.y && a.x >= a.z) {
+        face = direction.x > 0 ? 0 : 1;
+        major = a.x;
+        onFace = float2(direction.x > 0 ? -direction.z : direction.z, -direction.y);
+    } else if (a.y >= a.z) {
+        face = direction.y > 0 ? 2 : 3;
+        major = a.y;
+        onFace = float2(direction.x, direction.y > 0 ? direction.z : -direction.z);
+    } else {
+        face = direction.z > 0 ? 4 : 5;
+        major = a.z;
+        onFace = float2(direction.z > 0 ? direction.x : -direction.x, -direction.y);
+    }
+
+    coordinate = (onFace / major + 1) * 0.5f;
+
+    return face;
+}
+}
+}
+
+namespace metal {
+template <typename T, access A = access::sample>
+struct texture2d {
+public:
+    texture2d() = default;
+
+    explicit texture2d(detail::Texels<T>* raw)
+        : raw_(raw)
+    {
+    }
+
+public:
+    detail::Texels<T>* raw() const { return raw_; }
+
+public:
+    uint get_width(const uint lod = 0) const { return raw_->levels[lod].width; }
+    uint get_height(const uint lod = 0) const { return raw_->levels[lod].height; }
+    uint get_num_mip_levels() const { return uint(raw_->levels.size()); }
+
+public:
+    vec<T, 4> sample(const sampler s, const float2 coordinate) const
+    {
+        return raw_->sample(s, coordinate, 0, 0);
+    }
+
+    vec<T, 4> sample(const sampler s, const float2 coordinate, const level lod) const
+    {
+        return raw_->sample(s, coordinate, 0, lod.lod);
+    }
+
+public:
+    vec<T, 4> read(const uint2 coordinate, const uint lod = 0) const
+    {
+        return raw_->at(coordinate, 0, lod);
+    }
+
+    void write(const vec<T, 4> color, const uint2 coordinate, const uint lod = 0) const
+    {
+        raw_->at(coordinate, 0, lod) = color;
+    }
+
+private:
+    detail::Texels<T>* raw_ = nullptr;
+};
+
+template <typename T, access A = access::sample>
+struct texturecube {
+public:
+    texturecube() = default;
+
+    explicit texturecube(detail::Texels<T>* raw)
+        : raw_(raw)
+    {
+    }
+
+public:
+    detail::Texels<T>* raw() const { return raw_; }
+
+public:
+    uint get_width(const uint lod = 0) const { return raw_->levels[lod].width; }
+    uint get_height(const uint lod = 0) const { return raw_->levels[lod].height; }
+    uint get_num_mip_levels() const { return uint(raw_->levels.size()); }
+
+public:
+    vec<T, 4> sample(const sampler s, const float3 direction) const
+    {
+        float2 coordinate;
+        const auto face = detail::faceOf(direction, coordinate);
+
+        return raw_->sample(s, coordinate, face, 0);
+    }
+
+    vec<T, 4> sample(const sampler s, const float3 direction, const level lod) const
+    {
+        float2 coordinate;
+        const auto face = detail::faceOf(direction, coordinate);
+
+        return raw_->sample(s, coordinate, face, lod.lod);
+    }
+
+public:
+    vec<T, 4> read(const uint2 coordinate, const uint face, const uint lod = 0) const
+    {
+        return raw_->at(coordinate, face, lod);
+    }
+
+    void write(const vec<T, 4> color, const uint2 coordinate, const uint face, const uint lod = 0) const
+    {
+        raw_->at(coordinate, face, lod) = color;
+    }
+
+private:
+    detail::Texels<T>* raw_ = nullptr;
+};
+}
@@ -0,0 +1,296 @@
+// tomocy
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace metal {
+template <typename T, int N>
+struct vec;
+
+template <typename T, int N>
+struct packed_vec;
+}
+
+namespace metal {
+namespace detail {
+// Metal lays out 3-component vectors as 4-component ones, except for packed vectors.
+template <typename T, int N>
+constexpr std::size_t alignmentOf() { return sizeof(T) * (N == 3 ? 4 : N); }
+
+template <typename T, int N>
+struct Components;
+
+template <typename T>
+struct Components<T, 2> {
+public:
+    union {
+        T elements[2];
+        __extension__ struct {
+            T x, y;
+        };
+        __extension__ struct {
+            T r, g;
+        };
+    };
+};
+
+template <typename T>
+struct Components<T, 3> {
+public:
+    union {
+        T elements[3];
+        __extension__ struct {
+            T x, y, z;
+        };
+        __extension__ struct {
+            T r, g, b;
+        };
+        vec<T, 2> xy;
+        vec<T, 2> rg;
+    };
+};
+
+template <typename T>
+struct Components<T, 4> {
+public:
+    union {
+        T elements[4];
+        __extension__ struct {
+            T x, y, z, w;
+        };
+        __extension__ struct {
+            T r, g, b, a;
+        };
+        vec<T, 2> xy;
+        vec<T, 2> rg;
+        vec<T, 3> xyz;
+        vec<T, 3> rgb;
+    };
+};
+}
+}
+
+namespace metal {
+template <typename T, int N>
+struct alignas(detail::alignmentOf<T, N>()) vec : detail::Components<T, N> {
+public:
+    using value_type = T;
+    static constexpr int count = N;
+
+public:
+    vec() = default;
+
+    vec(const T value)
+    {
+        for (int i = 0; i < N; i++) {
+            (*this)[i] = value;
+        }
+    }
+
+    template <int M = N, std::enable_if_t<M == 2, int> = 0>
+    vec(const T x, const T y)
+    {
+        this->elements[0] = x;
+        this->elements[1] = y;
+    }
+
+    template <int M = N, std::enable_if_t<M == 3, int> = 0>
+    vec(const T x, const T y, const T z)
+    {
+        this->elements[0] = x;
+        this->elements[1] = y;
+        this->elements[2] = z;
+    }
+
+    template <int M = N, std::enable_if_t<M == 3, int> = 0>
+    vec(const vec<T, 2> xy, const T z)
+        : vec(xy.x, xy.y, z)
+    {
+    }
+
+    template <int M = N, std::enable_if_t<M == 3, int> = 0>
+    vec(const packed_vec<T, 3> other)
+        : vec(other.x, other.y, other.z)
+    {
+    }
+
+    template <int M = N, std::enable_if_t<M == 4, int> = 0>
+    vec(const T x, const T y, const T z, const T w)
+    {
+        this->elements[0] = x;
+        this->elements[1] = y;
+        this->elements[2] = z;
+        this->elements[3] = w;
+    }
+
+    template <int M = N, std::enable_if_t<M == 4, int> = 0>
+    vec(const vec<T, 3> xyz, const T w)
+        : vec(xyz.x, xyz.y, xyz.z, w)
+    {
+    }
+
+    template <int M = N, std::enable_if_t<M == 4, int> = 0>
+    vec(const vec<T, 2> xy, const T z, const T w)
+        : vec(xy.x, xy.y, z, w)
+    {
+    }
+
+    template <int M = N, std::enable_if_t<M == 4, int> = 0>
+    vec(const vec<T, 2> xy, const vec<T, 2> zw)
+        : vec(xy.x, xy.y, zw.x, zw.y)
+    {
+    }
+
+    template <typename U, std::enable_if_t<!std::is_same<U, T>::value, int> = 0>
+    explicit vec(const vec<U, N>& other)
+    {
+        for (int i = 0; i < N; i++) {
+            (*this)[i] = T(other[i]);
+        }
+    }
+
+public:
+    T& operator[](const int i) { return this->elements[i]; }
+    const T& operator[](const int i) const { return this->elements[i]; }
+
+public:
+    friend vec operator+(const vec& v) { return v; }
+
+    friend vec operator-(const vec& v)
+    {
+        vec result;
+        for (int i = 0; i < N; i++) {
+            result[i] = -v[i];
+        }
+        return result;
+    }
+
+    friend vec<bool, N> operator!(const vec& v)
+    {
+        vec<bool, N> result;
+        for (int i = 0; i < N; i++) {
+            result[i] = !v[i];
+        }
+        return result;
+    }
+
+#define METAL_VEC_ARITHMETIC(op)                            \
+    friend vec operator op(const vec& a, const vec& b)      \
+    {                                                       \
+        vec result;                                         \
+        for (int i = 0; i < N; i++) {                       \
+            result[i] = a[i] op b[i];                       \
+        }                                                   \
+        return result;                                      \
+    }                                                       \
+                                                            \
+    friend vec& operator op##=(vec& a, const vec& b)        \
+    {                                                       \
+        return a = a op b;                                  \
+    }
+
+    METAL_VEC_ARITHMETIC(+)
+    METAL_VEC_ARITHMETIC(-)
+    METAL_VEC_ARITHMETIC(*)
+    METAL_VEC_ARITHMETIC(/)
+    METAL_VEC_ARITHMETIC(%)
+    METAL_VEC_ARITHMETIC(&)
+    METAL_VEC_ARITHMETIC(|)
+    METAL_VEC_ARITHMETIC(^)
+    METAL_VEC_ARITHMETIC(<<)
+    METAL_VEC_ARITHMETIC(>>)
+
+#undef METAL_VEC_ARITHMETIC
+
+#define METAL_VEC_RELATIONAL(op)                                \
+    friend vec<bool, N> operator op(const vec& a, const vec& b) \
+    {                                                           \
+        vec<bool, N> result;                                    \
+        for (int i = 0; i < N; i++) {                           \
+            result[i] = a[i] op b[i];                           \
+        }                                                       \
+        return result;                                          \
+    }
+
+    METAL_VEC_RELATIONAL(==)
+    METAL_VEC_RELATIONAL(!=)
+    METAL_VEC_RELATIONAL(<)
+    METAL_VEC_RELATIONAL(<=)
+    METAL_VEC_RELATIONAL(>)
+    METAL_VEC_RELATIONAL(>=)
+    METAL_VEC_RELATIONAL(&&)
+    METAL_VEC_RELATIONAL(||)
+
+#undef METAL_VEC_RELATIONAL
+};
+
+template <typename T, int N>
+struct packed_vec {
+    static_assert(N == 3, "only packed 3-component vectors are supported");
+
+public:
+    packed_vec() = default;
+
+    packed_vec(const T x, const T y, const T z)
+        : x(x)
+        , y(y)
+        , z(z)
+    {
+    }
+
+    packed_vec(const vec<T, 3> other)
+        : packed_vec(other.x, other.y, other.z)
+    {
+    }
+
+public:
+    T& operator[](const int i) { return (&x)[i]; }
+    const T& operator[](const int i) const { return (&x)[i]; }
+
+public:
+    T x, y, z;
+};
+}
+
+#define METAL_VEC_TYPES(type)                \
+    using type##2 = metal::vec<type, 2>;     \
+    using type##3 = metal::vec<type, 3>;     \
+    using type##4 = metal::vec<type, 4>;
+
+using uint = unsigned int;
+using ushort = unsigned short;
+using uchar = unsigned char;
+
+METAL_VEC_TYPES(float)
+METAL_VEC_TYPES(int)
+METAL_VEC_TYPES(uint)
+METAL_VEC_TYPES(short)
+METAL_VEC_TYPES(ushort)
+METAL_VEC_TYPES(char)
+METAL_VEC_TYPES(uchar)
+METAL_VEC_TYPES(bool)
+
+#undef METAL_VEC_TYPES
+
+using packed_float3 = metal::packed_vec<float, 3>;
+
+namespace metal {
+using ::bool2;
+using ::bool3;
+using ::bool4;
+using ::float2;
+using ::float3;
+using ::float4;
+using ::int2;
+using ::int3;
+using ::int4;
+using ::packed_float3;
+using ::uint;
+using ::uint2;
+using ::uint3;
+using ::uint4;
+using ::ushort;
+}
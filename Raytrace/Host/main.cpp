@@ -0,0 +1,499 @@
+// tomocy
+
+#include "Host+Acceleration.h"
+#include "Host+Accelerator.h"
+#include "Host+Background.h"
+#include "Host+Denoiser.h"
+#include "Host+Env.h"
+#include "Host+Image.h"
+#include "Host+LUT.h"
+#include "Host+Mesh.h"
+#include "Host+OBJ.h"
+#include "Host+Pool.h"
+#include "Host+Raytracer.h"
+#include "Host+Schedule.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+double secondsSince(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Numbers the path of each frame before its extension, as in Raytrace.0001.ppm.
+std::string framePathOf(const std::string& path, const uint32_t index)
+{
+    char number[16];
+    std::snprintf(number, sizeof(number), ".%04u", index);
+
+    const auto slash = path.find_last_of('/');
+    const auto dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + number;
+    }
+
+    return path.substr(0, dot) + number + path.substr(dot);
+}
+
+// An OBJ at objPath takes the place of the sphere.
+std::vector<Host::Mesh> makeMeshes(Host::Pool& pool, const std::string& objPath, const Host::OBJ::Options& objOptions)
+{
+    // We know the scene for now.
+    std::vector<Host::Mesh> meshes;
+
+    if (!objPath.empty()) {
+        auto obj = Host::OBJ::load(pool, objPath, objOptions);
+        std::printf(
+            "OBJ: %zu positions, %zu triangles, %zu pieces, %zu chunks in %.3f ms\n",
+            obj.mesh.positions.size(),
+            obj.stats.triangleCount,
+            obj.mesh.pieces.size(),
+            obj.stats.chunkCount,
+            obj.stats.seconds * 1e3
+        );
+
+        obj.mesh.instances = {
+            { .transform = { .translate = float3(0, 0, 0) } },
+        };
+
+        meshes.push_back(std::move(obj.mesh));
+    } else {
+        auto mesh = Host::Mesh::sphere(
+            0.4, uint2(48, 24),
+            {
+                { .transform = { .translate = float3(0, 0.4, 0) } },
+            }
+        );
+        mesh.pieces[0].material = {
+            .albedo = Host::Texture<float>::fill(float4(1, 0.75, 0.25, 1)),
+            .metalRoughness = Host::Texture<float>::fill(float4(1, 0.5, 0, 0)),
+        };
+
+        meshes.push_back(mesh);
+    }
+
+    {
+        auto mesh = Host::Mesh::plane(
+            float2(4, 4),
+            {
+                { .transform = { .translate = float3(0, 0, 0) } },
+            }
+        );
+        mesh.pieces[0].material = {
+            .albedo = Host::Texture<float>::fill(float4(0.5, 0.5, 0.5, 1)),
+            .metalRoughness = Host::Texture<float>::fill(float4(0, 1, 0, 0)),
+        };
+
+        meshes.push_back(mesh);
+    }
+
+    return meshes;
+}
+}
+
+int main(const int argc, const char* const argv[])
+{
+    auto threadCount = Host::Pool::concurrency();
+    auto tracesPrimaryInPackets = true;
+    auto tracesInWavefronts = false;
+    auto reordersRays = false;
+    auto maxTraceCount = uint32_t(3);
+    auto bvhCacheDirectory = std::string();
+    auto resolution = uint2(1600, 1200);
+    auto taskSize = Raytrace::Accumulation::tileSize;
+
+    // Frames after the first move the instances of the first mesh by --motion, which refits the instances.
+    auto frameCount = uint32_t(1);
+    auto motion = float3(0);
+    auto outputPath = std::string("Raytrace.ppm");
+
+    // Passes add samples to the tiles up to --spp, or until the noise of the region falls below --noise.
+    auto scheduleOptions = Host::Schedule::Options();
+    auto hasMaxCount = false;
+    auto heatmapPath = std::string();
+    auto denoises = false;
+    auto envOptions = Host::Env::Options();
+    auto lutOptions = Host::LUT::Options();
+    auto objPath = std::string();
+    auto objOptions = Host::OBJ::Options();
+    auto compactsTriangles = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = std::size_t(std::max(std::atoi(argv[++i]), 1));
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--no-packets") == 0) {
+            tracesPrimaryInPackets = false;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--wavefront") == 0) {
+            tracesInWavefronts = true;
+            continue;
+        }
+
+        // Rays are only reordered in wavefronts.
+        if (std::strcmp(argv[i], "--reorder") == 0) {
+            tracesInWavefronts = true;
+            reordersRays = true;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--node-stats") == 0) {
+            Host::NodeVisits::isEnabled = true;
+            continue;
+        }
+
+        if ((std::strcmp(argv[i], "--max-trace-count") == 0 || std::strcmp(argv[i], "--max-depth") == 0) && i + 1 < argc) {
+            maxTraceCount = uint32_t(std::max(std::atoi(argv[++i]), 1));
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--bvh-cache") == 0 && i + 1 < argc) {
+            bvhCacheDirectory = argv[++i];
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+            auto width = 0u;
+            auto height = 0u;
+            if (std::sscanf(argv[++i], "%ux%u", &width, &height) == 2 && width > 0 && height > 0) {
+                resolution = uint2(width, height);
+                continue;
+            }
+        }
+
+        if (std::strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            taskSize = uint32_t(std::max(std::atoi(argv[++i]), 1));
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = uint32_t(std::max(std::atoi(argv[++i]), 1));
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--motion") == 0 && i + 3 < argc) {
+            motion = float3(float(std::atof(argv[i + 1])), float(std::atof(argv[i + 2])), float(std::atof(argv[i + 3])));
+            i += 3;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--spp") == 0 && i + 1 < argc) {
+            scheduleOptions.maxCount = uint32_t(std::max(std::atoi(argv[++i]), 1));
+            hasMaxCount = true;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            scheduleOptions.threshold = float(std::atof(argv[++i]));
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--noise-region") == 0 && i + 4 < argc) {
+            scheduleOptions.regionOrigin = uint2(uint(std::atoi(argv[i + 1])), uint(std::atoi(argv[i + 2])));
+            scheduleOptions.regionSize = uint2(uint(std::atoi(argv[i + 3])), uint(std::atoi(argv[i + 4])));
+            i += 4;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            heatmapPath = argv[++i];
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--denoise") == 0) {
+            denoises = true;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--diffuse-sh") == 0) {
+            envOptions.projectsDiffuse = true;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--lut-cache") == 0 && i + 1 < argc) {
+            lutOptions.cacheDirectory = argv[++i];
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--lut-format") == 0 && i + 1 < argc) {
+            const auto* format = argv[++i];
+            if (std::strcmp(format, "rg16f") == 0 || std::strcmp(format, "rg32f") == 0) {
+                lutOptions.format = std::strcmp(format, "rg16f") == 0 ? Host::LUT::Format::rg16Float : Host::LUT::Format::rg32Float;
+                continue;
+            }
+        }
+
+        if (std::strcmp(argv[i], "--obj") == 0 && i + 1 < argc) {
+            objPath = argv[++i];
+            continue;
+        }
+
+        // The sphere, or an OBJ like --obj.
+        if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            const auto* scene = argv[++i];
+            objPath = std::strcmp(scene, "sphere") == 0 ? "" : scene;
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--obj-chunk-size") == 0 && i + 1 < argc) {
+            objOptions.chunkSize = std::size_t(std::max(std::atoll(argv[++i]), 1ll));
+            continue;
+        }
+
+        if (std::strcmp(argv[i], "--compact-triangles") == 0) {
+            compactsTriangles = true;
+            continue;
+        }
+
+        std::fprintf(
+            stderr,
+            "Usage: Raytrace [--threads <count>] [--no-packets] [--wavefront] [--reorder] [--node-stats] [--max-trace-count|--max-depth <count>] [--bvh-cache <directory>]"
+            " [--resolution <width>x<height>] [--tile <pixels>] [--frames <count>] [--motion <x> <y> <z>] [--output <path>]"
+            " [--spp <count>] [--noise <threshold>] [--noise-region <x> <y> <width> <height>] [--heatmap <path>]"
+            " [--denoise] [--diffuse-sh] [--lut-cache <directory>] [--lut-format rg16f|rg32f] [--scene sphere|<path>] [--obj <path>] [--obj-chunk-size <bytes>]"
+            " [--compact-triangles]\n"
+        );
+        return 1;
+    }
+
+    // --noise alone lets the noise decide when to stop, under a cap so that tiles which converge slowly still end.
+    if (scheduleOptions.threshold > 0 && !hasMaxCount) {
+        scheduleOptions.maxCount = 1024;
+    }
+
+    try {
+        auto pool = Host::Pool(threadCount);
+
+        // Where the time goes, from loading the scene to writing the images.
+        auto loadSeconds = 0.0;
+        auto buildSeconds = 0.0;
+        auto setupSeconds = 0.0;
+        auto traceSeconds = 0.0;
+        auto denoiseSeconds = 0.0;
+        auto outputSeconds = 0.0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        auto meshes = makeMeshes(pool, objPath, objOptions);
+
+        // Rays sample the textures of the materials by their footprints, all over them.
+        for (auto& mesh : meshes) {
+            for (auto& piece : mesh.pieces) {
+                piece.material = piece.material.tiled();
+            }
+        }
+
+        if (compactsTriangles) {
+            auto bytes = std::size_t(0);
+            for (auto& mesh : meshes) {
+                mesh.compact();
+
+                for (const auto& piece : mesh.pieces) {
+                    bytes += piece.compactData.size() * sizeof(Raytrace::Primitive::CompactTriangle);
+                }
+            }
+
+            std::printf("Compact triangles: %zu bytes\n", bytes);
+        }
+
+        loadSeconds += secondsSince(start);
+        start = std::chrono::steady_clock::now();
+
+        auto accelerator = Host::Accelerator();
+        accelerator.primitive.cacheDirectory = bvhCacheDirectory;
+        accelerator.primitive.encode(pool, meshes);
+        accelerator.instanced.encode(pool, meshes);
+
+        buildSeconds += secondsSince(start);
+
+        {
+            const auto stats = accelerator.stats(meshes);
+
+            for (const auto& [label, each] : { std::pair { "Primitive", stats.primitive }, std::pair { "Instanced", stats.instanced } }) {
+                std::printf(
+                    "%s: %zu boxes, %zu nodes (%zu leaves, depth %zu), %zu bytes (%zu bytes per node), %.3f ms\n",
+                    label,
+                    each.boxCount,
+                    each.nodeCount,
+                    each.leafCount,
+                    each.depth,
+                    each.bytes,
+                    each.bytesPerNode,
+                    each.seconds * 1e3
+                );
+            }
+        }
+
+        start = std::chrono::steady_clock::now();
+
+        const auto background = Host::Background::make();
+
+        const auto lut = Host::LUT::make(pool, lutOptions);
+        std::printf(
+            "LUT: %ux%u, %u samples, %s, %s in %.3f ms\n",
+            lutOptions.size,
+            lutOptions.size,
+            lutOptions.sampleCount,
+            lutOptions.format == Host::LUT::Format::rg16Float ? "rg16f" : "rg32f",
+            lut.stats.isCached ? "loaded" : "generated",
+            lut.stats.seconds * 1e3
+        );
+
+        const auto env = Host::Env::make(background, lut, envOptions);
+
+        auto raytracer = Host::Raytracer(resolution);
+        raytracer.tracesPrimaryInPackets = tracesPrimaryInPackets;
+        raytracer.tracesInWavefronts = tracesInWavefronts;
+        raytracer.reordersRays = reordersRays;
+        raytracer.maxTraceCount = maxTraceCount;
+        raytracer.taskSize = taskSize;
+
+        setupSeconds += secondsSince(start);
+
+        auto stats = Host::Raytracer::Stats();
+        auto sampleCount = uint64_t(0);
+        auto refitCount = uint32_t(0);
+
+        for (uint32_t f = 0; f < frameCount; f++) {
+            if (f != 0) {
+                start = std::chrono::steady_clock::now();
+
+                for (auto& instance : meshes[0].instances) {
+                    instance.transform.translate += motion;
+                }
+
+                accelerator.instanced.encode(pool, meshes);
+                refitCount += accelerator.instanced.hasRefitted ? 1 : 0;
+
+                buildSeconds += secondsSince(start);
+            }
+
+            start = std::chrono::steady_clock::now();
+
+            auto acceleration = Host::Acceleration(accelerator.instanced.target, meshes);
+
+            // Each frame starts over, as the schedule has no samples yet, with samples of its own.
+            const auto frame = Raytrace::Frame { .id = f };
+            auto schedule = Host::Schedule(raytracer.target.resolution, scheduleOptions);
+            auto passCount = uint32_t(0);
+
+            while (true) {
+                stats += raytracer.encode(pool, frame, schedule, background, env, acceleration);
+                passCount++;
+
+                if (!schedule.advance(raytracer.measure(pool, schedule))) {
+                    break;
+                }
+            }
+
+            sampleCount += schedule.sampleCount();
+
+            traceSeconds += secondsSince(start);
+
+            if (scheduleOptions.threshold > 0) {
+                std::printf(
+                    "Noise: %.4f (threshold %.4f) after %u passes\n",
+                    raytracer.measure(pool, schedule).errorIn(scheduleOptions.regionOrigin, scheduleOptions.regionSize),
+                    scheduleOptions.threshold,
+                    passCount
+                );
+            }
+
+            if (denoises) {
+                auto denoiser = Host::Denoiser(raytracer.target.resolution);
+                const auto denoised = denoiser.encode(pool, raytracer, schedule);
+
+                denoiseSeconds += denoised.seconds;
+            }
+
+            start = std::chrono::steady_clock::now();
+
+            Host::Image::save(raytracer.target.texture, frameCount == 1 ? outputPath : framePathOf(outputPath, f));
+
+            if (!heatmapPath.empty()) {
+                Host::Image::save(schedule.heatmap(), frameCount == 1 ? heatmapPath : framePathOf(heatmapPath, f));
+            }
+
+            outputSeconds += secondsSince(start);
+        }
+
+        const auto pixelCount = double(raytracer.target.resolution.x) * raytracer.target.resolution.y * frameCount;
+
+        std::printf(
+            "Frames: %u at %ux%u (%u refitted), %.2f samples per pixel\n",
+            frameCount,
+            raytracer.target.resolution.x,
+            raytracer.target.resolution.y,
+            refitCount,
+            double(sampleCount) / pixelCount
+        );
+
+        // The throughput counts the rays actually traced, so the kernel, which shares the camera ray of a pixel
+        // across the samples of a pass, traces fewer of them than wavefronts for the same image.
+        std::printf(
+            "Rays: %llu (%llu primary), Time: %.3f s, Throughput: %.3f Mrays/s (%.3f Mrays/s per thread, %zu threads)\n",
+            static_cast<unsigned long long>(stats.rayCount),
+            static_cast<unsigned long long>(stats.primaryRayCount),
+            stats.seconds,
+            stats.raysPerSecond() / 1e6,
+            stats.raysPerSecond() / 1e6 / double(pool.size()),
+            pool.size()
+        );
+
+        // Every ray belongs to a path of a sample, so this tells how early the roulette ends them.
+        // Each path starts with its camera ray, however many samples share it, and the bounces follow.
+        std::printf(
+            "Path length: %.3f rays per sample on average (at most %u)\n",
+            (maxTraceCount != 0 ? 1.0 : 0.0)
+                + double(stats.rayCount - stats.primaryRayCount) / double(std::max<uint64_t>(sampleCount, 1)),
+            maxTraceCount
+        );
+
+        std::printf(
+            "Shadow rays: %llu, %.3f per sample\n",
+            static_cast<unsigned long long>(stats.shadowRayCount),
+            double(stats.shadowRayCount) / double(std::max<uint64_t>(sampleCount, 1))
+        );
+
+        if (Host::NodeVisits::isEnabled) {
+            std::printf(
+                "Nodes: %.2f visits per ray, %.2f visits per shadow ray, %.2f%% missed in a %zu KiB cache\n",
+                double(stats.nodeVisitCount - stats.shadowNodeVisitCount) / double(std::max<uint64_t>(stats.rayCount, 1)),
+                double(stats.shadowNodeVisitCount) / double(std::max<uint64_t>(stats.shadowRayCount, 1)),
+                double(stats.nodeMissCount) / double(std::max<uint64_t>(stats.nodeVisitCount, 1)) * 100,
+                Host::NodeVisits::lineCount * sizeof(Host::WideBVH::Node) / 1024
+            );
+        }
+
+        // The trace covers the measures of the passes too, which the throughput above leaves out.
+        std::printf(
+            "Breakdown: load %.3f ms, BVH %.3f ms, setup %.3f ms, trace %.3f ms, denoise %.3f ms, output %.3f ms\n",
+            loadSeconds * 1e3,
+            buildSeconds * 1e3,
+            setupSeconds * 1e3,
+            traceSeconds * 1e3,
+            denoiseSeconds * 1e3,
+            outputSeconds * 1e3
+        );
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "Error:\n%s\n", error.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -8,101 +8,180 @@ import MetalKit
 struct App {
     private(set) var args: Args
 
+    private var device: any MTLDevice
     private var commandQueue: any MTLCommandQueue
-    private var prelight: Prelight
+
+    // The lookup table depends on no source, so every source of a batch shares it.
+    private var env: Prelight.Env
 }
 
 extension App {
     init(args: Args, device: some MTLDevice) throws {
         self.args = args
+        self.device = device
 
         commandQueue = device.makeCommandQueue()!
 
-        do {
-            let source = try MTKTextureLoader.init(device: device).newTexture(
-                URL: args.sourceURL,
+        env = try .init(device: device)
+    }
+}
+
+extension App {
+    // Prelights the sources one after another as a pipeline,
+    // where the source after the current one is decoded and the one before it is saved while the GPU prefilters it.
+    // At most a source in each of the stages is in flight, which bounds the memory of a batch of any size.
+    func run() async throws {
+        let lut = try await preLightEnv()
+
+        var decoding: Task<any MTLTexture, any Error>? = decodeInBackground(args.sourceURLs.first)
+        var saving: Task<Void, any Error>?
+
+        for (i, url) in args.sourceURLs.enumerated() {
+            let source = try await decoding!.value
+            decoding = decodeInBackground(args.sourceURLs.dropFirst(i + 1).first)
+
+            let prelight = try await preLight(source, label: url.lastPathComponent)
+
+            try await saving?.value
+            saving = Task { [self] in
+                try await save(prelight, lut: lut, for: url)
+            }
+        }
+
+        try await saving?.value
+    }
+}
+
+extension App {
+    private func preLightEnv() async throws -> Encoded {
+        let command = commandQueue.makeCommandBuffer()!
+        command.label = "Env"
+
+        try await process(label: "Prelight: Env") {
+            env.encode(to: command)
+            try await command.commitAndWait()
+        }
+
+        return try await encode(env.target, faceCount: 1, levels: [env.target])
+    }
+
+    private func decodeInBackground(_ url: URL?) -> Task<any MTLTexture, any Error>? {
+        guard let url else { return nil }
+
+        return Task { [self] in
+            try await decode(url)
+        }
+    }
+
+    private func decode(_ url: URL) async throws -> any MTLTexture {
+        var source: (any MTLTexture)?
+
+        try await process(label: "Decode: \(url.lastPathComponent)") {
+            source = try await MTKTextureLoader.init(device: device).newTexture(
+                URL: url,
                 options: [
                     .textureUsage: MTLTextureUsage.shaderRead.rawValue,
                     .textureStorageMode: MTLStorageMode.private.rawValue,
                     .cubeLayout: MTKTextureLoader.CubeLayout.vertical.rawValue,
-                    .generateMipmaps: false,
+                    // Specular reads lower levels for wider samples.
+                    .generateMipmaps: true,
                 ]
             )
+        }
 
-            prelight = .init(
-                diffuse: try .init(device: device, source: source),
-                specular: try .init(device: device, source: source),
-                env: try .init(device: device)
+        return source!
+    }
+
+    // Diffuse and Specular only read the source, so they are committed together for the GPU to overlap them.
+    private func preLight(_ source: some MTLTexture, label: String) async throws -> Prelight {
+        let prelight = Prelight.init(
+            diffuse: try .init(device: device, source: source, format: args.radianceFormat, projects: args.projectsDiffuse),
+            specular: try .init(device: device, source: source, format: args.radianceFormat)
+        )
+
+        try await process(label: "Prelight: \(label)") {
+            let commands = (
+                diffuse: commandQueue.makeCommandBuffer()!,
+                specular: commandQueue.makeCommandBuffer()!
             )
+            commands.diffuse.label = "Diffuse"
+            commands.specular.label = "Specular"
+
+            prelight.diffuse.encode(to: commands.diffuse)
+            prelight.specular.encode(to: commands.specular)
+
+            async let diffuse: () = commands.diffuse.commitAndWait()
+            async let specular: () = commands.specular.commitAndWait()
+
+            _ = try await (diffuse, specular)
         }
+
+        return prelight
     }
 }
 
 extension App {
-    func preLight() async throws {
-        do {
-            let command = commandQueue.makeCommandBuffer()!
-            command.label = "Diffuse"
-
-            try await process(label: "Prelight: Diffuse") {
-                try await command.complete {
-                    try command.commit {
-                        prelight.diffuse.encode(to: command)
-                    }
-                }
-            }
-        }
+    // A prelit texture as a container, and as an image of each level when PNGs are saved too.
+    struct Encoded {
+        var container: Data
+        var images: [CGImage]
+    }
 
-        do {
-            let command = commandQueue.makeCommandBuffer()!
-            command.label = "Specular"
-
-            try await process(label: "Prelight: Specular") {
-                try await command.complete {
-                    try command.commit {
-                        prelight.specular.encode(to: command)
-                    }
-                }
-            }
-        }
+    private func encode(_ texture: some MTLTexture, faceCount: Int, levels: [any MTLTexture]) async throws -> Encoded {
+        return .init(
+            container: try await Container.encode(texture, faceCount: faceCount, with: commandQueue),
+            images: args.savesPNG ? levels.compactMap { image(of: $0) } : []
+        )
+    }
 
-        do {
-            let command = commandQueue.makeCommandBuffer()!
-            command.label = "Env"
-
-            try await process(label: "Prelight: Env") {
-                try await command.complete {
-                    try command.commit {
-                        prelight.env.encode(to: command)
-                    }
-                }
-            }
-        }
+    private func image(of texture: some MTLTexture) -> CGImage? {
+        return texture.into(
+            in: CGColorSpace.init(name: CGColorSpace.linearSRGB)!,
+            mipmapLevel: 0
+        )
     }
 }
 
 extension App {
-    func save() async throws {
-        async let diffuse: () = save(prelight.diffuse.target, label: "Prelight_Diffuse")
-        async let specular: () = save(prelight.specular.target, label: "Prelight_Specular")
-        async let env: () = save(prelight.env.target, label: "Prelight_Env_GGX")
+    private func save(_ prelight: Prelight, lut: Encoded, for sourceURL: URL) async throws {
+        async let diffuse: () = save(
+            try await encode(prelight.diffuse.target, faceCount: 6, levels: [prelight.diffuse.target]),
+            label: "Prelight_Diffuse",
+            for: sourceURL
+        )
+        async let specular: () = save(
+            try await encode(prelight.specular.target, faceCount: 6, levels: prelight.specular.levels),
+            label: "Prelight_Specular",
+            for: sourceURL
+        )
+        async let env: () = save(lut, label: "Prelight_Env_GGX", for: sourceURL)
 
         _ = try await (diffuse, specular, env)
     }
 
-    private func save(_ texture: some MTLTexture, label: String) async throws {
-        let image: CGImage = texture.into(
-            in: CGColorSpace.init(name: CGColorSpace.linearSRGB)!,
-            mipmapLevel: 0
-        )!
+    // Saves the container as <name>_<label>.prelit with all the levels,
+    // and each image as a PNG of its own, as PNG has no mipmaps,
+    // the first as <name>_<label>.png and the others as <name>_<label>_1.png, _2 and so on.
+    private func save(_ encoded: Encoded, label: String, for sourceURL: URL) async throws {
+        let urlFor = { (suffix: String, pathExtension: String) in
+            let name = (sourceURL.lastPathComponent as NSString).deletingPathExtension
+            return sourceURL.deletingLastPathComponent().appending(path: "\(name)_\(label)\(suffix).\(pathExtension)")
+        }
+
+        do {
+            let url = urlFor("", "prelit")
 
-        let url = ({
-            let name = (args.sourceURL.lastPathComponent as NSString).deletingPathExtension
-            return args.sourceURL.deletingLastPathComponent().appending(path: "\(name)_\(label).png")
-        }) ()
+            try await process(label: "Save: \(url.lastPathComponent)") {
+                try encoded.container.write(to: url, options: .atomic)
+            }
+        }
 
-        try await process(label: "Save: \(url.lastPathComponent)") {
-            try image.save(at: url, as: .png)
+        for (i, image) in encoded.images.enumerated() {
+            let url = urlFor(i == 0 ? "" : "_\(i)", "png")
+
+            try await process(label: "Save: \(url.lastPathComponent)") {
+                try image.save(at: url, as: .png)
+            }
         }
     }
 }
@@ -118,8 +197,18 @@ extension App {
 
 extension App {
     struct Args {
-        var sourceURL: URL
+        var sourceURLs: [URL]
         var capturesFrame: Bool = false
+        var projectsDiffuse: Bool = false
+        var savesPNG: Bool = false
+        var packsRadiance: Bool = false
+    }
+}
+
+extension App.Args {
+    // The format of the diffuse and the specular, which keep radiance beyond 1 either way.
+    var radianceFormat: MTLPixelFormat {
+        packsRadiance ? .rgb9e5Float : .rgba16Float
     }
 }
 
@@ -134,7 +223,18 @@ extension App.Args {
             return (nil, reportError(message: "<source>: the file wad not found: '\(sourceURL.path())'"))
         }
 
-        var args = Self.init(sourceURL: sourceURL)
+        let sourceURLs: [URL]
+        do {
+            sourceURLs = try sourceURLsIn(sourceURL)
+        } catch {
+            return (nil, reportError(message: "<source>: \(error.localizedDescription)"))
+        }
+
+        guard !sourceURLs.isEmpty else {
+            return (nil, reportError(message: "<source>: no sources were found: '\(sourceURL.path())'"))
+        }
+
+        var args = Self.init(sourceURLs: sourceURLs)
 
         let options = arguments.suffix(from: 2)
         for option in options {
@@ -143,12 +243,51 @@ extension App.Args {
                 continue
             }
 
+            if option == "--diffuse-sh" {
+                args.projectsDiffuse = true
+                continue
+            }
+
+            if option == "--png" {
+                args.savesPNG = true
+                continue
+            }
+
+            if option == "--rgb9e5" {
+                args.packsRadiance = true
+                continue
+            }
+
             return (nil, reportError(message: "unknown option: \(option)"))
         }
 
         return (args, nil)
     }
 
+    static let sourceExtensions: Set<String> = ["png", "jpg", "jpeg", "hdr", "exr"]
+
+    // A source is an image, a directory of images, or a manifest (.txt) listing an image for each line,
+    // relative to the manifest unless absolute.
+    static func sourceURLsIn(_ url: URL) throws -> [URL] {
+        if url.hasDirectoryPath {
+            return try FileManager.default.contentsOfDirectory(at: url, includingPropertiesForKeys: nil)
+                .filter { sourceExtensions.contains($0.pathExtension.lowercased()) }
+                // Skip what Prelight has written next to the sources.
+                .filter { !$0.deletingPathExtension().lastPathComponent.contains("_Prelight_") }
+                .sorted { $0.lastPathComponent < $1.lastPathComponent }
+        }
+
+        if url.pathExtension.lowercased() == "txt" {
+            return try String.init(contentsOf: url, encoding: .utf8)
+                .split(whereSeparator: \.isNewline)
+                .map { $0.trimmingCharacters(in: .whitespaces) }
+                .filter { !$0.isEmpty && !$0.hasPrefix("#") }
+                .map { URL.init(fileURLWithPath: $0, relativeTo: url.deletingLastPathComponent()) }
+        }
+
+        return [url]
+    }
+
     static var help: String {
         """
 # Prelight
@@ -156,9 +295,20 @@ extension App.Args {
 ## Usage
 Prelight <source>
 
+<source> is an image of a cube laid out vertically, a directory of them, or a manifest (.txt) listing one for each line.
+The images are prelit one after another, saving each next to itself
+as containers of float texels (.prelit), which Raytrace maps as they are.
+
 ## Options
 --captures-frame
   Captures the frame of the Metal workload
+--diffuse-sh
+  Reconstructs the diffuse irradiance from the source projected into 9 spherical harmonics
+  instead of integrating 1024 samples for each texel
+--png
+  Saves PNGs of the levels too, which clamp the radiance to 1
+--rgb9e5
+  Packs the diffuse and the specular into RGB9E5 instead of RGBA16F, which halves them
 """
     }
 
@@ -173,7 +323,7 @@ Error:
 extension App.Args: CustomStringConvertible {
     var description: String {
     """
-<source>: \(sourceURL.path())
+<source>: \(sourceURLs.map { $0.path() }.joined(separator: ", "))
 """
     }
 }
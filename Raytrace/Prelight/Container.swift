@@ -0,0 +1,166 @@
+// tomocy
+
+import Foundation
+import Metal
+
+// Container holds the levels of a prelit texture as they are in memory, which Raytrace.Container maps and uploads as is,
+// keeping the full range of radiance that PNG clamps.
+//
+// The header takes the first page:
+//   magic "PLIT", then UInt32s of version, format, face count, size (of a face on the first level), level count and alignment.
+// The payload of each face of each level follows, level by level, each starting on a page of alignment bytes,
+// whose rows run from the top of the face as the faces of the targets do.
+// The file is padded to a whole page, so that it can be mapped as a buffer without a copy.
+enum Container {}
+
+extension Container {
+    static let magic: [UInt8] = Array("PLIT".utf8)
+    static let version: UInt32 = 1
+
+    // The pages of Apple silicon, which are also whole pages of Intel Macs.
+    static let alignment = 16384
+}
+
+extension Container {
+    enum Format: UInt32 {
+        case rgba16Float = 0
+        case rgb9e5Float = 1
+        case rg16Float = 2
+    }
+}
+
+extension Container.Format {
+    init?(_ format: MTLPixelFormat) {
+        switch format {
+        case .rgba16Float:
+            self = .rgba16Float
+        case .rgb9e5Float:
+            self = .rgb9e5Float
+        case .rg16Float:
+            self = .rg16Float
+        default:
+            return nil
+        }
+    }
+
+    var bytesPerPixel: Int {
+        switch self {
+        case .rgba16Float:
+            return 8
+        case .rgb9e5Float, .rg16Float:
+            return 4
+        }
+    }
+}
+
+extension Container {
+    struct Header {
+        var format: Format
+        var faceCount: Int
+        var size: Int
+        var levelCount: Int
+    }
+}
+
+extension Container.Header {
+    func size(at level: Int) -> Int {
+        return max(size >> level, 1)
+    }
+
+    func length(at level: Int) -> Int {
+        let size = size(at: level)
+        return size * size * format.bytesPerPixel
+    }
+
+    // The offset of the payload of the face of the level, where the header takes the first page.
+    func offset(at level: Int, face: Int) -> Int {
+        var offset = Container.alignment
+
+        for other in 0..<level {
+            offset += length(at: other).align(by: Container.alignment) * faceCount
+        }
+
+        return offset + length(at: level).align(by: Container.alignment) * face
+    }
+
+    var length: Int {
+        return offset(at: levelCount, face: 0)
+    }
+
+    func write(to destination: UnsafeMutableRawPointer) {
+        destination.copyMemory(from: Container.magic, byteCount: Container.magic.count)
+
+        let values = [
+            Container.version,
+            format.rawValue,
+            UInt32(faceCount),
+            UInt32(size),
+            UInt32(levelCount),
+            UInt32(Container.alignment),
+        ]
+        for (i, value) in values.enumerated() {
+            destination.storeBytes(of: value.littleEndian, toByteOffset: 4 + i * 4, as: UInt32.self)
+        }
+    }
+}
+
+extension Container {
+    enum Error: Swift.Error {
+        case unsupported(MTLPixelFormat)
+    }
+}
+
+extension Container {
+    // Reads the texture back into a container, where the faces lie from top to bottom in each level of the texture.
+    static func encode(
+        _ texture: some MTLTexture,
+        faceCount: Int,
+        with queue: some MTLCommandQueue
+    ) async throws -> Data {
+        guard let format = Format.init(texture.pixelFormat) else {
+            throw Error.unsupported(texture.pixelFormat)
+        }
+
+        let header = Header.init(
+            format: format,
+            faceCount: faceCount,
+            size: texture.width,
+            levelCount: texture.mipmapLevelCount
+        )
+
+        let buffer = queue.device.makeBuffer(length: header.length, options: .storageModeShared)!
+        buffer.label = "Container"
+
+        header.write(to: buffer.contents())
+
+        let command = queue.makeCommandBuffer()!
+        command.label = "Container"
+
+        do {
+            let encoder = command.makeBlitCommandEncoder()!
+            defer { encoder.endEncoding() }
+
+            for level in 0..<header.levelCount {
+                let size = header.size(at: level)
+
+                for face in 0..<header.faceCount {
+                    encoder.copy(
+                        from: texture,
+                        sourceSlice: 0,
+                        sourceLevel: level,
+                        sourceOrigin: .init(x: 0, y: face * size, z: 0),
+                        sourceSize: .init(width: size, height: size, depth: 1),
+                        to: buffer,
+                        destinationOffset: header.offset(at: level, face: face),
+                        destinationBytesPerRow: size * format.bytesPerPixel,
+                        destinationBytesPerImage: header.length(at: level)
+                    )
+                }
+            }
+        }
+
+        try await command.commitAndWait()
+
+        return Data.init(bytes: buffer.contents(), count: buffer.length)
+    }
+}
@@ -0,0 +1,179 @@
+// tomocy
+
+#include "../Shader/Coordinate.h"
+#include "../Shader/SphericalHarmonics.h"
+#include "../Shader/Texture/Texture+Cube.h"
+#include <metal_stdlib>
+
+namespace Prelight {
+namespace Diffuse {
+namespace SH {
+using Irradiance = Shader::SphericalHarmonics::Irradiance;
+
+// A threadgroup has up to 1024 threads, which is 32 SIMD groups of 32 threads.
+constexpr constant uint maxSIMDGroupCount = 32;
+
+// Sums the irradiance of the threads in the threadgroup, which only the first thread gets.
+// The sums of the SIMD groups meet in sums, the coefficients of each group one after another.
+Irradiance sumInGroup(
+    const thread Irradiance& irradiance,
+    threadgroup float3* sums,
+    const uint simdGroupIndex,
+    const uint simdGroupCount,
+    const uint indexInSIMDGroup
+)
+{
+    constexpr auto count = Irradiance::coefficientCount;
+
+    for (uint i = 0; i < count; i++) {
+        const auto sum = metal::simd_sum(irradiance.coefficients[i]);
+
+        if (indexInSIMDGroup == 0) {
+            sums[simdGroupIndex * count + i] = sum;
+        }
+    }
+
+    metal::threadgroup_barrier(metal::mem_flags::mem_threadgroup);
+
+    Irradiance result;
+    if (simdGroupIndex == 0 && indexInSIMDGroup == 0) {
+        for (uint group = 0; group < simdGroupCount; group++) {
+            for (uint i = 0; i < count; i++) {
+                result.coefficients[i] += sums[group * count + i];
+            }
+        }
+    }
+
+    return result;
+}
+}
+}
+}
+
+namespace Prelight {
+namespace Diffuse {
+namespace SH {
+struct ProjectArgs {
+public:
+    Shader::Texture::Cube<float, metal::access::sample> source;
+
+    // The irradiance of each threadgroup.
+    device Irradiance* partials;
+};
+
+// Projects each texel of the source, weighted by the solid angle that it covers,
+// and sums the projections of the threadgroup into its partial.
+kernel void project(
+    const uint2 id [[thread_position_in_grid]],
+    const uint2 groupID [[threadgroup_position_in_grid]],
+    const uint2 groupCount [[threadgroups_per_grid]],
+    const uint simdGroupIndex [[simdgroup_index_in_threadgroup]],
+    const uint simdGroupCount [[simdgroups_per_threadgroup]],
+    const uint indexInSIMDGroup [[thread_index_in_simdgroup]],
+    constant ProjectArgs& args [[buffer(0)]]
+)
+{
+    const auto size = args.source.size();
+
+    // Threads beyond the source still take part in the sum.
+    Irradiance irradiance;
+    if (id.x < size && id.y < size * 6) {
+        const auto inScreen = Shader::Coordinate::InScreen(id);
+        const auto inFace = args.source.coordinateInFace(inScreen);
+
+        // The center of the texel, so that the solid angles of the texels add up to the sphere.
+        const auto inUV = Shader::Coordinate::InUV((float2(inFace.value()) + 0.5) / float(size));
+        const auto inNDC = Shader::Coordinate::InNDC::from(inUV, args.source.faceFor(inScreen));
+
+        const auto color = args.source.readInFace(inScreen).rgb;
+
+        irradiance = irradiance.adding(
+            color,
+            metal::normalize(inNDC.value()),
+            Irradiance::solidAngleOf(inNDC.value(), size)
+        );
+    }
+
+    threadgroup float3 sums[maxSIMDGroupCount * Irradiance::coefficientCount];
+    const auto sum = sumInGroup(irradiance, sums, simdGroupIndex, simdGroupCount, indexInSIMDGroup);
+
+    if (simdGroupIndex == 0 && indexInSIMDGroup == 0) {
+        args.partials[groupID.y * groupCount.x + groupID.x] = sum;
+    }
+}
+}
+}
+}
+
+namespace Prelight {
+namespace Diffuse {
+namespace SH {
+struct ReduceArgs {
+public:
+    device const Irradiance* partials;
+    uint partialCount;
+
+    device Irradiance* irradiance;
+};
+
+// Sums the partials in a single threadgroup.
+kernel void reduce(
+    const uint index [[thread_index_in_threadgroup]],
+    const uint threadCount [[threads_per_threadgroup]],
+    const uint simdGroupIndex [[simdgroup_index_in_threadgroup]],
+    const uint simdGroupCount [[simdgroups_per_threadgroup]],
+    const uint indexInSIMDGroup [[thread_index_in_simdgroup]],
+    constant ReduceArgs& args [[buffer(0)]]
+)
+{
+    Irradiance irradiance;
+    for (uint i = index; i < args.partialCount; i += threadCount) {
+        const Irradiance partial = args.partials[i];
+        irradiance = irradiance.adding(partial);
+    }
+
+    threadgroup float3 sums[maxSIMDGroupCount * Irradiance::coefficientCount];
+    const auto sum = sumInGroup(irradiance, sums, simdGroupIndex, simdGroupCount, indexInSIMDGroup);
+
+    if (index == 0) {
+        *args.irradiance = sum;
+    }
+}
+}
+}
+}
+
+namespace Prelight {
+namespace Diffuse {
+namespace SH {
+struct ReconstructArgs {
+public:
+    device const Irradiance* irradiance;
+
+    // Laid out as the faces of a cube from top to bottom, as the target of Prelight::Diffuse::compute.
+    metal::texture2d<float, metal::access::write> target;
+};
+
+kernel void reconstruct(
+    const uint2 id [[thread_position_in_grid]],
+    constant ReconstructArgs& args [[buffer(0)]]
+)
+{
+    const auto size = args.target.get_width();
+    if (id.x >= size || id.y >= size * 6) {
+        return;
+    }
+
+    const auto inScreen = Shader::Coordinate::InScreen(id);
+    const auto inFace = Shader::Coordinate::InFace::from(inScreen, size);
+    const auto inUV = Shader::Coordinate::InUV::from(inFace, size);
+    const auto inNDC = Shader::Coordinate::InNDC::from(inUV, Shader::Coordinate::Face(id.y / size));
+
+    const Irradiance irradiance = *args.irradiance;
+    const auto color = irradiance.at(metal::normalize(inNDC.value()));
+
+    args.target.write(float4(color, 1), inScreen.value());
+}
+}
+}
+}
@@ -0,0 +1,252 @@
+// tomocy
+
+import Metal
+
+extension Prelight.Diffuse {
+    // SH projects the source into spherical harmonics once, sums the projections of the texels in two passes,
+    // and reconstructs the irradiance of each texel of the target from the sum,
+    // instead of integrating the hemisphere of each texel as Kernel does.
+    struct SH {
+        private var pipelineStates: PipelineStates
+        private var args: Args
+
+        private var source: any MTLTexture
+
+        // The irradiance of each threadgroup of project, and the sum of them,
+        // each of which is a Shader::SphericalHarmonics::Irradiance.
+        private var partials: any MTLBuffer
+        private(set) var irradiance: any MTLBuffer
+
+        private(set) var target: any MTLTexture
+    }
+}
+
+extension Prelight.Diffuse.SH {
+    // Shader::SphericalHarmonics::Irradiance holds 9 float3s, which take 16 bytes each.
+    static let irradianceSize = MemoryLayout<SIMD3<Float>>.stride * 9
+
+    static let projectThreadsSizePerGroup = MTLSize.init(width: 16, height: 16, depth: 1)
+    static let reduceThreadsSizePerGroup = MTLSize.init(width: 256, height: 1, depth: 1)
+}
+
+extension Prelight.Diffuse.SH {
+    init(device: some MTLDevice, source: some MTLTexture, format: MTLPixelFormat) throws {
+        let lib = device.makeDefaultLibrary()!
+
+        let fns = (
+            project: lib.makeFunction(name: "Prelight::Diffuse::SH::project")!,
+            reduce: lib.makeFunction(name: "Prelight::Diffuse::SH::reduce")!,
+            reconstruct: lib.makeFunction(name: "Prelight::Diffuse::SH::reconstruct")!
+        )
+
+        pipelineStates = .init(
+            project: try Prelight.Kernel.PipelineStates.make(with: device, for: fns.project),
+            reduce: try Prelight.Kernel.PipelineStates.make(with: device, for: fns.reduce),
+            reconstruct: try Prelight.Kernel.PipelineStates.make(with: device, for: fns.reconstruct)
+        )
+        args = .init(
+            project: fns.project.makeArgumentEncoder(bufferIndex: 0),
+            reduce: fns.reduce.makeArgumentEncoder(bufferIndex: 0),
+            reconstruct: fns.reconstruct.makeArgumentEncoder(bufferIndex: 0)
+        )
+
+        do {
+            self.source = source
+            source.label!.append(",Diffuse/SH/Source")
+        }
+
+        do {
+            let groupCount = Self.projectGroupCount(for: source)
+
+            partials = device.makeBuffer(
+                length: Self.irradianceSize * groupCount.width * groupCount.height,
+                options: .storageModePrivate
+            )!
+            partials.label = "Diffuse/SH/Partials"
+        }
+
+        irradiance = device.makeBuffer(
+            length: Self.irradianceSize,
+            options: .storageModeShared
+        )!
+        irradiance.label = "Diffuse/SH/Irradiance"
+
+        target = Texture.make2D(
+            with: device,
+            label: "Diffuse/SH/Target",
+            format: format,
+            size: .init(source.width, source.height * 6 /* face count in a cube */),
+            usage: [.shaderRead, .shaderWrite],
+            storageMode: .private,
+            mipmapped: false
+        )!
+    }
+}
+
+extension Prelight.Diffuse.SH {
+    static func projectGroupCount(for source: some MTLTexture) -> MTLSize {
+        let size = projectThreadsSizePerGroup
+
+        return .init(
+            width: source.width.align(by: size.width) / size.width,
+            height: (source.height * 6).align(by: size.height) / size.height,
+            depth: 1
+        )
+    }
+}
+
+extension Prelight.Diffuse.SH {
+    func encode(to buffer: some MTLCommandBuffer) {
+        let encoder = buffer.makeComputeCommandEncoder()!
+        defer { encoder.endEncoding() }
+
+        encoder.label = "Diffuse/SH"
+
+        let groupCount = Self.projectGroupCount(for: source)
+
+        do {
+            encoder.setComputePipelineState(pipelineStates.project)
+
+            let buffer = args.buildProject(source, partials, with: encoder, label: "Diffuse/SH/ProjectArgs")!
+            encoder.setBuffer(buffer, offset: 0, index: 0)
+
+            encoder.dispatchThreadgroups(groupCount, threadsPerThreadgroup: Self.projectThreadsSizePerGroup)
+        }
+
+        do {
+            encoder.setComputePipelineState(pipelineStates.reduce)
+
+            let buffer = args.buildReduce(
+                partials,
+                count: groupCount.width * groupCount.height,
+                irradiance,
+                with: encoder,
+                label: "Diffuse/SH/ReduceArgs"
+            )!
+            encoder.setBuffer(buffer, offset: 0, index: 0)
+
+            encoder.dispatchThreadgroups(
+                .init(width: 1, height: 1, depth: 1),
+                threadsPerThreadgroup: Self.reduceThreadsSizePerGroup
+            )
+        }
+
+        do {
+            encoder.setComputePipelineState(pipelineStates.reconstruct)
+
+            let buffer = args.buildReconstruct(irradiance, target, with: encoder, label: "Diffuse/SH/ReconstructArgs")!
+            encoder.setBuffer(buffer, offset: 0, index: 0)
+
+            let threadsSizePerGroup = encoder.defaultThreadsSizePerGroup
+            let threadsGroupSize = encoder.threadsGroupSize(
+                for: .init(target.width, target.height),
+                as: threadsSizePerGroup
+            )
+
+            encoder.dispatchThreadgroups(
+                threadsGroupSize,
+                threadsPerThreadgroup: threadsSizePerGroup
+            )
+        }
+    }
+}
+
+extension Prelight.Diffuse.SH {
+    struct PipelineStates {
+        var project: any MTLComputePipelineState
+        var reduce: any MTLComputePipelineState
+        var reconstruct: any MTLComputePipelineState
+    }
+}
+
+extension Prelight.Diffuse.SH {
+    struct Args {
+        var project: any MTLArgumentEncoder
+        var reduce: any MTLArgumentEncoder
+        var reconstruct: any MTLArgumentEncoder
+    }
+}
+
+extension Prelight.Diffuse.SH.Args {
+    func buildProject(
+        _ source: some MTLTexture,
+        _ partials: some MTLBuffer,
+        with encoder: some MTLComputeCommandEncoder,
+        label: String
+    ) -> (any MTLBuffer)? {
+        guard let buffer = encoder.device.makeBuffer(
+            length: project.encodedLength
+        ) else { return nil }
+
+        buffer.label = label
+
+        project.setArgumentBuffer(buffer, offset: 0)
+
+        do {
+            encoder.useResource(source, usage: .read)
+            project.setTexture(source, index: 0)
+        }
+        do {
+            encoder.useResource(partials, usage: .write)
+            project.setBuffer(partials, offset: 0, index: 1)
+        }
+
+        return buffer
+    }
+
+    func buildReduce(
+        _ partials: some MTLBuffer,
+        count: Int,
+        _ irradiance: some MTLBuffer,
+        with encoder: some MTLComputeCommandEncoder,
+        label: String
+    ) -> (any MTLBuffer)? {
+        guard let buffer = encoder.device.makeBuffer(
+            length: reduce.encodedLength
+        ) else { return nil }
+
+        buffer.label = label
+
+        reduce.setArgumentBuffer(buffer, offset: 0)
+
+        do {
+            encoder.useResource(partials, usage: .read)
+            reduce.setBuffer(partials, offset: 0, index: 0)
+        }
+        do {
+            reduce.constantData(at: 1).storeBytes(of: UInt32(count), as: UInt32.self)
+        }
+        do {
+            encoder.useResource(irradiance, usage: .write)
+            reduce.setBuffer(irradiance, offset: 0, index: 2)
+        }
+
+        return buffer
+    }
+
+    func buildReconstruct(
+        _ irradiance: some MTLBuffer,
+        _ target: some MTLTexture,
+        with encoder: some MTLComputeCommandEncoder,
+        label: String
+    ) -> (any MTLBuffer)? {
+        guard let buffer = encoder.device.makeBuffer(
+            length: reconstruct.encodedLength
+        ) else { return nil }
+
+        buffer.label = label
+
+        reconstruct.setArgumentBuffer(buffer, offset: 0)
+
+        do {
+            encoder.useResource(irradiance, usage: .read)
+            reconstruct.setBuffer(irradiance, offset: 0, index: 0)
+        }
+        do {
+            encoder.useResource(target, usage: .write)
+            reconstruct.setTexture(target, index: 1)
+        }
+
+        return buffer
+    }
+}
@@ -4,30 +4,60 @@ import Metal
 
 extension Prelight {
     struct Diffuse {
-        private var kernel: Kernel
+        private var mode: Mode
     }
 }
 
 extension Prelight.Diffuse {
-    init(device: some MTLDevice, source: some MTLTexture) throws {
+    enum Mode {
+        // Integrates the hemisphere of each texel by Prelight::Diffuse::compute.
+        case integral(Prelight.Kernel)
+
+        // Reconstructs each texel from the source projected into spherical harmonics, see SH.
+        case sphericalHarmonics(SH)
+    }
+}
+
+extension Prelight.Diffuse {
+    init(device: some MTLDevice, source: some MTLTexture, format: MTLPixelFormat, projects: Bool = false) throws {
+        if projects {
+            mode = .sphericalHarmonics(try .init(device: device, source: source, format: format))
+            return
+        }
+
         let lib = device.makeDefaultLibrary()!
         let fn = lib.makeFunction(name: "Prelight::Diffuse::compute")!
 
-        kernel = try .init(
-            device: device,
-            label: "Diffuse",
-            function: fn,
-            source: source
+        mode = .integral(
+            try .init(
+                device: device,
+                label: "Diffuse",
+                function: fn,
+                source: source,
+                format: format
+            )
         )
     }
 }
 
 extension Prelight.Diffuse {
-    var target: some MTLTexture { kernel.target }
+    var target: any MTLTexture {
+        switch mode {
+        case let .integral(kernel):
+            return kernel.target
+        case let .sphericalHarmonics(sh):
+            return sh.target
+        }
+    }
 }
 
 extension Prelight.Diffuse {
     func encode(to buffer: some MTLCommandBuffer) {
-        kernel.encode(to: buffer)
+        switch mode {
+        case let .integral(kernel):
+            kernel.encode(to: buffer)
+        case let .sphericalHarmonics(sh):
+            sh.encode(to: buffer)
+        }
     }
 }
@@ -74,9 +74,9 @@ kernel void compute(
     } coordinates = {
         .inScreen = Shader::Coordinate::InScreen(id),
     };
-    coordinates.inUV = Shader::Coordinate::InUV::from(
-        coordinates.inScreen,
-        uint2(args.target.get_width(), args.target.get_height())
+    // The center of the texel, which keeps dotNV off 0 where the visibility divides by it.
+    coordinates.inUV = Shader::Coordinate::InUV(
+        (float2(coordinates.inScreen.value()) + 0.5) / float2(args.target.get_width(), args.target.get_height())
     );
 
     const auto dotNV = coordinates.inUV.value().x;
@@ -26,7 +26,8 @@ extension Prelight.Env {
         target = Texture.make2D(
             with: device,
             label: "Env/Target",
-            format: .bgra8Unorm,
+            // The scale and the bias of the albedo.
+            format: .rg16Float,
             size: .init(128, 128),
             usage: [.shaderRead, .shaderWrite],
             storageMode: .private,
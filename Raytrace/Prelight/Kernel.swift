@@ -15,7 +15,13 @@ extension Prelight {
 }
 
 extension Prelight.Kernel {
-    init(device: some MTLDevice, label: String, function: some MTLFunction, source: some MTLTexture) throws {
+    init(
+        device: some MTLDevice,
+        label: String,
+        function: some MTLFunction,
+        source: some MTLTexture,
+        format: MTLPixelFormat
+    ) throws {
         self.label = label
 
         pipelineStates = .init(
@@ -33,7 +39,7 @@ extension Prelight.Kernel {
         target = Texture.make2D(
             with: device,
             label: "\(label)/Target",
-            format: .bgra8Unorm,
+            format: format,
             size: .init(source.width, source.height * 6 /* face count in a cube */),
             usage: [.shaderRead, .shaderWrite],
             storageMode: .private,
@@ -5,14 +5,19 @@ import CoreImage
 import Metal
 
 extension MTLCommandBuffer {
-    func commit(_ code: () throws -> Void) throws {
-        try code()
-        commit()
-    }
+    // Commits and suspends until the GPU completes it, without blocking a thread as waitUntilCompleted does.
+    func commitAndWait() async throws {
+        await withCheckedContinuation { continuation in
+            addCompletedHandler { _ in
+                continuation.resume()
+            }
+
+            commit()
+        }
 
-    func complete(_ code: () throws -> Void) async throws {
-        try code()
-        waitUntilCompleted()
+        if let error {
+            throw error
+        }
     }
 }
 
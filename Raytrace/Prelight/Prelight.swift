@@ -5,5 +5,4 @@ import Metal
 struct Prelight {
     var diffuse: Diffuse
     var specular: Specular
-    var env: Env
 }
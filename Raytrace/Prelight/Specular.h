@@ -0,0 +1,103 @@
+// tomocy
+
+#pragma once
+
+#include "../Shader/Distribution.h"
+#include "../Shader/Geometry/Geometry+Normalized.h"
+#include "../Shader/PBR/PBR+CookTorrance.h"
+#include "../Shader/Sample.h"
+#include "../Shader/Texture/Texture+Cube.h"
+#include <metal_stdlib>
+
+namespace Prelight {
+namespace Specular {
+// The target has a level for each step of roughness, from 0 on the first level to 1 on the last,
+// halving down to faces of minSize texels, which Shader::PBR::IBL::Specular picks back by roughness.
+constexpr constant uint minSize = 4;
+
+inline uint levelCountFor(uint size)
+{
+    uint count = 1;
+    while (size / 2 >= minSize) {
+        size /= 2;
+        count++;
+    }
+
+    return count;
+}
+
+inline float roughnessAt(const uint level, const uint levelCount)
+{
+    return levelCount > 1 ? float(level) / float(levelCount - 1) : 0;
+}
+}
+}
+
+namespace Prelight {
+namespace Specular {
+// Integral reads each sample from the level of the mipmapped source whose texels cover about as much
+// as the sample stands for, which is what lets a few samples do the work of many on the first level
+// (filtered importance sampling, Krivanek and Colbert, 2008).
+struct Integral {
+public:
+    float3 integrate(const float roughness, const thread float3& reflect) const
+    {
+        // A mirror reflects the source as it is.
+        if (roughness == 0) {
+            return colorFor(reflect, 0).rgb;
+        }
+
+        // Assume normal == view == reflect.
+        const auto normal = Shader::Geometry::normalize(reflect);
+
+        // The solid angle that a texel of the first level covers, on average over the cube.
+        const auto size = float(source.raw().get_width());
+        const auto texelSolidAngle = 4 * M_PI_F / (6 * size * size);
+
+        float3 color = 0;
+        float weight = 0;
+
+        for (uint i = 0; i < sampleCount; i++) {
+            const auto v = Shader::Distribution::Hammersley::distribute(sampleCount, i);
+            const auto subject = Shader::Sample::GGX::sample(v, roughness, normal);
+            const auto light = 2 * metal::dot(reflect, subject) * subject - reflect;
+
+            const auto dotNL = metal::saturate(metal::dot(normal.value(), light));
+            if (dotNL <= 0) {
+                continue;
+            }
+
+            // The pdf of the light is D * dotNH / (4 * dotVH), which is D / 4 as the view is the normal.
+            const auto pdf = Shader::PBR::CookTorrance::D::compute(
+                                 roughness, normal, Shader::Geometry::normalize(subject)
+                             )
+                / 4;
+            const auto sampleSolidAngle = 1 / (float(sampleCount) * pdf);
+
+            // Each level quadruples the solid angle of a texel.
+            const auto lod = 0.5f * metal::log2(sampleSolidAngle / texelSolidAngle);
+
+            color += colorFor(light, lod).rgb * dotNL;
+            weight += dotNL;
+        }
+
+        return color / metal::max(weight, 1e-4);
+    }
+
+public:
+    float4 colorFor(const thread float3& direction, const float lod) const
+    {
+        constexpr auto sampler = metal::sampler(
+            metal::filter::linear,
+            metal::mip_filter::linear
+        );
+
+        return source.raw().sample(sampler, direction, metal::level(lod)) * M_PI_F;
+    }
+
+public:
+    uint sampleCount;
+    Shader::Texture::Cube<float, metal::access::sample> source;
+};
+}
+}
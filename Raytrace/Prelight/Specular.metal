@@ -1,86 +1,48 @@
 // tomocy
 
 #include "../Shader/Coordinate.h"
-#include "../Shader/Distribution.h"
-#include "../Shader/Sample.h"
-#include "Prelight.h"
+#include "Specular.h"
 #include <metal_stdlib>
 
 namespace Prelight {
 namespace Specular {
-struct Integral {
+struct Args {
 public:
-    float3 integrate(const float roughness, const thread float3& reflect) const
-    {
-        // Assume normal == reflect.
-        const auto normal = reflect;
-
-        float3 color = 0;
-        float weight = 0;
-
-        for (uint i = 0; i < sampleCount; i++) {
-            const auto v = Shader::Distribution::Hammersley::distribute(sampleCount, i);
-            const auto subject = Shader::Sample::GGX::sample(v, roughness, normal);
-            const auto light = 2 * metal::dot(reflect, subject) * subject - reflect;
-
-            const auto dotNL = metal::saturate(metal::dot(normal, light));
-            if (dotNL <= 0) {
-                continue;
-            }
-
-            color += colorFor(light).rgb * dotNL;
-            weight += dotNL;
-        }
-
-        return color / metal::max(weight, 1e-4);
-    }
-
-public:
-    float4 colorFor(const thread float3& direction) const
-    {
-        constexpr auto sampler = metal::sampler(
-            metal::filter::linear
-        );
+    Shader::Texture::Cube<float, metal::access::sample> source;
 
-        return source.raw().sample(sampler, direction) * M_PI_F;
-    }
+    // A level of the target, laid out as the faces of a cube from top to bottom.
+    metal::texture2d<float, metal::access::write> target;
 
-public:
+    float roughness;
     uint sampleCount;
-    Shader::Texture::Cube<float, metal::access::sample> source;
 };
-}
-}
 
-namespace Prelight {
-namespace Specular {
+// Prefilters the source for the roughness of a level of the target.
 kernel void compute(
     const uint2 id [[thread_position_in_grid]],
     constant Args& args [[buffer(0)]]
 )
 {
-    struct {
-        Shader::Coordinate::InScreen inScreen;
-        Shader::Coordinate::InFace inFace;
-        Shader::Coordinate::InUV inUV;
-        Shader::Coordinate::InNDC inNDC;
-    } coordinates = {
-        .inScreen = Shader::Coordinate::InScreen(id),
-    };
-    coordinates.inFace = args.source.coordinateInFace(coordinates.inScreen);
-    coordinates.inUV = Shader::Coordinate::InUV::from(coordinates.inFace, args.source.size());
-    coordinates.inNDC = Shader::Coordinate::InNDC::from(coordinates.inUV, args.source.faceFor(coordinates.inScreen));
+    const auto size = args.target.get_width();
+    if (id.x >= size || id.y >= size * 6) {
+        return;
+    }
+
+    const auto inScreen = Shader::Coordinate::InScreen(id);
+    const auto inFace = Shader::Coordinate::InFace::from(inScreen, size);
+    const auto inUV = Shader::Coordinate::InUV::from(inFace, size);
+    const auto inNDC = Shader::Coordinate::InNDC::from(inUV, Shader::Coordinate::Face(id.y / size));
 
-    const auto reflect = metal::normalize(coordinates.inNDC.value());
+    const auto reflect = metal::normalize(inNDC.value());
 
     const auto integral = Integral {
-        .sampleCount = 1024,
+        .sampleCount = args.sampleCount,
         .source = args.source,
     };
 
-    const auto color = integral.integrate(0.2, reflect);
+    const auto color = integral.integrate(args.roughness, reflect);
 
-    args.target.write(float4(color, 1), coordinates.inScreen.value());
+    args.target.write(float4(color, 1), inScreen.value());
 }
 }
 }
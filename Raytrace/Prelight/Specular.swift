@@ -3,31 +3,159 @@
 import Metal
 
 extension Prelight {
+    // Specular prefilters the source into a level of the target for each step of roughness,
+    // reading the mipmaps of the source so that each texel needs a few samples, see Prelight::Specular::Integral.
     struct Specular {
-        private var kernel: Kernel
+        private var pipelineState: any MTLComputePipelineState
+        private var args: Args
+
+        private var source: any MTLTexture
+
+        private(set) var target: any MTLTexture
+
+        // Each level of the target on its own, which the kernel writes one by one.
+        private(set) var levels: [any MTLTexture]
+    }
+}
+
+extension Prelight.Specular {
+    // Prelight::Specular::minSize.
+    static let minSize = 4
+
+    static let sampleCount = 64
+
+    static func levelCount(for size: Int) -> Int {
+        var size = size
+        var count = 1
+        while size / 2 >= minSize {
+            size /= 2
+            count += 1
+        }
+
+        return count
+    }
+
+    static func roughness(at level: Int, of levelCount: Int) -> Float {
+        return levelCount > 1 ? Float(level) / Float(levelCount - 1) : 0
     }
 }
 
 extension Prelight.Specular {
-    init(device: some MTLDevice, source: some MTLTexture) throws {
+    init(device: some MTLDevice, source: some MTLTexture, format: MTLPixelFormat) throws {
         let lib = device.makeDefaultLibrary()!
         let fn = lib.makeFunction(name: "Prelight::Specular::compute")!
 
-        kernel = try .init(
-            device: device,
-            label: "Specular",
-            function: fn,
-            source: source
+        pipelineState = try Prelight.Kernel.PipelineStates.make(with: device, for: fn)
+        args = .init(
+            encoder: fn.makeArgumentEncoder(bufferIndex: 0)
         )
+
+        do {
+            self.source = source
+            source.label!.append(",Specular/Source")
+        }
+
+        let levelCount = Self.levelCount(for: source.width)
+
+        target = Texture.make2D(
+            with: device,
+            label: "Specular/Target",
+            format: format,
+            size: .init(source.width, source.height * 6 /* face count in a cube */),
+            usage: [.shaderRead, .shaderWrite],
+            storageMode: .private,
+            mipmapped: true,
+            levelCount: levelCount
+        )!
+
+        levels = (0..<levelCount).map { [target] level in
+            let view = target.makeTextureView(
+                pixelFormat: target.pixelFormat,
+                textureType: .type2D,
+                levels: level..<(level + 1),
+                slices: 0..<1
+            )!
+            view.label = "Specular/Target/\(level)"
+
+            return view
+        }
     }
 }
 
 extension Prelight.Specular {
-    var target: some MTLTexture { kernel.target }
+    func encode(to buffer: some MTLCommandBuffer) {
+        let encoder = buffer.makeComputeCommandEncoder()!
+        defer { encoder.endEncoding() }
+
+        encoder.label = "Specular"
+
+        encoder.setComputePipelineState(pipelineState)
+
+        for (i, level) in levels.enumerated() {
+            do {
+                let buffer = args.build(
+                    source,
+                    level,
+                    roughness: Self.roughness(at: i, of: levels.count),
+                    sampleCount: Self.sampleCount,
+                    with: encoder,
+                    label: "Specular/Args/\(i)"
+                )!
+                encoder.setBuffer(buffer, offset: 0, index: 0)
+            }
+
+            do {
+                let threadsSizePerGroup = encoder.defaultThreadsSizePerGroup
+                let threadsGroupSize = encoder.threadsGroupSize(
+                    for: .init(level.width, level.height),
+                    as: threadsSizePerGroup
+                )
+
+                encoder.dispatchThreadgroups(
+                    threadsGroupSize,
+                    threadsPerThreadgroup: threadsSizePerGroup
+                )
+            }
+        }
+    }
 }
 
 extension Prelight.Specular {
-    func encode(to buffer: some MTLCommandBuffer) {
-        kernel.encode(to: buffer)
+    struct Args {
+        var encoder: any MTLArgumentEncoder
+    }
+}
+
+extension Prelight.Specular.Args {
+    func build(
+        _ source: some MTLTexture,
+        _ target: some MTLTexture,
+        roughness: Float,
+        sampleCount: Int,
+        with encoder: some MTLComputeCommandEncoder,
+        label: String
+    ) -> (any MTLBuffer)? {
+        guard let buffer = encoder.device.makeBuffer(
+            length: self.encoder.encodedLength
+        ) else { return nil }
+
+        buffer.label = label
+
+        self.encoder.setArgumentBuffer(buffer, offset: 0)
+
+        do {
+            encoder.useResource(source, usage: .read)
+            self.encoder.setTexture(source, index: 0)
+        }
+        do {
+            encoder.useResource(target, usage: .write)
+            self.encoder.setTexture(target, index: 1)
+        }
+        do {
+            self.encoder.constantData(at: 2).storeBytes(of: roughness, as: Float.self)
+            self.encoder.constantData(at: 3).storeBytes(of: UInt32(sampleCount), as: UInt32.self)
+        }
+
+        return buffer
     }
 }
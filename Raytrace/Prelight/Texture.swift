@@ -14,7 +14,8 @@ extension Texture {
         size: SIMD2<Int>,
         usage: MTLTextureUsage,
         storageMode: MTLStorageMode,
-        mipmapped: Bool
+        mipmapped: Bool,
+        levelCount: Int? = nil
     ) -> (any MTLTexture)? {
         let desc = MTLTextureDescriptor.texture2DDescriptor(
             pixelFormat: format,
@@ -26,6 +27,11 @@ extension Texture {
         desc.usage = usage
         desc.storageMode = storageMode
 
+        // Fewer levels than the full chain of a mipmapped texture.
+        if let levelCount {
+            desc.mipmapLevelCount = levelCount
+        }
+
         let texture = device.makeTexture(descriptor: desc)
 
         texture?.label = label
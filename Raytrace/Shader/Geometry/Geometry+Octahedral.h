@@ -0,0 +1,42 @@
+// tomocy
+
+#pragma once
+
+#include "Geometry+Normalized.h"
+#include <metal_stdlib>
+
+namespace Shader {
+namespace Geometry {
+// Octahedral maps a unit vector onto the faces of an octahedron, unfolded into a square,
+// so that it takes 32 bits as two snorm16s with an error of less than 0.01 degrees.
+namespace Octahedral {
+inline uint encode(const thread Normalized<float3>& v)
+{
+    const auto n = v.value() / (metal::abs(v.value().x) + metal::abs(v.value().y) + metal::abs(v.value().z));
+
+    auto folded = float2(n.x, n.y);
+    if (n.z < 0) {
+        folded = float2(
+            (1 - metal::abs(n.y)) * (n.x >= 0 ? 1 : -1),
+            (1 - metal::abs(n.x)) * (n.y >= 0 ? 1 : -1)
+        );
+    }
+
+    return metal::pack_float_to_snorm2x16(folded);
+}
+
+inline Normalized<float3> decode(const uint encoded)
+{
+    const auto folded = metal::unpack_snorm2x16_to_float(encoded);
+
+    auto n = float3(folded.x, folded.y, 1 - metal::abs(folded.x) - metal::abs(folded.y));
+
+    const auto t = metal::saturate(-n.z);
+    n.x += n.x >= 0 ? -t : t;
+    n.y += n.y >= 0 ? -t : t;
+
+    return normalize(n);
+}
+}
+}
+}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "../Geometry/Geometry+Normalized.h"
+#include "../SphericalHarmonics.h"
 #include "../Texture/Texture+Cube.h"
 #include "PBR+Material.h"
 
@@ -26,6 +27,16 @@ public:
 
             return albedo * color;
         }
+
+        // Takes the irradiance from its spherical harmonics without a cube, as Prelight::Diffuse::SH reconstructs it.
+        static float3 compute(
+            const thread SphericalHarmonics::Irradiance& irradiance,
+            const thread float3& albedo,
+            const thread Geometry::Normalized<float3>& normal
+        )
+        {
+            return albedo * irradiance.at(normal.value());
+        }
     };
 
 public:
@@ -41,12 +52,17 @@ public:
         )
         {
             constexpr auto sampler = metal::sampler(
-                metal::filter::linear
+                metal::filter::linear,
+                metal::mip_filter::linear
             );
 
             const auto reflect = metal::reflect(view.value(), normal.value());
 
-            const auto color = source.sample(sampler, reflect).rgb;
+            // The source has a level for each step of roughness, from 0 on the first to 1 on the last,
+            // as Prelight::Specular prefilters it.
+            const auto lod = roughness * float(source.get_num_mip_levels() - 1);
+
+            const auto color = source.sample(sampler, reflect, metal::level(lod)).rgb;
 
             const auto dotNV = metal::saturate(
                 metal::dot(normal.value(), view.value())
@@ -16,80 +16,63 @@ public:
         float3 specular;
     };
 
-    Albedo albedoAt(const thread float2& coordinate) const constant
-    {
-        return AddressSpace::Thread::from(*this).albedoAt(coordinate);
-    }
-
-    Albedo albedoAt(const thread float2& coordinate) const thread
-    {
-        const auto metalness = metalnessAt(coordinate);
-        const auto raw = rawAlbedoAt(coordinate).rgb;
-
-        return {
-            .diffuse = Interpolate::linear(float3(0), raw, 1.0 - metalness),
-            .specular = Interpolate::linear(float3(0.04), raw, metalness),
-        };
-    }
-
-    float4 rawAlbedoAt(const thread float2& coordinate) const constant
-    {
-        return AddressSpace::Thread::from(*this).rawAlbedoAt(coordinate);
-    }
-
-    float4 rawAlbedoAt(const thread float2& coordinate) const thread
-    {
-        constexpr auto sampler = metal::sampler(
-            metal::filter::linear
-        );
+    // Texel is what the textures of the material have at a coordinate, fetched once for all the properties of a hit.
+    struct Texel {
+    public:
+        Albedo albedo() const
+        {
+            return {
+                .diffuse = Interpolate::linear(float3(0), rawAlbedo.rgb, 1.0 - metalness),
+                .specular = Interpolate::linear(float3(0.04), rawAlbedo.rgb, metalness),
+            };
+        }
 
-        return albedo.sample(sampler, coordinate);
-    }
+        bool isMetallic() const { return metalness == 1; }
 
-public:
-    metal::texture2d<float> albedo;
+    public:
+        float4 rawAlbedo;
+        float metalness;
+        float roughness;
+    };
 
 public:
-    bool isMetalicAt(const thread float2& coordinate) const constant
-    {
-        return AddressSpace::Thread::from(*this).isMetalicAt(coordinate);
-    }
-
-    bool isMetalicAt(const thread float2& coordinate) const thread
+#if defined(__METAL_VERSION__)
+    Texel texelAt(const thread float2& coordinate, const float footprint) const constant
     {
-        return metalnessAt(coordinate) == 1;
+        return AddressSpace::Thread::from(*this).texelAt(coordinate, footprint);
     }
+#endif
 
-    float metalnessAt(const thread float2& coordinate) const constant
-    {
-        return AddressSpace::Thread::from(*this).metalnessAt(coordinate);
-    }
-
-    float metalnessAt(const thread float2& coordinate) const thread
+    // The footprint is how much of the texture coordinate the ray covers around the coordinate,
+    // from which each texture picks the level whose texels are about as large.
+    Texel texelAt(const thread float2& coordinate, const float footprint) const thread
     {
         constexpr auto sampler = metal::sampler(
-            metal::filter::linear
+            metal::filter::linear,
+            metal::mip_filter::linear
         );
 
-        return metalRoughness.sample(sampler, coordinate).r;
-    }
+        const auto metalRoughness = this->metalRoughness.sample(
+            sampler, coordinate, metal::level(levelOf(this->metalRoughness, footprint))
+        );
 
-public:
-    float roughnessAt(const thread float2& coordinate) const constant
-    {
-        return AddressSpace::Thread::from(*this).roughnessAt(coordinate);
+        return {
+            .rawAlbedo = albedo.sample(sampler, coordinate, metal::level(levelOf(albedo, footprint))),
+            .metalness = metalRoughness.r,
+            .roughness = metal::max(metalRoughness.g, 0.04),
+        };
     }
 
-    float roughnessAt(const thread float2& coordinate) const thread
+private:
+    static float levelOf(const thread metal::texture2d<float>& texture, const float footprint)
     {
-        constexpr auto sampler = metal::sampler(
-            metal::filter::linear
-        );
-
-        return metal::max(metalRoughness.sample(sampler, coordinate).g, 0.04);
+        const auto size = float(metal::max(texture.get_width(), texture.get_height()));
+        return metal::max(metal::log2(footprint * size), 0.0f);
     }
 
 public:
+    metal::texture2d<float> albedo;
+
     // R for metalness, G for roughness.
     metal::texture2d<float> metalRoughness;
 };
@@ -0,0 +1,108 @@
+// tomocy
+
+#pragma once
+
+#include <metal_stdlib>
+
+namespace Shader {
+namespace Sequence {
+// Sobol is the first 4 dimensions of the Sobol sequence (with the direction numbers of Joe and Kuo),
+// Owen-scrambled by hashing (Burley, Practical Hash-based Owen Scrambling),
+// so that each seed gets a sequence of its own which keeps the strata of the original.
+struct Sobol {
+private:
+    // The direction of each bit of the index in each dimension, where the first is the van der Corput sequence.
+    static constexpr constant uint32_t directions[4][32] = {
+        {
+            0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000, //
+            0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000, //
+            0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100, //
+            0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001, //
+        },
+        {
+            0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000, //
+            0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000, //
+            0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00, //
+            0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff, //
+        },
+        {
+            0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000, 0x5c000000, 0x8e000000, 0xc5000000, //
+            0x68800000, 0x9cc00000, 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000, 0x90550000, //
+            0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000, 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500, //
+            0x8000e880, 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c, 0x8e00eeee, 0xc5005555, //
+        },
+        {
+            0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000, 0x74000000, 0xa2000000, 0x93000000, //
+            0xd8800000, 0x25400000, 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000, 0xc3050000, //
+            0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000, 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00, //
+            0x58800080, 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074, 0x200200a2, 0x50050093, //
+        },
+    };
+
+public:
+    // The point at the index of the sequence of the seed, whose index is shuffled by scrambling it as well,
+    // so that sequences of different seeds do not line up sample by sample.
+    static float4 at(const uint32_t index, const uint32_t seed)
+    {
+        const auto shuffled = scramble(index, hash(seed));
+
+        uint32_t values[4] = {};
+        pointsAt(shuffled, values);
+
+        float4 point;
+        for (uint32_t dimension = 0; dimension < 4; dimension++) {
+            point[dimension] = toFloat(scramble(values[dimension], hash(seed + 1 + dimension)));
+        }
+
+        return point;
+    }
+
+    // A hash of the bits of the value (lowbias32 of Wellons), which seeds take apart with.
+    static uint32_t hash(uint32_t value)
+    {
+        value ^= value >> 16;
+        value *= 0x7feb352d;
+        value ^= value >> 15;
+        value *= 0x846ca68b;
+        value ^= value >> 16;
+
+        return value;
+    }
+
+private:
+    // Takes a step for every bit of the index for all the dimensions at once, without a branch,
+    // as the shuffled index has random bits all over, which a branch would mispredict.
+    static void pointsAt(const uint32_t index, thread uint32_t (&values)[4])
+    {
+        for (uint32_t bit = 0; bit < 32; bit++) {
+            const auto mask = 0u - ((index >> bit) & 1u);
+
+            for (uint32_t dimension = 0; dimension < 4; dimension++) {
+                values[dimension] ^= directions[dimension][bit] & mask;
+            }
+        }
+    }
+
+    // Flips each bit by a hash of the bits above it, as a permutation that only carries each bit into lower ones
+    // (Laine and Karras) does on the reversed bits.
+    static uint32_t scramble(uint32_t value, const uint32_t seed)
+    {
+        value = metal::reverse_bits(value);
+
+        value += seed;
+        value ^= value * 0x6c50b47c;
+        value ^= value * 0xb82f1e52;
+        value ^= value * 0xc7afe638;
+        value ^= value * 0x8d22f6e6;
+
+        return metal::reverse_bits(value);
+    }
+
+    // Keeps the 24 bits that a float holds, so that the value stays below 1.
+    static float toFloat(const uint32_t value)
+    {
+        return float(value >> 8) / 16777216.0;
+    }
+};
+}
+}
@@ -0,0 +1,103 @@
+// tomocy
+
+#pragma once
+
+#include <metal_stdlib>
+
+namespace Shader {
+namespace SphericalHarmonics {
+// Irradiance holds radiance projected onto the first 3 bands of real spherical harmonics (9 coefficients),
+// which is all that the irradiance of a Lambertian surface keeps of it (Ramamoorthi and Hanrahan, 2001):
+// the cosine lobe has no energy in the 4th band and hardly any beyond.
+struct Irradiance {
+public:
+    static constexpr constant uint coefficientCount = 9;
+
+    struct Basis {
+    public:
+        float values[coefficientCount];
+    };
+
+    static Basis basisOf(const float3 direction)
+    {
+        const auto x = direction.x;
+        const auto y = direction.y;
+        const auto z = direction.z;
+
+        return {
+            .values = {
+                0.282095f,
+
+                0.488603f * y,
+                0.488603f * z,
+                0.488603f * x,
+
+                1.092548f * x * y,
+                1.092548f * y * z,
+                0.315392f * (3 * z * z - 1),
+                1.092548f * x * z,
+                0.546274f * (x * x - y * y),
+            },
+        };
+    }
+
+    // The solid angle that a texel of a cube face covers, where inNDC is the center of the texel on the face,
+    // such as (1, y, z) on the right face, and size is the texels on a side of the face.
+    static float solidAngleOf(const float3 inNDC, const uint size)
+    {
+        const auto side = 2 / float(size);
+        const auto distance2 = metal::dot(inNDC, inNDC);
+
+        return side * side / (distance2 * metal::sqrt(distance2));
+    }
+
+public:
+    // Adds the radiance coming from the direction over the solid angle.
+    Irradiance adding(const float3 radiance, const float3 direction, const float solidAngle) const
+    {
+        const auto basis = basisOf(direction);
+
+        auto result = *this;
+        for (uint i = 0; i < coefficientCount; i++) {
+            result.coefficients[i] += radiance * (basis.values[i] * solidAngle);
+        }
+
+        return result;
+    }
+
+    Irradiance adding(const thread Irradiance& other) const
+    {
+        auto result = *this;
+        for (uint i = 0; i < coefficientCount; i++) {
+            result.coefficients[i] += other.coefficients[i];
+        }
+
+        return result;
+    }
+
+public:
+    // The irradiance on the surface facing the normal, which is the radiance convolved with the clamped cosine.
+    float3 at(const float3 normal) const
+    {
+        // The convolution scales the coefficients of each band by its own constant.
+        constexpr float scales[coefficientCount] = {
+            M_PI_F,
+            2 * M_PI_F / 3, 2 * M_PI_F / 3, 2 * M_PI_F / 3,
+            M_PI_F / 4, M_PI_F / 4, M_PI_F / 4, M_PI_F / 4, M_PI_F / 4,
+        };
+
+        const auto basis = basisOf(normal);
+
+        float3 color = 0;
+        for (uint i = 0; i < coefficientCount; i++) {
+            color += coefficients[i] * (basis.values[i] * scales[i]);
+        }
+
+        return metal::max(color, float3(0));
+    }
+
+public:
+    float3 coefficients[coefficientCount] = {};
+};
+}
+}
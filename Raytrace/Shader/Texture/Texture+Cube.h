@@ -15,7 +15,9 @@ public:
 public:
     thread Raw& raw() { return raw_; }
     const thread Raw& raw() const { return raw_; }
+#if defined(__METAL_VERSION__)
     constant Raw& raw() constant { return raw_; }
+#endif
 
 private:
     Raw raw_;